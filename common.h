@@ -1,9 +1,22 @@
 #pragma once
 
+/**
+ * Storage modes of a group device. The mode is chosen by the
+ * thread installing the group and it is ignored whenever the
+ * group device already exists.
+ */
+#define GROUP_MODE_LIST 0 /* Semaphore protected list. */
+#define GROUP_MODE_RING 1 /* Bounded lock-free ring. */
+#define GROUP_MODE_SHARED 2 /* Ring shared with userspace by mmap(). */
+#define GROUP_MODE_SHARDED 3 /* Per-CPU lists, FIFO per writer only. */
+#define GROUP_MODE_BROADCAST 4 /* Every reader retrieves every message. */
+#define GROUP_MODE_LOG 5 /* Retained log, readers seek by offset. */
+
 struct group_t
 {
-    unsigned char desc;
+    unsigned int desc;
+    unsigned char mode;
 };
 
 #define START_MSG   "begin"
-#define DONE_MSG    "done"
\ No newline at end of file
+#define DONE_MSG    "done"
@@ -0,0 +1,546 @@
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/sort.h>
+#include <linux/mutex.h>
+#include <linux/jiffies.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "ioctl.h"
+#include "group_dev.h"
+#include "group_dev_manager.h"
+#include "message_cache.h"
+#include "checkpoint.h"
+
+/**
+ * struct checkpoint_image - an image being written or read.
+ *
+ * @file: the image
+ * @pos: offset the buffer is written or read at
+ * @buf: bytes not written yet, or read and not consumed yet
+ * @len: bytes of @buf
+ * @off: offset of the first byte not consumed from @buf
+ * @error: the first error met, later operations do nothing
+ */
+struct checkpoint_image
+{
+    struct file *file;
+    loff_t pos;
+    char *buf;
+    size_t len;
+    size_t off;
+    int error;
+};
+
+/* Opens the image and allocates its buffer. */
+static int _image_open(struct checkpoint_image *img, const char *path, int flags)
+{
+    int ret;
+
+    memset(img, 0, sizeof(struct checkpoint_image));
+    img->buf = kvmalloc(CHECKPOINT_CHUNK_SIZE, GFP_KERNEL);
+    if (!img->buf)
+    {
+        kmalloc_err("checkpoint buffer");
+        return -ENOMEM;
+    }
+
+    img->file = filp_open(path, flags | O_LARGEFILE, 0600);
+    if (IS_ERR(img->file))
+    {
+        ret = PTR_ERR(img->file);
+        kvfree(img->buf);
+        return ret;
+    }
+
+    return 0;
+}
+
+static void _image_close(struct checkpoint_image *img)
+{
+    filp_close(img->file, NULL);
+    kvfree(img->buf);
+}
+
+/* Writes the buffer to the image. */
+static void _image_flush(struct checkpoint_image *img)
+{
+    size_t done;
+    ssize_t ret;
+
+    done = 0;
+    while (!img->error && done < img->len)
+    {
+        ret = kernel_write(img->file, img->buf + done, img->len - done, &img->pos);
+        if (ret <= 0)
+        {
+            err("kernel_write %ld bytes: %ld\n", img->len - done, ret);
+            img->error = ret ? ret : -EIO;
+            break;
+        }
+        done += ret;
+    }
+    img->len = 0;
+}
+
+/* Appends bytes to the image, either from a kernel buffer or
+   from the payload of a message. */
+static void _image_write(struct checkpoint_image *img, const void *data, struct message *msg, size_t length)
+{
+    size_t done, chunk;
+
+    for (done = 0; !img->error && done < length; done += chunk)
+    {
+        if (img->len == CHECKPOINT_CHUNK_SIZE)
+        {
+            _image_flush(img);
+        }
+
+        chunk = min(length - done, CHECKPOINT_CHUNK_SIZE - img->len);
+        if (msg)
+        {
+            message_read(msg, done, img->buf + img->len, chunk);
+        }
+        else
+        {
+            memcpy(img->buf + img->len, (const char *)data + done, chunk);
+        }
+        img->len += chunk;
+    }
+}
+
+/* Consumes bytes of the image, copying them either into a
+   kernel buffer or into the payload of a message. A truncated
+   image is an error. */
+static void _image_read(struct checkpoint_image *img, void *data, struct message *msg, size_t length)
+{
+    size_t done, chunk;
+    ssize_t ret;
+
+    for (done = 0; !img->error && done < length; done += chunk)
+    {
+        if (img->off == img->len)
+        {
+            ret = kernel_read(img->file, img->buf, CHECKPOINT_CHUNK_SIZE, &img->pos);
+            if (ret <= 0)
+            {
+                err("kernel_read: %ld\n", ret);
+                img->error = ret ? ret : -EIO;
+                break;
+            }
+            img->len = ret;
+            img->off = 0;
+        }
+
+        chunk = min(length - done, img->len - img->off);
+        if (msg)
+        {
+            message_write(msg, done, img->buf + img->off, chunk);
+        }
+        else
+        {
+            memcpy((char *)data + done, img->buf + img->off, chunk);
+        }
+        img->off += chunk;
+    }
+}
+
+/* Orders messages as they were published. */
+static int _cmp_seq(const void *a, const void *b)
+{
+    const struct message *x = *(const struct message **)a;
+    const struct message *y = *(const struct message **)b;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* Writes a group device and its messages. Must be invoked
+   holding pending_sem and message_sem. */
+static void _save_group(struct checkpoint_image *img, struct group_dev *dev)
+{
+    unsigned int i, count;
+    unsigned long now;
+    u32 length;
+    struct message *msg, **msgs;
+    struct checkpoint_message rec = {};
+    struct checkpoint_group grp = {
+        .desc = dev->desc,
+        .mode = dev->mode,
+        .delay = jiffies_to_msecs(dev->delay),
+        .ttl = jiffies_to_msecs(READ_ONCE(dev->ttl)),
+    };
+
+    /* Only lists can be walked without retrieving messages. */
+    count = 0;
+    for (i = 0; dev->mode == GROUP_MODE_LIST && i < GROUP_PRIORITY_LEVELS * GROUP_TAGS; i++)
+    {
+        list_for_each_entry(msg, &dev->message_list[i], list)
+        {
+            count++;
+        }
+    }
+    list_for_each_entry(msg, dev->pending_list, list)
+    {
+        count++;
+    }
+
+    msgs = kvmalloc_array(max(count, 1U), sizeof(struct message *), GFP_KERNEL);
+    if (!msgs)
+    {
+        kmalloc_err("checkpoint messages");
+        img->error = -ENOMEM;
+        return;
+    }
+
+    /* Published messages, leaving expired ones behind. Lists
+       hold messages of a priority level and tag, newest first. */
+    count = 0;
+    if (dev->mode == GROUP_MODE_LIST)
+    {
+        for (i = 0; i < GROUP_PRIORITY_LEVELS * GROUP_TAGS; i++)
+        {
+            list_for_each_entry(msg, &dev->message_list[i], list)
+            {
+                if (!message_expired(msg))
+                {
+                    msgs[count++] = msg;
+                }
+            }
+        }
+        sort(msgs, count, sizeof(struct message *), _cmp_seq, NULL);
+    }
+    grp.published = count;
+
+    /* Pending messages, the earliest last. */
+    list_for_each_entry_reverse(msg, dev->pending_list, list)
+    {
+        msgs[count++] = msg;
+    }
+    grp.pending = count - grp.published;
+
+    /* Messages of other modes cannot be reached without
+       retrieving them, nor can spilled ones without reading the
+       spill back: they are lost. */
+    if ((dev->mode != GROUP_MODE_LIST && group_has_messages(dev, NULL)) ||
+        (dev->spill && !spill_empty(dev->spill)))
+    {
+        warn("group_dev%u published messages not checkpointed, only pending ones are\n", dev->desc);
+    }
+
+    _image_write(img, &grp, NULL, sizeof(grp));
+    for (i = 0; i < count; i++)
+    {
+        length = msgs[i]->data_size;
+        _image_write(img, &length, NULL, sizeof(length));
+    }
+
+    now = jiffies;
+    for (i = 0; i < count; i++)
+    {
+        msg = msgs[i];
+        rec.priority = msg->priority;
+        rec.tag = msg->tag;
+        if (i < grp.published)
+        {
+            rec.ttl = msg->ttl && time_before(now, msg->expires) ? jiffies_to_msecs(msg->expires - now) : 0;
+            rec.ttl = msg->ttl ? max(rec.ttl, 1U) : 0;
+            rec.delay = 0;
+        }
+        else
+        {
+            rec.ttl = jiffies_to_msecs(msg->ttl);
+            rec.delay = time_before(now, msg->deadline) ? jiffies_to_msecs(msg->deadline - now) : 0;
+        }
+        _image_write(img, &rec, NULL, sizeof(rec));
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        _image_write(img, NULL, msgs[i], msgs[i]->data_size);
+    }
+    dbg("group_dev%u checkpointed with %u published and %u pending messages\n", dev->desc, grp.published, grp.pending);
+
+    kvfree(msgs);
+}
+
+int checkpoint_save(const char *path)
+{
+    int ret;
+    unsigned long desc;
+    struct group_dev *dev;
+    struct checkpoint_image img;
+    struct checkpoint_header hdr = {
+        .magic = CHECKPOINT_MAGIC,
+        .version = CHECKPOINT_VERSION,
+    };
+
+    dbg_start();
+
+    ret = _image_open(&img, path, O_WRONLY | O_CREAT | O_TRUNC);
+    if (ret)
+    {
+        err("filp_open %s: %d\n", path, ret);
+        goto exit;
+    }
+
+    /* No group device is installed or reclaimed meanwhile. */
+    mutex_lock(&group_devs->install_mutex); /* Acquire resource. */
+
+    xa_for_each(&group_devs->groups, desc, dev)
+    {
+        hdr.groups++;
+    }
+    _image_write(&img, &hdr, NULL, sizeof(hdr));
+
+    xa_for_each(&group_devs->groups, desc, dev)
+    {
+        down(dev->pending_sem); /* Acquire resource. */
+        down(dev->message_sem); /* Acquire resource. */
+        _save_group(&img, dev);
+        up(dev->message_sem); /* Release resource. */
+        up(dev->pending_sem); /* Release resource. */
+    }
+
+    mutex_unlock(&group_devs->install_mutex); /* Release resource. */
+
+    _image_flush(&img);
+    ret = img.error;
+    _image_close(&img);
+
+    if (ret)
+    {
+        err("checkpoint into %s failed: %d\n", path, ret);
+        goto exit;
+    }
+    info("%u group devices checkpointed into %s\n", hdr.groups, path);
+
+exit:
+    dbg_end();
+    return ret;
+}
+
+/* Sends the messages of a group device again. */
+static void _restore_messages(struct checkpoint_image *img, struct group_dev *dev, struct checkpoint_group *grp)
+{
+    unsigned int i, count, restored;
+    unsigned long now;
+    u64 total;
+    u32 *lengths;
+    struct message **msgs;
+    struct checkpoint_message *recs;
+
+    /* The image is not trusted: a group device cannot store
+       more messages than bytes, whatever the image claims. */
+    if (grp->pending > UINT_MAX - grp->published || grp->published + grp->pending > max_storage_size)
+    {
+        err("group_dev%u has too many messages\n", grp->desc);
+        img->error = -EINVAL;
+        return;
+    }
+
+    count = grp->published + grp->pending;
+    if (!count)
+    {
+        return;
+    }
+
+    lengths = kvmalloc_array(count, sizeof(u32), GFP_KERNEL);
+    recs = kvmalloc_array(count, sizeof(struct checkpoint_message), GFP_KERNEL);
+    msgs = kvmalloc_array(count, sizeof(struct message *), GFP_KERNEL);
+    if (!lengths || !recs || !msgs)
+    {
+        kmalloc_err("checkpoint messages");
+        img->error = -ENOMEM;
+        goto free;
+    }
+
+    _image_read(img, lengths, NULL, count * sizeof(u32));
+    _image_read(img, recs, NULL, count * sizeof(struct checkpoint_message));
+    if (img->error)
+    {
+        goto free;
+    }
+
+    /* Nor can its messages exceed the limits, checked before
+       allocating them. */
+    total = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (lengths[i] > max_message_size)
+        {
+            err("group_dev%u has a message of %u bytes\n", grp->desc, lengths[i]);
+            img->error = -EINVAL;
+            goto free;
+        }
+        total += lengths[i];
+    }
+    if (total > max_storage_size)
+    {
+        err("group_dev%u has %llu bytes of messages\n", grp->desc, total);
+        img->error = -EINVAL;
+        goto free;
+    }
+
+    /* All headers at once, from the same slab pages. */
+    if (message_alloc_bulk(lengths, count, msgs))
+    {
+        err("message_alloc_bulk %u messages\n", count);
+        img->error = -ENOMEM;
+        goto free;
+    }
+
+    now = jiffies;
+    restored = 0;
+    for (i = 0; i < count; i++)
+    {
+        _image_read(img, NULL, msgs[i], lengths[i]);
+        if (!img->error && (recs[i].priority >= GROUP_PRIORITY_LEVELS || recs[i].tag >= GROUP_TAGS))
+        {
+            err("group_dev%u has a corrupted message\n", grp->desc);
+            img->error = -EINVAL;
+        }
+        if (img->error)
+        {
+            break;
+        }
+
+        msgs[i]->priority = recs[i].priority;
+        msgs[i]->tag = recs[i].tag;
+        msgs[i]->ttl = msecs_to_jiffies(recs[i].ttl);
+        msgs[i]->deadline = now + msecs_to_jiffies(recs[i].delay);
+        if (restore_message(dev, msgs[i], i >= grp->published))
+        {
+            message_free(msgs[i]);
+            continue;
+        }
+        restored++;
+    }
+
+    /* Messages left behind by a failure. */
+    for (; i < count; i++)
+    {
+        message_free(msgs[i]);
+    }
+    info("group_dev%u restored with %u of %u messages\n", grp->desc, restored, count);
+
+free:
+    kvfree(lengths);
+    kvfree(recs);
+    kvfree(msgs);
+}
+
+
+/* Installs a group device and sends its messages again. */
+static void _restore_group(struct checkpoint_image *img)
+{
+    struct checkpoint_group grp;
+    struct group_t group_desc = {};
+    struct group_dev *dev;
+
+    _image_read(img, &grp, NULL, sizeof(grp));
+    if (img->error)
+    {
+        return;
+    }
+
+    if (grp.mode > GROUP_MODE_LOG)
+    {
+        err("group_dev%u has an unknown mode %u\n", grp.desc, grp.mode);
+        img->error = -EINVAL;
+        return;
+    }
+
+    group_desc.desc = grp.desc;
+    group_desc.mode = grp.mode;
+    /* Hold the group device, such that it cannot be reclaimed
+       while being restored. */
+    dev = install_group(&group_desc) < 0 ? NULL : get_group_ref(grp.desc);
+    if (!dev)
+    {
+        err("group_dev%u cannot be installed\n", grp.desc);
+        img->error = -ENODEV;
+        return;
+    }
+    _set_delay(dev, grp.delay);
+    WRITE_ONCE(dev->ttl, msecs_to_jiffies(grp.ttl));
+
+    _restore_messages(img, dev, &grp);
+
+    WRITE_ONCE(dev->last_used, jiffies);
+    atomic_dec(&dev->users);
+}
+
+int checkpoint_restore(const char *path)
+{
+    int ret;
+    unsigned int i;
+    struct file *file;
+    struct checkpoint_image img;
+    struct checkpoint_header hdr;
+
+    dbg_start();
+
+    ret = _image_open(&img, path, O_RDONLY);
+    if (ret)
+    {
+        if (ret == -ENOENT)
+        {
+            info("no checkpoint found into %s\n", path);
+            ret = 0;
+        }
+        else
+        {
+            err("filp_open %s: %d\n", path, ret);
+        }
+        goto exit;
+    }
+
+    _image_read(&img, &hdr, NULL, sizeof(hdr));
+    if (img.error)
+    {
+        /* An emptied image has been restored already. */
+        info("no checkpoint found into %s\n", path);
+        _image_close(&img);
+        ret = 0;
+        goto exit;
+    }
+    if (hdr.magic != CHECKPOINT_MAGIC || hdr.version != CHECKPOINT_VERSION)
+    {
+        err("%s is not a checkpoint\n", path);
+        _image_close(&img);
+        ret = -EINVAL;
+        goto exit;
+    }
+
+    for (i = 0; i < hdr.groups && !img.error; i++)
+    {
+        _restore_group(&img);
+    }
+    ret = img.error;
+    _image_close(&img);
+
+    /* The image is left as it is, such that it can be
+       inspected. */
+    if (ret)
+    {
+        err("restoring from %s failed: %d, image left in place\n", path, ret);
+        goto exit;
+    }
+    info("%u group devices restored from %s\n", hdr.groups, path);
+
+    /* Empty the image, messages restored twice would be
+       delivered twice. */
+    file = filp_open(path, O_WRONLY | O_TRUNC | O_LARGEFILE, 0600);
+    if (IS_ERR(file))
+    {
+        err("filp_open %s: %ld\n", path, PTR_ERR(file));
+        goto exit;
+    }
+    filp_close(file, NULL);
+
+exit:
+    dbg_end();
+    return ret;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <linux/fs.h>
+#include <linux/types.h>
+
+/**
+ * Path of the image group devices are checkpointed into when
+ * the module is removed, and restored from when it is loaded.
+ * Unset to never checkpoint.
+ */
+extern char *checkpoint_path;
+
+#define CHECKPOINT_MAGIC 0x54534d43 /* "TSMC" */
+#define CHECKPOINT_VERSION 1
+
+/**
+ * Bytes written to or read from an image at once.
+ */
+
+#define CHECKPOINT_CHUNK_SIZE (64 * 1024)
+
+/**
+ * struct checkpoint_header - header of an image.
+ *
+ * @magic: CHECKPOINT_MAGIC
+ * @version: CHECKPOINT_VERSION
+ * @groups: number of group devices following the header
+ */
+struct checkpoint_header
+{
+    u32 magic;
+    u32 version;
+    u32 groups;
+};
+
+/**
+ * struct checkpoint_group - header of a group device.
+ *
+ * @desc: the descriptor of the group device
+ * @mode: the storage mode of the group device
+ * @delay: the delay of the group device, in msecs
+ * @ttl: the time to live of the group device, in msecs
+ * @published: number of published messages, oldest first
+ * @pending: number of pending messages, earliest first
+ *
+ * The header is followed by the length of each message, then
+ * by a struct checkpoint_message for each message and finally
+ * by their payloads, published messages first.
+ */
+struct checkpoint_group
+{
+    u32 desc;
+    u32 mode;
+    u32 delay;
+    u32 ttl;
+    u32 published;
+    u32 pending;
+};
+
+/**
+ * struct checkpoint_message - record of a message.
+ *
+ * @priority: the priority level of the message
+ * @tag: the tag the message is labelled with
+ * @ttl: msecs the message lives for once published, 0 for no
+ * limit. For published messages, the time left.
+ * @delay: msecs left before a pending message is published
+ */
+struct checkpoint_message
+{
+    u8 priority;
+    u8 tag;
+    u16 pad;
+    u32 ttl;
+    u32 delay;
+};
+
+/**
+ * checkpoint_save() - checkpoints all group devices.
+ *
+ * @path: the image to be written, replaced if it exists
+ *
+ * Writes the configuration of every group device, together
+ * with its pending messages and, for GROUP_MODE_LIST, its
+ * published ones. Group devices are left as they are, while
+ * installations and reclamations wait for the whole image to
+ * be written. Published messages of other modes, spilled and
+ * expired messages are not saved, a warning is logged for
+ * each group device losing some.
+ *
+ * Returns:
+ * 0 - ok
+ * <0 - the image could not be written
+ */
+int checkpoint_save(const char *path);
+
+/**
+ * checkpoint_restore() - restores group devices.
+ *
+ * @path: the image to be read
+ *
+ * Installs every group device found in @path with its mode,
+ * delay and time to live, then sends its messages again, each
+ * with the time left before its publication or expiry. Once
+ * restored, the image is emptied, so that it is restored once.
+ * Messages not fitting into the storage are dropped, while
+ * group devices claiming more messages or bytes than
+ * max_storage_size, or messages larger than max_message_size,
+ * make the image be rejected.
+ *
+ * Returns:
+ * 0 - ok, or no image found at @path
+ * <0 - the image could not be read or was rejected, group
+ * devices found before the failure are restored anyway and
+ * the image is left in place
+ */
+int checkpoint_restore(const char *path);
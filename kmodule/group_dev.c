@@ -4,11 +4,25 @@
 #include <linux/kernel.h>
 #include <linux/mutex.h>
 #include <linux/jiffies.h>
+#include <linux/poll.h>
+#include <linux/highmem.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
 
 #include "../common.h"
 #include "kern.h"
 #include "ioctl.h"
 #include "group_dev.h"
+#include "group_dev_manager.h"
+#include "message_cache.h"
+
+/* Bytes stored by all group devices, and writers waiting for
+   some of them to be freed. */
+static atomic_long_t global_stored_bytes = ATOMIC_LONG_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(global_write_queue);
 
 /* Associate specialized file operations. */
 struct file_operations group_dev_fops = {
@@ -17,8 +31,15 @@ struct file_operations group_dev_fops = {
     .release = group_release,
     .read = group_read,
     .write = group_write,
+    .read_iter = group_read_iter,
+    .write_iter = group_write_iter,
+    .splice_read = group_splice_read,
+    .splice_write = group_splice_write,
+    .llseek = group_llseek,
     .unlocked_ioctl = group_unlocked_ioctl,
-    .flush = group_flush};
+    .flush = group_flush,
+    .poll = group_poll,
+    .mmap = group_mmap};
 
 void message_print(struct message *msg)
 {
@@ -86,7 +107,7 @@ void _set_delay(struct group_dev *dev, long delay)
     jiffies = msecs_to_jiffies(delay); /* msec -> jiffies. */
     dbg("msecs %ld -> %ld jiffies\n", delay, jiffies);
     dev->delay = jiffies;
-    dbg("group_dev%d delay set to %ld (%ld)\n", dev->minor, delay, dev->delay);
+    dbg("group_dev%u delay set to %ld (%ld)\n", dev->desc, delay, dev->delay);
 
     dbg_end();
     return;
@@ -106,671 +127,2922 @@ long get_delay_jiffies(struct group_dev *dev)
     return dev->delay;
 }
 
-int is_flushing(struct group_dev *dev)
+int is_barrier_up(struct group_dev *dev)
 {
     dbg_start();
-    dbg("FLUSHING_BIT is %d\n", check_bit(dev->flags, FLUSHING_BIT));
+    dbg("%d threads sleeping on the barrier\n", atomic_read(&dev->barrier_sleepers));
     dbg_end();
-    return check_bit(dev->flags, FLUSHING_BIT);
+    return atomic_read(&dev->barrier_sleepers) > 0;
 }
 
-void set_flushing(struct group_dev *dev)
+void barrier_sleep(struct group_dev *dev)
 {
+    long generation;
+
     dbg_start();
-    set_bit(dev->flags, FLUSHING_BIT); /* Flushing set up. */
+
+    /* Count the sleeper first, so that the group device is
+       never found idle meanwhile. */
+    atomic_inc(&dev->barrier_sleepers);
+    generation = atomic_long_read(&dev->barrier_generation);
+
+    /* The condition is checked after queueing, hence an awake
+       racing with this thread is never missed. */
+    swait_event_idle_exclusive(dev->wait_queue, atomic_long_read(&dev->barrier_generation) != generation);
+
+    atomic_dec(&dev->barrier_sleepers);
+    dbg("released from generation %ld\n", generation);
+
     dbg_end();
     return;
 }
 
-void clear_flushing(struct group_dev *dev)
+void barrier_awake(struct group_dev *dev)
 {
     dbg_start();
-    clear_bit(dev->flags, FLUSHING_BIT); /* Flushing cleared. */
+
+    /* End the generation, then wake up all threads of the
+       device wait queue. Threads queueing meanwhile find the
+       generation over before going to sleep. */
+    atomic_long_inc(&dev->barrier_generation);
+    swake_up_all(&dev->wait_queue);
+
     dbg_end();
     return;
 }
 
-int is_barrier_up(struct group_dev *dev)
+/* Starts a new round of the counting barrier, releasing all
+   waiting threads. Must be invoked holding count_lock. */
+static void _count_barrier_release(struct group_dev *dev)
 {
-    dbg_start();
-    dbg("BARRIER_BIT is %d\n", check_bit(dev->flags, BARRIER_BIT));
-    dbg_end();
-    return check_bit(dev->flags, BARRIER_BIT);
+    dbg("group_dev%u releases %u threads\n", dev->desc, dev->count_arrived);
+    dev->count_arrived = 0;
+    WRITE_ONCE(dev->count_generation, dev->count_generation + 1);
+    wake_up_all(&dev->count_queue);
 }
 
-void set_barrier(struct group_dev *dev)
+void count_barrier_set_parties(struct group_dev *dev, unsigned int parties)
 {
     dbg_start();
-    set_bit(dev->flags, BARRIER_BIT); /* Barrier set up. */
+
+    spin_lock(&dev->count_lock); /* Acquire resource. */
+    dev->count_parties = parties;
+    /* Threads already waiting may be enough now. */
+    if (dev->count_arrived && dev->count_arrived >= parties)
+    {
+        _count_barrier_release(dev);
+    }
+    spin_unlock(&dev->count_lock); /* Release resource. */
+
     dbg_end();
     return;
 }
 
-void clear_barrier(struct group_dev *dev)
+long count_barrier_wait(struct group_dev *dev)
 {
+    long ret;
+    u64 generation;
+
     dbg_start();
-    clear_bit(dev->flags, BARRIER_BIT); /* Barrier cleared. */
+
+    spin_lock(&dev->count_lock); /* Acquire resource. */
+    if (!dev->count_parties)
+    {
+        spin_unlock(&dev->count_lock); /* Release resource. */
+        err("group_dev%u has no party count\n", dev->desc);
+        ret = -EINVAL;
+        goto exit;
+    }
+
+    /* The last thread releases the others and goes on. */
+    if (++dev->count_arrived >= dev->count_parties)
+    {
+        _count_barrier_release(dev);
+        spin_unlock(&dev->count_lock); /* Release resource. */
+        ret = 1;
+        goto exit;
+    }
+    generation = dev->count_generation;
+    spin_unlock(&dev->count_lock); /* Release resource. */
+
+    /* Sleep until the round this thread arrived at is over. */
+    ret = wait_event_interruptible(dev->count_queue, READ_ONCE(dev->count_generation) != generation);
+    if (ret)
+    {
+        spin_lock(&dev->count_lock); /* Acquire resource. */
+        /* Leave the round, unless it was over meanwhile. */
+        if (dev->count_generation == generation)
+        {
+            dev->count_arrived--;
+        }
+        else
+        {
+            ret = 0;
+        }
+        spin_unlock(&dev->count_lock); /* Release resource. */
+    }
+
+exit:
     dbg_end();
-    return;
+    return ret;
 }
 
-int init_workqueue(struct group_dev *dev)
+/* List of messages of a priority level and tag. */
+static struct list_head *_message_list(struct group_dev *dev, unsigned int level, unsigned int tag)
 {
-    /* Create singlethrad workqueue. */
-    dev->delay_wq = create_singlethread_workqueue(DELAYED_WORKQUEUE_NAME);
-    dbg("group_dev%d create_st_workqueue\n", dev->minor);
-    return dev->delay_wq ? 0 : -1;
+    return &dev->message_list[level * GROUP_TAGS + tag];
 }
 
-void _fflush_workqueue(struct group_dev *dev)
+/* Arms the sweeping work, unless already armed or sweeping is
+   disabled. Only lists and shards can be swept. */
+static void _arm_expire_work(struct group_dev *dev)
 {
-    dbg_start();
+    unsigned int interval;
 
-    /* Check for items to be not NULL. */
-    if (!dev->pending_sem)
+    /* The interval can be changed at any time. */
+    interval = READ_ONCE(ttl_sweep_interval);
+    if (!interval)
     {
-        ref_err("pending_sem");
-        goto exit;
+        return;
     }
 
-    if (!dev->message_sem)
+    if (dev->mode == GROUP_MODE_LIST || dev->mode == GROUP_MODE_SHARDED)
     {
-        ref_err("message_sem");
-        goto exit;
+        queue_delayed_work(system_wq, &dev->expire_work, msecs_to_jiffies(interval));
     }
+}
 
-    if (!dev->pending_list)
+/* Numbers a message being published. */
+static void _stamp_publication(struct group_dev *dev, struct message *msg)
+{
+    msg->header.seq = atomic64_inc_return(&dev->published);
+    msg->header.published = ktime_get_ns();
+}
+
+/* Starts the time to live of a message being published. */
+static void _stamp_expiry(struct group_dev *dev, struct message *msg)
+{
+    if (!msg->ttl)
     {
-        ref_err("pending_list");
-        goto exit;
+        return;
     }
 
-    if (!dev->message_list)
+    msg->expires = jiffies + msg->ttl;
+    if (!READ_ONCE(dev->expiring))
     {
-        ref_err("message_list");
-        goto exit;
+        WRITE_ONCE(dev->expiring, 1);
     }
+    _arm_expire_work(dev);
+}
 
-    down(dev->pending_sem); /* Acquire resource. */
-    down(dev->message_sem); /* Acquire resource. */
+/* Frees an expired message removed from the group device,
+   giving its storage back. */
+static void _drop_expired(struct group_dev *dev, struct message *msg)
+{
+    storage_uncharge(dev, msg->data_size);
+    message_free(msg);
+    atomic_long_inc(&dev->expired);
+}
 
-    /* Join pending_list to message_list. */
-    /*
-       Before join:
-        pending_list := A-B-C
-        message_list := D-E-F
-       After join:
-        pending_list := empty
-        message_list := A-B-C-D-E-F
-    */
-    list_splice_tail_init(dev->pending_list, dev->message_list);
-    dbg("pending_list joined to message_list\n");
-    up(dev->pending_sem); /* Release resource. */
-    up(dev->message_sem); /* Release resource. */
+/* Links a message as the newest one of its priority level and
+   tag. Must be invoked holding message_sem. */
+static void _list_link_message(struct group_dev *dev, struct message *msg)
+{
+    list_add(&msg->list, _message_list(dev, msg->priority, msg->tag));
+    set_bit(dev->tags[msg->priority], msg->tag);
+    set_bit(dev->priorities, msg->priority);
+}
 
-exit:
-    dbg_end();
-    return;
+/* Accounts for a message regardless of the limits. The message
+   is spilled as soon as it is published. */
+static void _storage_force_charge(struct group_dev *dev, size_t size)
+{
+    atomic_long_add(size, &dev->stored_bytes);
+    atomic_long_add(size, &global_stored_bytes);
 }
 
-void fflush_workqueue(struct group_dev *dev)
+/* Checks whether forced charges exceeded the limits. */
+static int _over_budget(struct group_dev *dev)
 {
-    struct work *work;
-    struct list_head *pos, *q;
-    dbg_start();
+    return atomic_long_read(&dev->stored_bytes) > max_storage_size ||
+           (max_global_storage_size && atomic_long_read(&global_stored_bytes) > max_global_storage_size);
+}
 
-    /* Check dev. */
-    if (!dev)
+/* Only messages of priority level 0 and tag 0 are spilled,
+   such that they only need to follow the messages of their own
+   list: messages of higher levels are served first anyway, and
+   readers of other tags never wait for the spill. */
+static int _may_spill(struct group_dev *dev, unsigned char priority, unsigned char tag)
+{
+    return dev->spill && !priority && !tag;
+}
+
+/* Moves a published message to the spill, giving its storage
+   back. Must be invoked holding message_sem. */
+static int _spill_message(struct group_dev *dev, struct message *msg)
+{
+    if (spill_push(dev->spill, msg))
     {
-        ref_err("dev");
-        goto exit;
+        return -1;
     }
 
-    /* First, move all pending messages. */
-    _fflush_workqueue(dev);
+    dev->messages_number--;
+    storage_uncharge(dev, msg->data_size);
+    message_free(msg);
+    return 0;
+}
 
-    /* Check for items to be not NULL. */
-    if (!dev->delay_wq)
+/* Adds a message as the newest one of its priority level and
+   tag. Once messages are spilled, newer ones of their list
+   follow them until they are brought back. If the spill cannot
+   be written, the message is kept anyway. Must be invoked
+   holding message_sem. */
+static void _list_add_message(struct group_dev *dev, struct message *msg)
+{
+    /* Under message_sem, hence numbered in list order. */
+    _stamp_publication(dev, msg);
+    _stamp_expiry(dev, msg);
+
+    /* Spilled messages keep their order among tags. */
+    msg->seq = dev->next_seq++;
+    if (_may_spill(dev, msg->priority, msg->tag) && (!spill_empty(dev->spill) || _over_budget(dev)) &&
+        !_spill_message(dev, msg))
     {
-        ref_err("delay_wq");
-        goto exit;
+        return;
     }
+    _list_link_message(dev, msg);
+}
 
-    if (!dev->delay_list)
+/* Finds the oldest message with one of the given tags, from
+   the highest priority level having any. Only the heads of the
+   lists of those tags are compared. Must be invoked holding
+   message_sem. */
+static struct message *_list_peek_message(struct group_dev *dev, u32 tags)
+{
+    unsigned int level, tag;
+    unsigned long levels, candidates;
+    struct message *msg, *head;
+
+    /* Highest level with a message of interest. */
+    candidates = 0;
+    levels = dev->priorities;
+    while (levels)
     {
-        ref_err("delay_list");
-        goto exit;
+        level = __fls(levels);
+        candidates = dev->tags[level] & tags;
+        if (candidates)
+        {
+            break;
+        }
+        clear_bit(levels, level);
     }
 
-    if (!dev->wq_sem)
+    if (!candidates)
     {
-        ref_err("wq_sem");
-        goto exit;
+        return NULL;
+    }
+
+    /* Oldest message among the heads of the candidate lists. */
+    msg = NULL;
+    while (candidates)
+    {
+        tag = __ffs(candidates);
+        clear_bit(candidates, tag);
+        head = list_last_entry(_message_list(dev, level, tag), struct message, list);
+        if (!msg || head->seq < msg->seq)
+        {
+            msg = head;
+        }
     }
 
-    /* All delayed work is going to be executed. */
-    down(dev->wq_sem); /* Acquire resource. */
+    return msg;
+}
 
-    set_flushing(dev); /* Set flushing flag. */
+/* Brings spilled messages back, the oldest first, as long as
+   the storage allows, once the list they follow is empty.
+   Readers of their tag must make progress, hence a message is
+   brought back anyway if the reader finds no other one. Must
+   be invoked holding message_sem. */
+static void _spill_refill(struct group_dev *dev, u32 tags)
+{
+    ssize_t length;
+    struct message *msg;
 
-    /* pending_list is empty => no work to be flushed. */
-    if (list_empty(dev->delay_list))
+    if (!(tags & 1U) || !list_empty(_message_list(dev, 0, 0)))
     {
-        dbg("delay_list empty");
-        goto dl_exit;
+        return;
     }
 
-    /* Traverse safely delay_list. */
-    list_for_each_prev_safe(pos, q, dev->delay_list)
+    while ((length = spill_next(dev->spill)) >= 0)
     {
-        work = list_entry(pos, struct work, list); /* Retrieve work. */
-        if (work)
+        if (!storage_charge(dev, length))
         {
-            dbg("work retrieved\n");
-            list_del(&work->list); /* Delete it from list. */
-            dbg("work list_del\n");
-            flush_delayed_work(&work->dwork); /* Instantly execute it. */
-            dbg("flush_delayed_work\n");
+            if (!list_empty(_message_list(dev, 0, 0)) || _list_peek_message(dev, tags))
+            {
+                break;
+            }
+            _storage_force_charge(dev, length);
         }
-        else /* Stop traversal. Crashes are in ambush. */
+
+        msg = spill_pop(dev->spill);
+        if (!msg)
         {
-            dbg("no work retrieved\n");
-            goto dl_exit;
+            storage_uncharge(dev, length);
+            break;
         }
+
+        dev->messages_number++;
+        _list_link_message(dev, msg);
     }
+}
 
-dl_exit:
-    drain_workqueue(dev->delay_wq); /* Drain the workqueue. */
-    clear_flushing(dev);            /* Reset flushing flag. */
-    up(dev->wq_sem);                /* Release resource. */
-exit:
-    dbg_end();
-    return;
+/* Removes a message from its list. Must be invoked holding
+   message_sem. */
+static void _list_del_message(struct group_dev *dev, struct message *msg)
+{
+    list_del(&msg->list);
+    if (list_empty(_message_list(dev, msg->priority, msg->tag)))
+    {
+        clear_bit(dev->tags[msg->priority], msg->tag);
+        if (!dev->tags[msg->priority])
+        {
+            clear_bit(dev->priorities, msg->priority);
+        }
+    }
 }
 
-void delayed_work_fun(struct work_struct *work)
+/* Removes the oldest message with one of the given tags, as
+   _list_peek_message() finds it, dropping expired messages on
+   the way. Must be invoked holding message_sem. */
+static struct message *_list_take_message(struct group_dev *dev, u32 tags)
 {
-    struct group_dev *dev;
     struct message *msg;
-    struct delayed_work *dwork_p;
-    struct work *dwork;
 
-    dbg_start();
+    /* Spilled messages are newer than any other one of their
+       list. */
+    if (dev->spill)
+    {
+        _spill_refill(dev, tags);
+    }
 
-    /* Check work. */
-    if (!work)
+    while ((msg = _list_peek_message(dev, tags)))
     {
-        ref_err("work");
-        goto exit;
+        _list_del_message(dev, msg);
+        if (!message_expired(msg))
+        {
+            return msg;
+        }
+        dev->messages_number--;
+        _drop_expired(dev, msg);
     }
 
-    /* Need to convert work to delayed work and to 
-       retrieve the specific structure. */
-    dwork_p = to_delayed_work(work);
-    dwork = container_of(dwork_p, struct work, dwork);
+    return NULL;
+}
+
+/* Drops expired messages from the oldest end of every list,
+   stopping at the first message still alive. Must be invoked
+   holding message_sem. */
+static void _list_expire(struct group_dev *dev)
+{
+    unsigned int level, tag;
+    unsigned long levels, tags;
+    struct list_head *head;
+    struct message *msg;
 
-    if (!dwork)
+    levels = dev->priorities;
+    while (levels)
     {
-        ref_err("dwork");
-        goto exit;
+        level = __ffs(levels);
+        clear_bit(levels, level);
+
+        tags = dev->tags[level];
+        while (tags)
+        {
+            tag = __ffs(tags);
+            clear_bit(tags, tag);
+
+            head = _message_list(dev, level, tag);
+            while (!list_empty(head))
+            {
+                msg = list_last_entry(head, struct message, list);
+                if (!message_expired(msg))
+                {
+                    break;
+                }
+                _list_del_message(dev, msg);
+                dev->messages_number--;
+                _drop_expired(dev, msg);
+            }
+        }
     }
+}
 
-    dev = dwork->dev;
-    if (!dev)
+/* Drops the expired messages which can be reached without
+   removing live ones. */
+static void _expire_messages(struct group_dev *dev)
+{
+    unsigned int count;
+    struct message *msg, *tmp;
+    struct list_head expired;
+
+    switch (dev->mode)
     {
-        ref_err("dev");
-        goto exit;
+    case GROUP_MODE_LIST:
+        down(dev->message_sem); /* Acquire resource. */
+        _list_expire(dev);
+        up(dev->message_sem); /* Release resource. */
+        return;
+    case GROUP_MODE_SHARDED:
+        INIT_LIST_HEAD(&expired);
+        count = shards_expire(dev->shards, &expired);
+        list_for_each_entry_safe(msg, tmp, &expired, list)
+        {
+            list_del(&msg->list);
+            _drop_expired(dev, msg);
+        }
+        dbg("group_dev%u dropped %u expired messages\n", dev->desc, count);
+        return;
     }
+}
 
-    if (!dev->wq_sem)
+void expire_work_fun(struct work_struct *work)
+{
+    struct group_dev *dev;
+
+    dbg_start();
+
+    dev = container_of(to_delayed_work(work), struct group_dev, expire_work);
+    _expire_messages(dev);
+
+    /* Messages left may expire later on. */
+    if (group_has_messages(dev, NULL))
     {
-        ref_err("wq_sem");
-        goto exit;
+        _arm_expire_work(dev);
     }
 
-    /* Need to check all semaphores and lists to be not null. */
-    if (!dev->pending_sem)
+    dbg_end();
+    return;
+}
+
+/* Drops the oldest message of the lowest priority level, which
+   must have some. Must be invoked holding message_sem. */
+static void _list_drop_lowest(struct group_dev *dev)
+{
+    unsigned int level, tag;
+    unsigned long tags;
+    struct message *msg, *head;
+
+    level = __ffs(dev->priorities);
+    tags = dev->tags[level];
+
+    msg = NULL;
+    while (tags)
     {
-        ref_err("dev->pending_sem");
-        goto exit;
+        tag = __ffs(tags);
+        clear_bit(tags, tag);
+        head = list_last_entry(_message_list(dev, level, tag), struct message, list);
+        if (!msg || head->seq < msg->seq)
+        {
+            msg = head;
+        }
     }
 
-    if (!dev->pending_list)
+    _list_del_message(dev, msg);
+    dev->messages_number--;
+    storage_uncharge(dev, msg->data_size);
+    message_free(msg);
+}
+
+unsigned long group_shrink_count(struct shrinker *shrinker, struct shrink_control *sc)
+{
+    struct group_dev *dev;
+
+    dev = container_of(shrinker, struct group_dev, shrinker);
+
+    if (shrink_policy == SHRINK_POLICY_NONE)
     {
-        ref_err("dev->pending_list");
-        goto exit;
+        return 0;
     }
 
-    if (!dev->message_sem)
+    switch (dev->mode)
     {
-        ref_err("dev->message_sem");
-        goto exit;
+    case GROUP_MODE_LIST:
+        if (shrink_policy == SHRINK_POLICY_EXPIRED && !READ_ONCE(dev->expiring))
+        {
+            return 0;
+        }
+        return READ_ONCE(dev->messages_number);
+    case GROUP_MODE_SHARDED:
+        if (!READ_ONCE(dev->expiring))
+        {
+            return 0;
+        }
+        /* Shards do not count their messages, but none of them
+           exceeds max_message_size. */
+        return DIV_ROUND_UP(atomic_long_read(&dev->stored_bytes), max(max_message_size, 1U));
     }
 
-    if (!dev->message_list)
+    return 0;
+}
+
+unsigned long group_shrink_scan(struct shrinker *shrinker, struct shrink_control *sc)
+{
+    long before;
+    unsigned long freed, shrunk;
+    struct group_dev *dev;
+
+    dev = container_of(shrinker, struct group_dev, shrinker);
+    before = atomic_long_read(&dev->expired);
+    shrunk = 0;
+
+    switch (dev->mode)
     {
-        ref_err("dev->message_list");
-        goto exit;
-    }
+    case GROUP_MODE_LIST:
+        /* Memory may be reclaimed on behalf of a thread holding
+           the resource, never wait for it. */
+        if (down_trylock(dev->message_sem)) /* Acquire resource. */
+        {
+            return SHRINK_STOP;
+        }
+        _list_expire(dev);
 
-    down(dev->pending_sem); /* Acquire resource. */
+        /* Live messages go only if expired ones were not enough. */
+        freed = atomic_long_read(&dev->expired) - before;
+        while (shrink_policy == SHRINK_POLICY_PRIORITY && freed + shrunk < sc->nr_to_scan && dev->priorities)
+        {
+            _list_drop_lowest(dev);
+            shrunk++;
+        }
+        up(dev->message_sem); /* Release resource. */
+        break;
+    case GROUP_MODE_SHARDED:
+        _expire_messages(dev);
+        break;
+    }
 
-    /* No message to move. */
-    if (list_empty(dev->pending_list))
+    freed = atomic_long_read(&dev->expired) - before;
+    if (shrunk)
     {
-        dbg("pending_list empty\n");
-        goto pnd_exit;
+        warn("group_dev%u dropped %lu live messages under memory pressure\n", dev->desc, shrunk);
     }
+    dbg("group_dev%u dropped %lu expired messages under memory pressure\n", dev->desc, freed);
 
-    /* Retrieve the last pending message (according to the FIFO
-       policy) and remove it from the pending list. */
-    msg = list_last_entry(dev->pending_list, struct message, list);
+    return freed + shrunk;
+}
 
-    /* Check if any message was retrieved. */
-    if (!msg)
+/* Applies the per-file settings of the writer to a message. */
+static void _set_message_class(struct file *filp, struct message *msg)
+{
+    msg->priority = file_settings(filp)->priority;
+    msg->tag = file_settings(filp)->tag;
+    msg->ttl = file_settings(filp)->ttl;
+    if (!msg->ttl)
     {
-        dbg("no message retrieved\n");
-        goto pnd_exit;
+        msg->ttl = READ_ONCE(file_group(filp)->ttl);
     }
+}
 
-    /* Remove message from pending list. */
-    list_del(&msg->list);
+/* Whether messages sent through a file may be spilled. */
+static int _file_may_spill(struct file *filp)
+{
+    return _may_spill(file_group(filp), file_settings(filp)->priority, file_settings(filp)->tag);
+}
 
-    up(dev->pending_sem);   /* Release resource. */
-    down(dev->message_sem); /* Acquire resource. */
+/* Records who wrote a message and when. @size is the length
+   the writer asked for, before truncation. */
+static void _stamp_sender(struct message *msg, size_t size)
+{
+    msg->header.enqueued = ktime_get_ns();
+    msg->header.tgid = current->tgid;
+    msg->header.tid = current->pid;
+    msg->header.size = size;
+}
 
-    /* Add message to the message list. */
-    list_add(&msg->list, dev->message_list);
-    up(dev->message_sem); /* Release resource. */
+/* Copies the header of a message to userspace, followed by
+   @length bytes of the message. */
+static int _header_to_user(struct message *msg, char __user *buf, size_t length)
+{
+    struct group_header header = msg->header;
 
-    info("moved %ld: '%s' after %lu msecs\n", msg->data_size, msg->data, get_delay_msecs(dev));
-    goto exit;
+    header.length = length;
+    return copy_to_user(buf, &header, sizeof(struct group_header));
+}
 
-pnd_exit:
-    up(dev->pending_sem); /* Release resource. */
-exit:
-    /* Free delayed work. */
-    if (!is_flushing(dev))
-    {
-        /* When FLUSHING_BIT is set, list management is left
-           to the fflush_workqueue() function. In other terms,
-           the FLUSHING_BIT discriminates whether the delayed
-           work is being executed because timer expired or if
-           the workqueue is being flushed. Required for efficient
-           list management without crashes. */
-        dbg("not flushing\n");
-        list_del(&dwork->list);
-        dbg("dwork list_del\n");
-    }
-    kfree(dwork);
-    dbg("kfreed dwork\n");
-    dbg_end();
-    return;
+/* As _header_to_user(), but into an iterator. */
+static size_t _header_to_iter(struct message *msg, struct iov_iter *to, size_t length)
+{
+    struct group_header header = msg->header;
+
+    header.length = length;
+    return copy_to_iter(&header, sizeof(struct group_header), to);
 }
 
-void add_delayed_work(struct group_dev *dev)
+void _fflush_workqueue(struct group_dev *dev)
 {
-    struct work *work;
+    struct message *msg;
 
     dbg_start();
 
-    /* Check workqueue. */
-    if (!dev->delay_wq)
+    /* Check for items to be not NULL. */
+    if (!dev->pending_sem)
+    {
+        ref_err("pending_sem");
+        goto exit;
+    }
+
+    if (!dev->message_sem)
+    {
+        ref_err("message_sem");
+        goto exit;
+    }
+
+    if (!dev->pending_list)
     {
-        ref_err("delay_wq");
+        ref_err("pending_list");
         goto exit;
     }
 
-    /* Allocate delayed work structure. */
-    work = kmalloc(sizeof(struct work), GFP_KERNEL);
-    if (!work)
+    if (!dev->message_list)
     {
-        kmalloc_err("work");
+        ref_err("message_list");
         goto exit;
     }
 
-    /* Initialize delayed work. */
-    INIT_DELAYED_WORK(&work->dwork, delayed_work_fun);
-    dbg("delayed_work initialized\n");
-    work->dev = dev;
-    INIT_LIST_HEAD(&work->list);
+    down(dev->pending_sem); /* Acquire resource. */
+
+    /* Rings and shards cannot be joined to a list. Move pending
+       messages one by one, according to the FIFO policy. */
+    if (dev->mode != GROUP_MODE_LIST)
+    {
+        while (!list_empty(dev->pending_list))
+        {
+            msg = list_last_entry(dev->pending_list, struct message, list);
+            list_del(&msg->list);
+            _store_message(dev, msg);
+        }
+        dbg("pending_list moved to ring\n");
+        up(dev->pending_sem); /* Release resource. */
+        wake_up_interruptible_all(&dev->read_queue);
+        goto exit;
+    }
 
-    down(dev->wq_sem); /* Acquire resource. */
+    down(dev->message_sem); /* Acquire resource. */
 
-    /* Queue the delayed work into the workqueue. */
-    queue_delayed_work(dev->delay_wq, &work->dwork, dev->delay);
-    /* Add the work to the delayed work list */
-    list_add(&work->list, dev->delay_list);
+    /* Move pending messages, oldest first, to the list of their
+       priority level. */
+    while (!list_empty(dev->pending_list))
+    {
+        msg = list_last_entry(dev->pending_list, struct message, list);
+        list_del(&msg->list);
+        _list_add_message(dev, msg);
+    }
+    dbg("pending_list joined to message_list\n");
+    up(dev->pending_sem); /* Release resource. */
+    up(dev->message_sem); /* Release resource. */
 
-    up(dev->wq_sem); /* Release resource. */
-    dbg("delayed_work queued\n");
+    /* Several messages may have been published. */
+    wake_up_interruptible_all(&dev->read_queue);
 
 exit:
     dbg_end();
     return;
 }
 
-int group_open(struct inode *inode, struct file *filp)
+void fflush_workqueue(struct group_dev *dev)
 {
-    struct group_dev *dev;
-
     dbg_start();
 
-    dev = container_of(inode->i_cdev, struct group_dev, cdev);
-    /* Check for device structure. */
+    /* Check dev. */
     if (!dev)
     {
         ref_err("dev");
-        dbg_end();
-        return -1;
+        goto exit;
     }
-    /* Associate the group device structure to inode private data. */
-    filp->private_data = dev;
 
-    dbg_end();
-    return 0;
-}
+    /* Move all pending messages. The publishing work is not
+       cancelled: a message delayed meanwhile may rely on it. */
+    _fflush_workqueue(dev);
 
-int group_release(struct inode *inode, struct file *filp)
-{
-    dbg_start();
+exit:
     dbg_end();
-    return 0;
+    return;
 }
 
-ssize_t group_read(struct file *filp, char __user *buf, size_t length, loff_t *offset)
+/* Arms the publishing work for the earliest deadline, if any.
+   Must be invoked holding pending_sem. */
+static void _arm_publish_work(struct group_dev *dev)
 {
-    ssize_t ret;
+    unsigned long now;
     struct message *msg;
+
+    if (list_empty(dev->pending_list))
+    {
+        return;
+    }
+
+    msg = list_last_entry(dev->pending_list, struct message, list);
+    now = jiffies;
+    mod_delayed_work(system_wq, &dev->publish_work,
+                     time_after(msg->deadline, now) ? msg->deadline - now : 0);
+}
+
+void publish_work_fun(struct work_struct *work)
+{
+    unsigned int published;
+    unsigned long now;
     struct group_dev *dev;
+    struct message *msg, *tmp;
+    struct list_head expired;
 
     dbg_start();
-    ret = -1;
 
-    /* Check for filp. */
-    if (!filp)
-    {
-        ref_err("filp");
-        goto exit;
-    }
+    dev = container_of(to_delayed_work(work), struct group_dev, publish_work);
+    INIT_LIST_HEAD(&expired);
+    published = 0;
+    now = jiffies;
 
-    dev = filp->private_data;
-    /* Check for device structure. */
-    if (!dev)
+    down(dev->pending_sem); /* Acquire resource. */
+
+    /* The earliest deadline is the last one. Move expired
+       messages keeping the newest as the first entry. */
+    while (!list_empty(dev->pending_list))
     {
-        ref_err("dev");
-        goto exit;
+        msg = list_last_entry(dev->pending_list, struct message, list);
+        if (time_after(msg->deadline, now))
+        {
+            break;
+        }
+        list_move(&msg->list, &expired);
+        published++;
     }
 
-    down(dev->message_sem); /* Acquire resource. */
-
-    /* Check for group device message list. */
-    if (!dev->message_list)
+    /* Publish the whole batch while still holding pending_sem,
+       such that a concurrent flush cannot overtake it. */
+    if (dev->mode == GROUP_MODE_LIST)
     {
-        ref_err("list");
-        goto msg_sem_exit;
+        down(dev->message_sem); /* Acquire resource. */
+        list_for_each_entry_safe_reverse(msg, tmp, &expired, list)
+        {
+            list_del(&msg->list);
+            _list_add_message(dev, msg); /* Add message to message list. */
+        }
+        up(dev->message_sem); /* Release resource. */
     }
-
-    /* Check if group device message list is empty. */
-    if (list_empty(dev->message_list))
+    else
     {
-        dbg("message_list empty\n");
-        ret = 0;
-        goto msg_sem_exit;
+        list_for_each_entry_safe_reverse(msg, tmp, &expired, list)
+        {
+            list_del(&msg->list);
+            _store_message(dev, msg);
+        }
     }
 
-    /* Retrieve message according to FIFO policy. */
-    msg = list_last_entry(dev->message_list, struct message, list);
-    if (!msg)
+    /* Wait for the next deadline. */
+    _arm_publish_work(dev);
+
+    up(dev->pending_sem); /* Release resource. */
+
+    dbg("group_dev%u published %u delayed messages\n", dev->desc, published);
+    if (published)
     {
-        ref_err("msg");
-        goto msg_sem_exit;
+        group_wake_readers(dev, published);
     }
 
-    dbg("list has a message to be retrieved\n");
-    list_del(&msg->list);   /* Remove message from message list. */
-    dev->messages_number--; /* Decrease number of messages in the device. */
+    dbg_end();
+    return;
+}
 
-    up(dev->message_sem); /* Release resource. */
+/* Drops the oldest messages of a broadcast or log group
+   device to make room for new ones. */
+static int _evict_oldest(struct group_dev *dev)
+{
+    int ret;
+    size_t released;
 
-    /* Tailor length to actual data size. In particular:
-       if length > data_size,   send data_size bytes;
-       otherwise,               send length bytes. */
-    if (length > msg->data_size)
+    released = 0;
+    switch (dev->mode)
     {
-        length = msg->data_size;
+    case GROUP_MODE_BROADCAST:
+        ret = broadcast_evict(dev->broadcast, &released);
+        break;
+    case GROUP_MODE_LOG:
+        ret = log_evict(dev->log, &released);
+        break;
+    default:
+        return 0;
     }
 
-    /* Send data to userspace. */
-    if (copy_to_user(buf, msg->data, length))
+    if (released)
     {
-        err("copy_to_user error\n");
-        goto exit;
+        storage_uncharge(dev, released);
     }
-    info("copy_to_user %ld bytes '%s'\n", length, msg->data);
+    return ret;
+}
 
-    /* Free the message and its data. */
-    kfree(msg->data);
-    kfree(msg);
-    ret = length;
-    goto exit;
+/* Drops messages of a log group device retained for longer
+   than log_retention. */
+static void _expire_log(struct group_dev *dev)
+{
+    size_t released;
 
-msg_sem_exit:
-    up(dev->message_sem); /* Release resource. */
-    dbg_cs_end();
-exit:
-    dbg_end();
-    return ret;
+    released = 0;
+    log_expire(dev->log, msecs_to_jiffies(log_retention), &released);
+    if (released)
+    {
+        storage_uncharge(dev, released);
+    }
 }
 
-ssize_t group_write(struct file *filp, const char *buf, size_t length, loff_t *offset)
+/* Accounts for a message about to be stored: a slot of the
+   shared region, or its bytes and, in ring mode, a slot.
+   @spill tells whether the message may be spilled. */
+static int _try_acquire_storage(struct group_dev *dev, size_t size, int spill)
 {
-    char *data;
-    ssize_t ret;
-    struct message *msg;
-    struct group_dev *dev;
+    int swept;
 
-    dbg_start();
-    ret = -1;
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        return shared_ring_reserve(dev->shared);
+    }
 
-    /* Check for filp. */
-    if (!filp)
+    swept = 0;
+    while (!storage_charge(dev, size))
     {
-        ref_err("filp");
-        goto exit;
+        /* Expired messages must not keep writers out. */
+        if (READ_ONCE(dev->expiring) && !swept)
+        {
+            _expire_messages(dev);
+            swept = 1;
+            continue;
+        }
+
+        /* Writers of a list group device able to spill do not
+           wait for readers, their messages are spilled. Delayed
+           messages would keep memory until published. */
+        if (spill && !READ_ONCE(dev->delay))
+        {
+            _storage_force_charge(dev, size);
+            break;
+        }
+
+        /* Broadcast and log modes: writers do not wait for
+           readers, they drop the oldest messages instead. */
+        if (!_evict_oldest(dev))
+        {
+            return 0;
+        }
     }
 
-    dev = filp->private_data;
-    /* Check for group device structure. */
-    if (!dev)
+    if (dev->mode == GROUP_MODE_RING && !ring_reserve(dev->ring))
     {
-        ref_err("dev");
-        goto exit;
+        storage_uncharge(dev, size);
+        return 0;
     }
 
-    if (length <= 0) {
-        err("length not valid\n");
-        goto exit;
+    return 1;
+}
+
+/* Gives back what _try_acquire_storage() accounted, for a
+   message which is not going to be stored. */
+static void _release_storage(struct group_dev *dev, size_t size)
+{
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        shared_ring_unreserve(dev->shared);
+        group_wake_writers(dev);
+        return;
     }
 
-    if (length > max_message_size) {
-        length = max_message_size;
+    if (dev->mode == GROUP_MODE_RING)
+    {
+        ring_unreserve(dev->ring);
     }
+    storage_uncharge(dev, size);
+}
 
-    /* Allocate data to be added to the group device. */
-    data = kzalloc(length * sizeof(char), GFP_KERNEL);
-    if (!data)
+/* Broadcast mode: subscribes a file about to retrieve
+   messages, which then retrieves messages published from now
+   on. Files only writing never subscribe, hence never hold
+   messages back. */
+static void _join_broadcast(struct group_dev *dev, struct group_file *file)
+{
+    if (dev->mode == GROUP_MODE_BROADCAST && !smp_load_acquire(&file->subscribed))
     {
-        kzalloc_err("data");
-        /* First fail, just return error. */
-        goto exit;
+        broadcast_subscribe(dev->broadcast, &file->cursor, &file->subscribed);
     }
-    dbg("data allocated\n");
+}
 
-    msg = kzalloc(sizeof(struct message), GFP_KERNEL);
-    if (!msg)
+/* Retrieves the next message of the broadcast log for a file,
+   giving back the storage of messages leaving the log. */
+static struct message *_take_broadcast(struct group_dev *dev, struct group_file *file)
+{
+    size_t released;
+    struct message *msg;
+
+    _join_broadcast(dev, file);
+    released = 0;
+    msg = broadcast_take(dev->broadcast, &file->cursor, &released);
+    if (released)
     {
-        kzalloc_err("message");
-        /* Second fail, free previous. */
-        goto data_fail;
+        storage_uncharge(dev, released);
     }
-    dbg("msg allocated\n");
+    return msg;
+}
 
-    down(dev->message_sem); /* Acquire resource. */
+/* Retrieves the message of the log at the offset of a file. */
+static struct message *_take_logged(struct group_dev *dev, struct group_file *file)
+{
+    _expire_log(dev);
+    return log_take(dev->log, &file->cursor);
+}
+
+/* Removes the oldest message from a ring or from a shard,
+   dropping expired messages on the way. */
+static struct message *_take_alive(struct group_dev *dev)
+{
+    struct message *msg;
 
-    /* Check if there is space to host messages. */
-    if (dev->messages_number >= max_storage_size)
+    for (;;)
     {
-        warn("no space to write\n");
-        /* Third fail, must release resource. */
-        ret = 0;
-        goto msg_fail;
+        if (dev->mode == GROUP_MODE_SHARDED)
+        {
+            msg = shards_dequeue(dev->shards);
+        }
+        else
+        {
+            msg = ring_dequeue(dev->ring);
+        }
+
+        if (!msg || !message_expired(msg))
+        {
+            return msg;
+        }
+        _drop_expired(dev, msg);
     }
+}
 
-    /* Check for group device message list. */
-    if (!dev->message_list)
+/* Removes the oldest message from a ring, either private or
+   shared, or from a shard. Broadcast and logged messages are
+   retrieved for the given file only. */
+static struct message *_take_slot(struct group_dev *dev, struct group_file *file)
+{
+    switch (dev->mode)
     {
-        ref_err("message_list");
-        /* Fourth fail, must release resource. */
-        goto msg_fail;
+    case GROUP_MODE_SHARED:
+        return shared_ring_dequeue(dev->shared);
+    case GROUP_MODE_BROADCAST:
+        return _take_broadcast(dev, file);
+    case GROUP_MODE_LOG:
+        return _take_logged(dev, file);
     }
+    return _take_alive(dev);
+}
 
-    /* Get data from userspace. */
-    if (copy_from_user(data, buf, length))
+/* Gives back the storage of messages taken from the group
+   device. Slots of the shared region are accounted instead of
+   bytes, broadcast and logged messages are given back when
+   they leave the log. */
+static void _slot_taken(struct group_dev *dev, size_t size)
+{
+    switch (dev->mode)
     {
-        err("copy_from_user %ld bytes\n", length);
-        /* Fifth fail, must release resource. */
-        goto msg_fail;
+    case GROUP_MODE_SHARED:
+        group_wake_writers(dev); /* A slot has been freed. */
+        return;
+    case GROUP_MODE_BROADCAST:
+    case GROUP_MODE_LOG:
+        return;
     }
-    dbg("copy_from_user %ld bytes ", length);
+    storage_uncharge(dev, size);
+}
 
-    if (!data)
+/* Frees a message taken from the group device, unless it is
+   still retained or used by other readers. */
+static void _put_message(struct group_dev *dev, struct message *msg)
+{
+    if (dev->mode == GROUP_MODE_BROADCAST || dev->mode == GROUP_MODE_LOG)
     {
-        ref_err("\ndata");
-        /* Sixth fail, must release resource. */
-        goto msg_fail;
+        message_put(msg);
+        return;
     }
+    message_free(msg);
+}
+
+/* Makes a message whose storage was acquired available, or
+   pending if a delay was set. */
+static void _commit_message(struct group_dev *dev, struct message *msg)
+{
+    /* List mode without delay: add message to message list
+       while holding the resource. */
+    if (dev->mode == GROUP_MODE_LIST)
+    {
+        down(dev->message_sem); /* Acquire resource. */
+
+        dev->messages_number++; /* Increase number of stored messages. */
+        dbg("group_dev%u contains %d messages\n", dev->desc, dev->messages_number);
 
-    /* Apply the terminator character.
-       Could be removed due to kzalloc. */
-    data[length] = 0;
-    dbg("'%s'\n", data);
+        if (!dev->delay)
+        {
+            dbg("group_dev%u has no delay", dev->desc);
+            _list_add_message(dev, msg);             /* Add message to message list. */
+            up(dev->message_sem);                    /* Release resource. */
+            group_wake_readers(dev, 1);              /* Wake up one reader. */
+            return;
+        }
+        up(dev->message_sem); /* Release resource. */
+    }
 
-    /* Initialize message with actual data. */
-    msg->data = data;
-    msg->data_size = length;
-    dev->messages_number++; /* Increase number of stored messages. */
-    info("group_dev%d contains %d messages\n", dev->minor, dev->messages_number);
-    /* If a delay was set, add message to pending list 
-       and queue a work in the workqueue. */
+    /* If a delay was set, add message to pending list
+       ordered by deadline. */
     if (dev->delay)
     {
-        dbg("group_dev%d has a delay of %ld msecs\n", dev->minor, get_delay_msecs(dev));
-        up(dev->message_sem);                    /* Release resource. */
-        down(dev->pending_sem);                  /* Acquire resource. */
-        list_add(&msg->list, dev->pending_list); /* Add message to pending list. */
-        up(dev->pending_sem);                    /* Release resource. */
-        add_delayed_work(dev);                   /* Initalize and queue delayed work. */
-        dbg("delayed work queued\n");
+        delay_message(dev, msg);
     }
-    /* Otherwise, add message to message list. */
+    /* Otherwise, make it available right now. */
     else
     {
-        dbg("group_dev%d has no delay", dev->minor);
-        list_add(&msg->list, dev->message_list); /* Add message to message list. */
-        up(dev->message_sem);                    /* Release resource. */
-        message_list_print(dev->message_list);
+        publish_message(dev, msg);
     }
+}
 
-    info("written %ld bytes '%s' with delay %ld msecs\n", length, data, get_delay_msecs(dev));
-    ret = length;
-    goto exit;
+/* Removes the oldest published message the file may retrieve,
+   giving its storage back. */
+static struct message *_take_message(struct group_dev *dev, struct group_file *file)
+{
+    struct message *msg;
 
-/*  Each fail will return -1.
-    Second fail, must just free data.
-    All other fail must free message and relese the resource, since
-    they all sit in the critical section. */
-msg_fail:
-    up(dev->message_sem); /* Release resource. */
-    kfree(msg);
-data_fail:
-    kfree(data);
-exit:
-    dbg_end();
-    return ret;
+    if (dev->mode != GROUP_MODE_LIST)
+    {
+        msg = _take_slot(dev, file);
+        if (msg)
+        {
+            _slot_taken(dev, msg->data_size);
+        }
+        return msg;
+    }
+
+    down(dev->message_sem); /* Acquire resource. */
+
+    /* Retrieve message according to priority and FIFO policy. */
+    msg = _list_take_message(dev, file->tags);
+    if (!msg)
+    {
+        up(dev->message_sem); /* Release resource. */
+        return NULL;
+    }
+    dev->messages_number--; /* Decrease number of messages in the device. */
+    up(dev->message_sem);   /* Release resource. */
+
+    storage_uncharge(dev, msg->data_size);
+    return msg;
 }
 
-long group_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+/* As _try_acquire_storage(), but sleeps until there is space
+   unless the caller is non-blocking. */
+static int _acquire_storage(struct group_dev *dev, size_t size, int spill, int nonblock)
 {
     int ret;
-    struct group_dev *dev;
 
-    dbg_start();
-    ret = -1;
+    /* A message which cannot fit even into an empty group
+       device would wait forever. */
+    if (dev->mode != GROUP_MODE_SHARED &&
+        (size > max_storage_size || (max_global_storage_size && size > max_global_storage_size)))
+    {
+        warn("message of %ld bytes exceeds storage\n", size);
+        return -EMSGSIZE;
+    }
 
-    /* Check for filp. */
-    if (!filp)
+    while (!_try_acquire_storage(dev, size, spill))
     {
-        ref_err("filp");
-        goto exit;
+        if (nonblock)
+        {
+            dbg("no space to write\n");
+            return -EAGAIN;
+        }
+
+        ret = group_wait_space(dev, size, spill);
+        if (ret < 0)
+        {
+            return ret;
+        }
     }
 
-    dev = filp->private_data;
-    /* Check for group device structure. */
-    if (!dev)
+    return 0;
+}
+
+void _store_message(struct group_dev *dev, struct message *msg)
+{
+    size_t released;
+
+    /* Lists number messages once linked. */
+    if (dev->mode != GROUP_MODE_LIST)
     {
-        ref_err("dev");
-        goto exit;
+        _stamp_publication(dev, msg);
     }
 
-    /* IOCTL cases: */
-    /* First case,  a thread wants to sleep. 
-       Second case, a thread wants to awake the whole barrier.
-       Third case,  a thread wants to set a delay. 
-       Fourth case, a thread wants to immediatly publish delayed messages. */
-    switch (cmd)
+    /* Ring, sharded, broadcast and log modes do not need any
+       sleeping lock. */
+    switch (dev->mode)
     {
-    case IOCTL_SLEEP_ON_BARRIER:
-        info("IOCTL_SLEEP_ON_BARRIER\n");
-        set_barrier(dev); /* Set the barrier up. */
-        /* Add thread to wait queue until barrier is destroyed. */
-        wait_event(dev->wait_queue, !is_barrier_up(dev));
-        ret = 0;
-        goto exit;
-    case IOCTL_AWAKE_BARRIER:
-        info("IOCTL_AWAKE_BARRIER\n");
-        /* Check if barrier is up and the wait queue is not empty. */
-        if (is_barrier_up(dev))
+    case GROUP_MODE_RING:
+        _stamp_expiry(dev, msg);
+        ring_enqueue(dev->ring, msg);
+        return;
+    case GROUP_MODE_SHARDED:
+        _stamp_expiry(dev, msg);
+        shards_enqueue(dev->shards, msg);
+        return;
+    case GROUP_MODE_SHARED:
+        /* The shared region stores a copy of the message. */
+        if (shared_ring_enqueue(dev->shared, msg))
         {
-            clear_barrier(dev); /* Destroy the barrier. */
-            dbg("clear_barrier\n");
+            err("message lost\n");
+            shared_ring_unreserve(dev->shared);
         }
-        if (waitqueue_active(&dev->wait_queue))
+        message_free(msg);
+        return;
+    case GROUP_MODE_BROADCAST:
+        released = 0;
+        broadcast_publish(dev->broadcast, msg, &released);
+        if (released)
         {
-            /* Wake up all threads in the device wait queue. Since barrier
-               was previously destroyed, every thread awakes up. */
-            wake_up_all(&dev->wait_queue);
-            dbg("wake_up_all\n");
+            storage_uncharge(dev, released);
         }
-        ret = 0;
-        goto exit;
-    case IOCTL_SET_SEND_DELAY:
-        info("IOCTL_SET_SEND_DELAY\n");
-        if ((long) arg < 0) {
-            err("negative delay\n");
-            goto exit;
+        return;
+    case GROUP_MODE_LOG:
+        _expire_log(dev);
+        if (log_append(dev->log, msg))
+        {
+            err("message lost\n");
+            storage_uncharge(dev, msg->data_size);
+            message_free(msg);
         }
-        _set_delay(dev, (long) arg); /* Set delay. */
-        ret = 0;
-        goto exit;
-    case IOCTL_REVOKE_DELAYED_MESSAGES:
-        info("IOCTL_REVOKE_DELAYED_MESSAGES\n");
-        /* Flush the workqueue. */
-        fflush_workqueue(dev);
-        ret = 0;
-        goto exit;
+        return;
     }
 
+    down(dev->message_sem);      /* Acquire resource. */
+    _list_add_message(dev, msg); /* Add message to message list. */
+    up(dev->message_sem);        /* Release resource. */
+}
+
+void publish_message(struct group_dev *dev, struct message *msg)
+{
+    dbg_start();
+
+    _store_message(dev, msg);
+
+    /* Wake up one reader waiting for a message. */
+    group_wake_readers(dev, 1);
+    dbg_end();
+    return;
+}
+
+/* Adds a message to the pending list according to its
+   deadline. */
+static void _pend_message(struct group_dev *dev, struct message *msg)
+{
+    struct message *pos;
+
+    down(dev->pending_sem); /* Acquire resource. */
+
+    /* Keep the pending list ordered by deadline, the earliest
+       last. Unless the delay was lowered, the walk stops at the
+       first entry. */
+    list_for_each_entry(pos, dev->pending_list, list)
+    {
+        if (!time_after(pos->deadline, msg->deadline))
+        {
+            break;
+        }
+    }
+    list_add_tail(&msg->list, &pos->list); /* Add message to pending list. */
+
+    /* Move the publishing work only if the earliest deadline
+       changed. */
+    if (list_last_entry(dev->pending_list, struct message, list) == msg)
+    {
+        _arm_publish_work(dev);
+        dbg("publish_work armed\n");
+    }
+
+    up(dev->pending_sem); /* Release resource. */
+}
+
+void delay_message(struct group_dev *dev, struct message *msg)
+{
+    dbg_start();
+    dbg("group_dev%u has a delay of %ld msecs\n", dev->desc, get_delay_msecs(dev));
+
+    msg->deadline = jiffies + dev->delay;
+    _pend_message(dev, msg);
+
+    dbg_end();
+    return;
+}
+
+int restore_message(struct group_dev *dev, struct message *msg, int delayed)
+{
+    dbg_start();
+
+    /* Limits may have been lowered since the checkpoint. */
+    if (!_try_acquire_storage(dev, msg->data_size, _may_spill(dev, msg->priority, msg->tag)))
+    {
+        warn("group_dev%u has no room for a restored message\n", dev->desc);
+        dbg_end();
+        return -1;
+    }
+
+    /* The writer is long gone. */
+    memset(&msg->header, 0, sizeof(struct group_header));
+    msg->header.enqueued = ktime_get_ns();
+    msg->header.size = msg->data_size;
+
+    if (dev->mode == GROUP_MODE_LIST)
+    {
+        down(dev->message_sem); /* Acquire resource. */
+        dev->messages_number++; /* Increase number of stored messages. */
+        up(dev->message_sem);   /* Release resource. */
+    }
+
+    if (delayed)
+    {
+        _pend_message(dev, msg);
+    }
+    else
+    {
+        publish_message(dev, msg);
+    }
+
+    dbg_end();
+    return 0;
+}
+
+int group_open(struct inode *inode, struct file *filp)
+{
+    struct group_dev *dev;
+    struct group_file *file;
+
+    dbg_start();
+
+    /* Minors are assigned dynamically, resolve the group device
+       and take a reference unless it is being reclaimed. */
+    dev = get_group_by_minor(iminor(inode));
+    /* Check for device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        dbg_end();
+        return -ENODEV;
+    }
+    /* Associate per-file settings and the group device structure
+       to file private data. */
+    file = kzalloc(sizeof(struct group_file), GFP_KERNEL);
+    if (!file)
+    {
+        kzalloc_err("group_file");
+        atomic_dec(&dev->users);
+        dbg_end();
+        return -ENOMEM;
+    }
+    file->dev = dev;
+    file->tags = GROUP_TAGS_ALL;
+    mutex_init(&file->splice_mutex);
+    filp->private_data = file;
+
+    /* read_iter and write_iter honour IOCB_NOWAIT. */
+    filp->f_mode |= FMODE_NOWAIT;
+
+    dbg_end();
+    return 0;
+}
+
+int group_release(struct inode *inode, struct file *filp)
+{
+    size_t released;
+    struct group_dev *dev;
+
+    dbg_start();
+
+    dev = file_group(filp);
+    if (file_settings(filp)->tags != GROUP_TAGS_ALL)
+    {
+        atomic_dec(&dev->filtered);
+    }
+
+    /* Messages not retrieved yet stop waiting for this reader. */
+    if (dev->mode == GROUP_MODE_BROADCAST)
+    {
+        released = 0;
+        broadcast_unsubscribe(dev->broadcast, &file_settings(filp)->cursor, &file_settings(filp)->subscribed, &released);
+        if (released)
+        {
+            storage_uncharge(dev, released);
+        }
+    }
+
+    /* The rest of a partially spliced message is lost. */
+    if (file_settings(filp)->remainder)
+    {
+        _put_message(dev, file_settings(filp)->remainder);
+    }
+    kfree(filp->private_data);
+
+    /* Remember when the group device was last used, then drop
+       the reference taken at open. */
+    WRITE_ONCE(dev->last_used, jiffies);
+    atomic_dec(&dev->users);
+
+    dbg_end();
+    return 0;
+}
+
+ssize_t group_read(struct file *filp, char __user *buf, size_t length, loff_t *offset)
+{
+    ssize_t ret;
+    size_t hlen;
+    struct message *msg;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -1;
+
+    /* Check for filp. */
+    if (!filp)
+    {
+        ref_err("filp");
+        goto exit;
+    }
+
+    dev = file_group(filp);
+    /* Check for device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        goto exit;
+    }
+
+    /* Files reading headers need room for one at least. */
+    hlen = file_settings(filp)->header ? sizeof(struct group_header) : 0;
+    if (length < hlen)
+    {
+        err("buffer of %ld bytes shorter than header\n", length);
+        ret = -EINVAL;
+        goto exit;
+    }
+
+retry:
+    /* Shared mode: copy the oldest message straight from the
+       shared region. */
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        ret = shared_ring_read_user(dev->shared, buf, length);
+        if (!ret)
+        {
+            dbg("shared region empty\n");
+            goto empty;
+        }
+        group_wake_writers(dev); /* A slot has been freed. */
+        goto exit;
+    }
+
+    /* Ring, sharded, broadcast and log modes: claim the oldest
+       message without taking message_sem. */
+    if (dev->mode != GROUP_MODE_LIST)
+    {
+        msg = _take_slot(dev, file_settings(filp));
+        if (!msg)
+        {
+            dbg("ring empty\n");
+            goto empty;
+        }
+        goto copy;
+    }
+
+    down(dev->message_sem); /* Acquire resource. */
+
+    /* Check for group device message list. */
+    if (!dev->message_list)
+    {
+        ref_err("list");
+        goto msg_sem_exit;
+    }
+
+    /* Retrieve message according to priority and FIFO policy,
+       unless every message list is empty. */
+    msg = _list_take_message(dev, file_settings(filp)->tags);
+    if (!msg)
+    {
+        dbg("message_list empty\n");
+        up(dev->message_sem); /* Release resource. */
+        goto empty;
+    }
+
+    dbg("list has a message to be retrieved\n");
+    dev->messages_number--; /* Decrease number of messages in the device. */
+
+    up(dev->message_sem); /* Release resource. */
+
+copy:
+    /* The message left the group device, give its bytes back. */
+    _slot_taken(dev, msg->data_size);
+
+    /* Tailor length to actual data size. In particular:
+       if length > data_size,   send data_size bytes;
+       otherwise,               send length bytes. */
+    length -= hlen;
+    if (length > msg->data_size)
+    {
+        length = msg->data_size;
+    }
+
+    /* Send the header, if requested, then data to userspace. */
+    if (hlen && _header_to_user(msg, buf, length))
+    {
+        err("copy_to_user header\n");
+        ret = -EFAULT;
+        goto msg_exit;
+    }
+    if (message_copy_to_user(msg, buf + hlen, length))
+    {
+        err("copy_to_user error\n");
+        ret = -EFAULT;
+        goto msg_exit;
+    }
+    dbg("copy_to_user %ld bytes '%s'\n", length, msg->data);
+    ret = hlen + length;
+
+msg_exit:
+    /* Free the message and its data. */
+    _put_message(dev, msg);
+    goto exit;
+
+empty:
+    /* Non-blocking readers give up immediately. */
+    if (filp->f_flags & O_NONBLOCK)
+    {
+        ret = -EAGAIN;
+        goto exit;
+    }
+
+    /* Sleep until a message is published. Then retry, since
+       another reader may have been faster. */
+    ret = group_wait_messages(dev, file_settings(filp));
+    if (ret < 0)
+    {
+        goto exit;
+    }
+    goto retry;
+
+msg_sem_exit:
+    up(dev->message_sem); /* Release resource. */
+    dbg_cs_end();
+exit:
+    dbg_end();
+    return ret;
+}
+
+ssize_t group_write(struct file *filp, const char *buf, size_t length, loff_t *offset)
+{
+    ssize_t ret;
+    size_t size;
+    struct message *msg;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -1;
+
+    /* Check for filp. */
+    if (!filp)
+    {
+        ref_err("filp");
+        goto exit;
+    }
+
+    dev = file_group(filp);
+    /* Check for group device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        goto exit;
+    }
+
+    if (length <= 0) {
+        err("length not valid\n");
+        goto exit;
+    }
+
+    size = length;
+    if (length > max_message_size) {
+        length = max_message_size;
+    }
+
+    /* Shared mode without delay: copy data straight into the
+       shared region. */
+    if (dev->mode == GROUP_MODE_SHARED && !dev->delay)
+    {
+shared_retry:
+        ret = shared_ring_write_user(dev->shared, buf, length);
+        if (ret > 0)
+        {
+            group_wake_readers(dev, 1);              /* Wake up one reader. */
+        }
+        else if (!ret)
+        {
+            dbg("no space to write\n");
+            if (filp->f_flags & O_NONBLOCK)
+            {
+                ret = -EAGAIN;
+                goto exit;
+            }
+            ret = group_wait_space(dev, length, 0);
+            if (!ret)
+            {
+                goto shared_retry;
+            }
+        }
+        goto exit;
+    }
+
+    /* Account for the message before allocating it, such that
+       blocked writers do not pin kernel memory. */
+    ret = _acquire_storage(dev, length, _file_may_spill(filp), filp->f_flags & O_NONBLOCK);
+    if (ret < 0)
+    {
+        goto exit;
+    }
+    ret = -1;
+
+    /* Allocate the message together with room for its data. */
+    msg = message_alloc(length);
+    if (!msg)
+    {
+        err("message_alloc %ld bytes\n", length);
+        /* First fail, just give storage back. */
+        goto storage_fail;
+    }
+    _set_message_class(filp, msg);
+    _stamp_sender(msg, size);
+    dbg("msg allocated\n");
+
+    /* Get data from userspace. */
+    if (message_copy_from_user(msg, buf, length))
+    {
+        err("copy_from_user %ld bytes\n", length);
+        /* Second fail, free previous. */
+        goto msg_fail;
+    }
+    dbg("copy_from_user %ld bytes ", length);
+    dbg("'%s'\n", msg->data);
+
+    _commit_message(dev, msg);
+
+    dbg("written %ld bytes with delay %ld msecs\n", length, get_delay_msecs(dev));
+    ret = length;
+    goto exit;
+
+/*  Each fail will return -1, but the ones for missing space.
+    First fail, must just give storage back.
+    Second fail, must also free the message. */
+msg_fail:
+    message_free(msg);
+storage_fail:
+    _release_storage(dev, length);
+exit:
+    dbg_end();
+    return ret;
+}
+
+/* Whether an iterator-based request must not sleep. */
+static int _iocb_nonblock(struct kiocb *iocb)
+{
+    return (iocb->ki_flags & IOCB_NOWAIT) || (iocb->ki_filp->f_flags & O_NONBLOCK);
+}
+
+ssize_t group_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    ssize_t ret;
+    size_t length, hlen;
+    struct message *msg;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -1;
+
+    dev = file_group(iocb->ki_filp);
+    /* Check for device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        goto exit;
+    }
+
+    /* As read(), files reading headers need room for one. */
+    hlen = file_settings(iocb->ki_filp)->header ? sizeof(struct group_header) : 0;
+    if (iov_iter_count(to) < hlen)
+    {
+        err("buffers of %ld bytes shorter than header\n", iov_iter_count(to));
+        ret = -EINVAL;
+        goto exit;
+    }
+
+retry:
+    msg = _take_message(dev, file_settings(iocb->ki_filp));
+    if (!msg)
+    {
+        /* Non-blocking readers give up immediately. */
+        if (_iocb_nonblock(iocb))
+        {
+            ret = -EAGAIN;
+            goto exit;
+        }
+
+        /* Sleep until a message is published. Then retry, since
+           another reader may have been faster. */
+        ret = group_wait_messages(dev, file_settings(iocb->ki_filp));
+        if (ret < 0)
+        {
+            goto exit;
+        }
+        goto retry;
+    }
+
+    /* Scatter the message over the provided buffers, truncating
+       it as read does. */
+    length = min(iov_iter_count(to) - hlen, msg->data_size);
+    if (hlen && _header_to_iter(msg, to, length) != hlen)
+    {
+        err("copy_to_iter header\n");
+        ret = -EFAULT;
+        goto msg_exit;
+    }
+    if (message_copy_to_iter(msg, length, to) != length)
+    {
+        err("copy_to_iter %ld bytes\n", length);
+        ret = -EFAULT;
+        goto msg_exit;
+    }
+    dbg("copy_to_iter %ld bytes '%s'\n", length, msg->data);
+    ret = hlen + length;
+
+msg_exit:
+    _put_message(dev, msg);
+exit:
+    dbg_end();
+    return ret;
+}
+
+ssize_t group_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    ssize_t ret;
+    size_t length, size;
+    struct message *msg;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -1;
+
+    dev = file_group(iocb->ki_filp);
+    /* Check for group device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        goto exit;
+    }
+
+    length = iov_iter_count(from);
+    if (length <= 0) {
+        err("length not valid\n");
+        goto exit;
+    }
+
+    size = length;
+    if (length > max_message_size) {
+        length = max_message_size;
+    }
+
+    ret = _acquire_storage(dev, length, _file_may_spill(iocb->ki_filp), _iocb_nonblock(iocb));
+    if (ret < 0)
+    {
+        goto exit;
+    }
+    ret = -1;
+
+    msg = message_alloc(length);
+    if (!msg)
+    {
+        err("message_alloc %ld bytes\n", length);
+        goto storage_fail;
+    }
+    _set_message_class(iocb->ki_filp, msg);
+    _stamp_sender(msg, size);
+
+    /* Gather all buffers into a single message. */
+    if (message_copy_from_iter(msg, length, from) != length)
+    {
+        err("copy_from_iter %ld bytes\n", length);
+        ret = -EFAULT;
+        goto msg_fail;
+    }
+    dbg("copy_from_iter %ld bytes '%s'\n", length, msg->data);
+
+    _commit_message(dev, msg);
+    ret = length;
+    goto exit;
+
+msg_fail:
+    message_free(msg);
+storage_fail:
+    _release_storage(dev, length);
+exit:
+    dbg_end();
+    return ret;
+}
+
+/* Appends the content of a pipe buffer to the message being
+   spliced, without going through userspace. */
+static int _splice_to_message(struct pipe_inode_info *pipe, struct pipe_buffer *buf, struct splice_desc *sd)
+{
+    int ret;
+    char *data;
+    struct message *msg = sd->u.data;
+
+    ret = pipe_buf_confirm(pipe, buf);
+    if (unlikely(ret))
+    {
+        return ret;
+    }
+
+    data = kmap_atomic(buf->page);
+    message_write(msg, sd->num_spliced, data + buf->offset, sd->len);
+    kunmap_atomic(data);
+
+    return sd->len;
+}
+
+ssize_t group_splice_write(struct pipe_inode_info *pipe, struct file *out, loff_t *ppos, size_t length, unsigned int flags)
+{
+    ssize_t ret;
+    struct message *msg;
+    struct group_dev *dev;
+    struct splice_desc sd = {
+        .flags = flags,
+    };
+
+    dbg_start();
+    ret = -1;
+
+    /* Check for out. */
+    if (!out)
+    {
+        ref_err("out");
+        goto exit;
+    }
+
+    dev = file_group(out);
+    /* Check for group device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        goto exit;
+    }
+
+    if (length <= 0) {
+        err("length not valid\n");
+        goto exit;
+    }
+
+    /* A splice carries a single message. */
+    if (length > max_message_size) {
+        length = max_message_size;
+    }
+
+    /* Account for the largest message the pipe may provide,
+       before consuming anything from it. */
+    ret = _acquire_storage(dev, length, _file_may_spill(out), (out->f_flags & O_NONBLOCK) || (flags & SPLICE_F_NONBLOCK));
+    if (ret < 0)
+    {
+        goto exit;
+    }
+    ret = -1;
+
+    msg = message_alloc(length);
+    if (!msg)
+    {
+        err("message_alloc %ld bytes\n", length);
+        goto storage_fail;
+    }
+    _set_message_class(out, msg);
+
+    /* Move pipe content into the message. The pipe is drained
+       up to length bytes or until it is empty, whichever comes
+       first. */
+    sd.total_len = length;
+    sd.pos = *ppos;
+    sd.u.data = msg;
+    pipe_lock(pipe);
+    ret = __splice_from_pipe(pipe, &sd, _splice_to_message);
+    pipe_unlock(pipe);
+    if (ret <= 0)
+    {
+        dbg("nothing spliced\n");
+        goto msg_fail;
+    }
+
+    /* Give back what was accounted but not spliced. Slots of
+       the shared region are not accounted by size. */
+    if (dev->mode != GROUP_MODE_SHARED && ret < length)
+    {
+        storage_uncharge(dev, length - ret);
+    }
+
+    message_truncate(msg, ret);
+    dbg("spliced %ld bytes '%s'\n", ret, msg->data);
+    _stamp_sender(msg, ret);
+
+    _commit_message(dev, msg);
+    goto exit;
+
+/*  A pipe providing no data, as well as a failed allocation,
+    leaves nothing behind. */
+msg_fail:
+    message_free(msg);
+storage_fail:
+    _release_storage(dev, length);
+exit:
+    dbg_end();
+    return ret;
+}
+
+/* Pipe buffers referring to the pages of a message. The pages
+   may be shared with other readers, hence they cannot be
+   stolen. */
+static const struct pipe_buf_operations _message_pipe_buf_ops = {
+    .release = generic_pipe_buf_release,
+    .get = generic_pipe_buf_get,
+};
+
+/* Appends the pages of a page backed message to the pipe, from
+   @offset on, as long as the pipe has free buffers. Each pipe
+   buffer holds a reference to its page, which hence outlives
+   the message. */
+static ssize_t _splice_message_pages(struct pipe_inode_info *pipe, struct message *msg, size_t offset, size_t length)
+{
+    ssize_t ret, spliced;
+    struct pipe_buffer buf = {
+        .ops = &_message_pipe_buf_ops,
+    };
+
+    spliced = 0;
+    while (spliced < length)
+    {
+        buf.page = msg->pages[(offset + spliced) / PAGE_SIZE];
+        buf.offset = (offset + spliced) % PAGE_SIZE;
+        buf.len = min_t(size_t, length - spliced, PAGE_SIZE - buf.offset);
+        get_page(buf.page);
+
+        /* On failure, the pipe drops the reference itself. */
+        ret = add_to_pipe(pipe, &buf);
+        if (ret < 0)
+        {
+            return spliced ? spliced : ret;
+        }
+        spliced += ret;
+    }
+
+    return spliced;
+}
+
+ssize_t group_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe, size_t length, unsigned int flags)
+{
+    ssize_t ret;
+    size_t offset;
+    struct iov_iter to;
+    struct message *msg;
+    struct group_dev *dev;
+    struct group_file *file;
+
+    dbg_start();
+    ret = -1;
+
+    /* Check for in. */
+    if (!in)
+    {
+        ref_err("in");
+        goto exit;
+    }
+
+    dev = file_group(in);
+    /* Check for group device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        goto exit;
+    }
+
+    file = file_settings(in);
+    if (mutex_lock_interruptible(&file->splice_mutex)) /* Acquire resource. */
+    {
+        ret = -ERESTARTSYS;
+        goto exit;
+    }
+
+    /* Wait for a free pipe buffer, as the VFS does before
+       splicing. The pipe wakes writers once it is no more
+       full. */
+    while (pipe_full(pipe->head, pipe->tail, pipe->max_usage))
+    {
+        if (!pipe->readers)
+        {
+            send_sig(SIGPIPE, current, 0);
+            ret = -EPIPE;
+            goto unlock;
+        }
+        if ((in->f_flags & O_NONBLOCK) || (flags & SPLICE_F_NONBLOCK))
+        {
+            dbg("pipe full\n");
+            ret = -EAGAIN;
+            goto unlock;
+        }
+        pipe_unlock(pipe);
+        ret = wait_event_interruptible(pipe->wr_wait, !pipe->readers ||
+                                                          !pipe_full(pipe->head, pipe->tail, pipe->max_usage));
+        pipe_lock(pipe);
+        if (ret < 0)
+        {
+            goto unlock;
+        }
+    }
+
+    /* The rest of a message which did not fit into the pipe is
+       spliced before any other message. */
+    msg = file->remainder;
+    offset = file->remainder_offset;
+    file->remainder = NULL;
+
+retry:
+    if (!msg)
+    {
+        msg = _take_message(dev, file);
+        offset = 0;
+    }
+    if (!msg)
+    {
+        /* Non-blocking readers give up immediately. */
+        if ((in->f_flags & O_NONBLOCK) || (flags & SPLICE_F_NONBLOCK))
+        {
+            ret = -EAGAIN;
+            goto unlock;
+        }
+
+        /* Sleep until a message is published. Then retry, since
+           another reader may have been faster. The pipe stays
+           locked, such that the free buffer is still there. */
+        ret = group_wait_messages(dev, file);
+        if (ret < 0)
+        {
+            goto unlock;
+        }
+        goto retry;
+    }
+
+    /* The pipe is a stream: whatever does not fit into it, or
+       into length, is kept for the next splice rather than
+       lost. */
+    if (length > msg->data_size - offset)
+    {
+        length = msg->data_size - offset;
+    }
+
+    if (msg->pages)
+    {
+        /* Large messages are handed over without copying. */
+        ret = _splice_message_pages(pipe, msg, offset, length);
+        dbg("spliced %ld bytes in pages\n", ret);
+    }
+    else
+    {
+        /* Fill pipe buffers with the message content. */
+        iov_iter_pipe(&to, READ, pipe, length);
+        ret = copy_to_iter(msg->data + offset, length, &to);
+        dbg("spliced %ld bytes '%s'\n", ret, msg->data);
+    }
+
+    if (ret > 0)
+    {
+        offset += ret;
+    }
+    if (offset < msg->data_size)
+    {
+        file->remainder = msg;
+        file->remainder_offset = offset;
+    }
+    else
+    {
+        _put_message(dev, msg);
+    }
+
+unlock:
+    mutex_unlock(&file->splice_mutex); /* Release resource. */
+exit:
+    dbg_end();
+    return ret;
+}
+
+loff_t group_llseek(struct file *filp, loff_t offset, int whence)
+{
+    loff_t ret;
+    struct group_dev *dev;
+
+    dbg_start();
+
+    dev = file_group(filp);
+
+    /* Only retained messages can be read again. */
+    if (dev->mode != GROUP_MODE_LOG)
+    {
+        ret = -ESPIPE;
+        goto exit;
+    }
+
+    /* Offsets count messages, not bytes. */
+    ret = log_seek(dev->log, &file_settings(filp)->cursor, offset, whence);
+    dbg("group_dev%u offset %lld\n", dev->desc, ret);
+
+    /* Messages may be available again. */
+    if (group_has_messages(dev, file_settings(filp)))
+    {
+        group_wake_readers(dev, 1);
+    }
+
+exit:
+    dbg_end();
+    return ret;
+}
+
+struct iovec *_get_batch_iov(struct group_batch __user *ubatch, struct group_batch *batch)
+{
+    struct iovec *iov;
+
+    dbg_start();
+    iov = NULL;
+
+    /* Get batch from userspace. */
+    if (copy_from_user(batch, ubatch, sizeof(struct group_batch)))
+    {
+        err("copy_from_user batch\n");
+        goto exit;
+    }
+
+    if (!batch->vlen || batch->vlen > GROUP_BATCH_MAX)
+    {
+        err("vlen %u not valid\n", batch->vlen);
+        goto exit;
+    }
+
+    /* Allocate and get iovecs from userspace. */
+    iov = kmalloc_array(batch->vlen, sizeof(struct iovec), GFP_KERNEL);
+    if (!iov)
+    {
+        kmalloc_err("iov");
+        goto exit;
+    }
+
+    if (copy_from_user(iov, batch->iov, batch->vlen * sizeof(struct iovec)))
+    {
+        err("copy_from_user %u iovecs\n", batch->vlen);
+        kfree(iov);
+        iov = NULL;
+        goto exit;
+    }
+    dbg("batch of %u iovecs\n", batch->vlen);
+
+exit:
+    dbg_end();
+    return iov;
+}
+
+long group_send_batch(struct file *filp, struct group_batch __user *ubatch)
+{
+    long ret;
+    unsigned int i, stored;
+    size_t length;
+    struct group_batch batch;
+    struct iovec *iov;
+    struct message *msg, *tmp, *oldest;
+    struct list_head batch_list;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -1;
+    dev = file_group(filp);
+    INIT_LIST_HEAD(&batch_list);
+
+    iov = _get_batch_iov(ubatch, &batch);
+    if (!iov)
+    {
+        goto exit;
+    }
+
+    /* Build all messages outside the critical section. As in the
+       message list, the newest message is the first entry. */
+    for (i = 0; i < batch.vlen; i++)
+    {
+        length = iov[i].iov_len;
+        if (!length)
+        {
+            err("length not valid for message %u\n", i);
+            goto msg_fail;
+        }
+
+        if (length > max_message_size)
+        {
+            length = max_message_size;
+        }
+
+        msg = message_alloc(length);
+        if (!msg)
+        {
+            err("message_alloc %ld bytes\n", length);
+            goto msg_fail;
+        }
+        _set_message_class(filp, msg);
+        _stamp_sender(msg, iov[i].iov_len);
+        list_add(&msg->list, &batch_list);
+
+        if (message_copy_from_user(msg, iov[i].iov_base, length))
+        {
+            err("copy_from_user %ld bytes\n", length);
+            goto msg_fail;
+        }
+    }
+
+    /* As write(), wait for space for the oldest message unless
+       the file is non-blocking. */
+    oldest = list_last_entry(&batch_list, struct message, list);
+    ret = _acquire_storage(dev, oldest->data_size, _file_may_spill(filp), filp->f_flags & O_NONBLOCK);
+    if (ret < 0)
+    {
+        goto msg_fail;
+    }
+
+    /* Then account for storage of as many messages as possible,
+       oldest first, without waiting. */
+    stored = 1;
+    list_for_each_entry_reverse(msg, &batch_list, list)
+    {
+        if (msg == oldest)
+        {
+            continue;
+        }
+        if (!_try_acquire_storage(dev, msg->data_size, _file_may_spill(filp)))
+        {
+            break;
+        }
+        stored++;
+    }
+
+    /* Discard the newest messages, which found no space. */
+    if (stored < batch.vlen)
+    {
+        warn("no space to write %u messages\n", batch.vlen - stored);
+    }
+    for (i = stored; i < batch.vlen; i++)
+    {
+        msg = list_first_entry(&batch_list, struct message, list);
+        list_del(&msg->list);
+        message_free(msg);
+    }
+
+    /* Without delay, the whole batch joins the message list at
+       once, while holding the resource. */
+    if (dev->mode == GROUP_MODE_LIST)
+    {
+        down(dev->message_sem); /* Acquire resource. */
+        dev->messages_number += stored;
+        if (!dev->delay)
+        {
+            list_for_each_entry_safe_reverse(msg, tmp, &batch_list, list)
+            {
+                list_del(&msg->list);
+                _list_add_message(dev, msg);
+            }
+            up(dev->message_sem); /* Release resource. */
+            group_wake_readers(dev, stored);
+        }
+        else
+        {
+            up(dev->message_sem); /* Release resource. */
+        }
+    }
+
+    /* Store whatever is left, oldest message first. */
+    list_for_each_entry_safe_reverse(msg, tmp, &batch_list, list)
+    {
+        list_del(&msg->list);
+        if (dev->delay)
+        {
+            delay_message(dev, msg);
+        }
+        else
+        {
+            publish_message(dev, msg);
+        }
+    }
+
+    dbg("group_dev%u stored %u of %u messages\n", dev->desc, stored, batch.vlen);
+    ret = stored;
+    goto iov_exit;
+
+msg_fail:
+    list_for_each_entry_safe(msg, tmp, &batch_list, list)
+    {
+        list_del(&msg->list);
+        message_free(msg);
+    }
+iov_exit:
+    kfree(iov);
+exit:
+    dbg_end();
+    return ret;
+}
+
+long group_recv_batch(struct file *filp, struct group_batch __user *ubatch)
+{
+    long ret;
+    unsigned int i, taken;
+    size_t length, bytes, hlen;
+    struct group_batch batch;
+    struct iovec *iov;
+    struct message *msg, **msgs;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -1;
+    dev = file_group(filp);
+
+    iov = _get_batch_iov(ubatch, &batch);
+    if (!iov)
+    {
+        goto exit;
+    }
+
+    /* As read(), every buffer needs room for a header, if
+       requested. */
+    hlen = file_settings(filp)->header ? sizeof(struct group_header) : 0;
+    for (i = 0; i < batch.vlen; i++)
+    {
+        if (iov[i].iov_len < hlen)
+        {
+            err("buffer %u shorter than header\n", i);
+            ret = -EINVAL;
+            goto iov_exit;
+        }
+    }
+
+    /* Broadcast messages are shared among readers, hence taken
+       messages are collected into an array rather than a list. */
+    msgs = kmalloc_array(batch.vlen, sizeof(struct message *), GFP_KERNEL);
+    if (!msgs)
+    {
+        kmalloc_err("msgs");
+        goto iov_exit;
+    }
+
+    /* Remove messages according to the FIFO policy. The oldest
+       message becomes the first entry of the array. */
+retry:
+    taken = 0;
+    bytes = 0;
+    if (dev->mode != GROUP_MODE_LIST)
+    {
+        while (taken < batch.vlen && (msg = _take_slot(dev, file_settings(filp))))
+        {
+            msgs[taken++] = msg;
+            bytes += msg->data_size;
+        }
+    }
+    else
+    {
+        down(dev->message_sem); /* Acquire resource. */
+        while (taken < batch.vlen && (msg = _list_take_message(dev, file_settings(filp)->tags)))
+        {
+            msgs[taken++] = msg;
+            bytes += msg->data_size;
+        }
+        dev->messages_number -= taken; /* Decrease number of messages in the device. */
+        up(dev->message_sem);          /* Release resource. */
+    }
+    dbg("group_dev%u retrieved %u messages\n", dev->desc, taken);
+
+    /* Give storage back at once. */
+    if (taken)
+    {
+        _slot_taken(dev, bytes);
+    }
+
+    /* As read(), wait for at least one message unless the file
+       is non-blocking. */
+    if (!taken)
+    {
+        if (filp->f_flags & O_NONBLOCK)
+        {
+            ret = -EAGAIN;
+            goto msgs_exit;
+        }
+
+        ret = group_wait_messages(dev, file_settings(filp));
+        if (ret < 0)
+        {
+            goto msgs_exit;
+        }
+        goto retry;
+    }
+
+    /* Send data to userspace outside the critical section. */
+    ret = taken;
+    for (i = 0; i < taken; i++)
+    {
+        msg = msgs[i];
+
+        /* Tailor length to actual data size. */
+        length = min_t(size_t, iov[i].iov_len - hlen, msg->data_size);
+        if (ret >= 0 && hlen && _header_to_user(msg, iov[i].iov_base, length))
+        {
+            err("copy_to_user header for message %u\n", i);
+            ret = -1;
+        }
+        if (ret >= 0 && message_copy_to_user(msg, (char __user *)iov[i].iov_base + hlen, length))
+        {
+            err("copy_to_user error for message %u\n", i);
+            ret = -1;
+        }
+        iov[i].iov_len = hlen + length;
+
+        _put_message(dev, msg);
+    }
+
+    /* Let userspace know how many bytes each message carried. */
+    if (ret > 0 && copy_to_user(batch.iov, iov, taken * sizeof(struct iovec)))
+    {
+        err("copy_to_user %u iovecs\n", taken);
+        ret = -1;
+    }
+
+msgs_exit:
+    kfree(msgs);
+iov_exit:
+    kfree(iov);
+exit:
+    dbg_end();
+    return ret;
+}
+
+/* Sets the tags retrieved through a file, keeping track of the
+   files subscribed to a subset of tags. */
+static void _subscribe(struct file *filp, u32 tags)
+{
+    u32 old;
+    struct group_dev *dev;
+
+    dev = file_group(filp);
+    _join_broadcast(dev, file_settings(filp));
+    old = xchg(&file_settings(filp)->tags, tags);
+    if (old == GROUP_TAGS_ALL && tags != GROUP_TAGS_ALL)
+    {
+        atomic_inc(&dev->filtered);
+    }
+    else if (old != GROUP_TAGS_ALL && tags == GROUP_TAGS_ALL)
+    {
+        atomic_dec(&dev->filtered);
+    }
+
+    /* Messages of the new tags may be already there. */
+    if (group_has_messages(dev, file_settings(filp)))
+    {
+        group_wake_readers(dev, 1);
+    }
+}
+
+long group_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    int ret;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -1;
+
+    /* Check for filp. */
+    if (!filp)
+    {
+        ref_err("filp");
+        goto exit;
+    }
+
+    dev = file_group(filp);
+    /* Check for group device structure. */
+    if (!dev)
+    {
+        ref_err("dev");
+        goto exit;
+    }
+
+    /* IOCTL cases: */
+    /* First case,  a thread wants to sleep. 
+       Second case, a thread wants to awake the whole barrier.
+       Third case,  a thread wants to set a delay. 
+       Fourth case, a thread wants to immediatly publish delayed messages.
+       Fifth case,  a thread wants to write a batch of messages.
+       Sixth case,  a thread wants to read a batch of messages.
+       Seventh case, a thread wants to know the shared region size.
+       Eighth case, a userspace writer wants to wake up readers. */
+    switch (cmd)
+    {
+    case IOCTL_SLEEP_ON_BARRIER:
+        info("IOCTL_SLEEP_ON_BARRIER\n");
+        /* Sleep until the current generation is over. */
+        barrier_sleep(dev);
+        ret = 0;
+        goto exit;
+    case IOCTL_AWAKE_BARRIER:
+        info("IOCTL_AWAKE_BARRIER\n");
+        /* Release every thread sleeping so far. */
+        barrier_awake(dev);
+        ret = 0;
+        goto exit;
+    case IOCTL_SET_BARRIER_PARTIES:
+        info("IOCTL_SET_BARRIER_PARTIES\n");
+        if (arg > UINT_MAX)
+        {
+            err("parties %lu not valid\n", arg);
+            ret = -EINVAL;
+            goto exit;
+        }
+        count_barrier_set_parties(dev, arg);
+        ret = 0;
+        goto exit;
+    case IOCTL_WAIT_BARRIER:
+        dbg("IOCTL_WAIT_BARRIER\n");
+        ret = count_barrier_wait(dev);
+        goto exit;
+    case IOCTL_SET_SEND_DELAY:
+        info("IOCTL_SET_SEND_DELAY\n");
+        if ((long) arg < 0) {
+            err("negative delay\n");
+            goto exit;
+        }
+        _set_delay(dev, (long) arg); /* Set delay. */
+        ret = 0;
+        goto exit;
+    case IOCTL_SET_PRIORITY:
+        dbg("IOCTL_SET_PRIORITY\n");
+        if (arg >= GROUP_PRIORITY_LEVELS)
+        {
+            err("priority %lu not valid\n", arg);
+            ret = -EINVAL;
+            goto exit;
+        }
+        /* Only this file is affected. */
+        file_settings(filp)->priority = arg;
+        ret = 0;
+        goto exit;
+    case IOCTL_SET_TAG:
+        dbg("IOCTL_SET_TAG\n");
+        if (arg >= GROUP_TAGS)
+        {
+            err("tag %lu not valid\n", arg);
+            ret = -EINVAL;
+            goto exit;
+        }
+        file_settings(filp)->tag = arg;
+        ret = 0;
+        goto exit;
+    case IOCTL_SUBSCRIBE:
+        dbg("IOCTL_SUBSCRIBE\n");
+        /* A file subscribed to no tag would wait forever. */
+        if (!(u32)arg || arg > GROUP_TAGS_ALL)
+        {
+            err("tags %lx not valid\n", arg);
+            ret = -EINVAL;
+            goto exit;
+        }
+        _subscribe(filp, arg);
+        ret = 0;
+        goto exit;
+    case IOCTL_SET_GROUP_TTL:
+        info("IOCTL_SET_GROUP_TTL\n");
+        if (arg > UINT_MAX)
+        {
+            err("ttl %lu not valid\n", arg);
+            ret = -EINVAL;
+            goto exit;
+        }
+        /* Messages already written keep their own. */
+        WRITE_ONCE(dev->ttl, msecs_to_jiffies(arg));
+        ret = 0;
+        goto exit;
+    case IOCTL_SET_TTL:
+        dbg("IOCTL_SET_TTL\n");
+        if (arg > UINT_MAX)
+        {
+            err("ttl %lu not valid\n", arg);
+            ret = -EINVAL;
+            goto exit;
+        }
+        file_settings(filp)->ttl = msecs_to_jiffies(arg);
+        ret = 0;
+        goto exit;
+    case IOCTL_SET_HEADER:
+        dbg("IOCTL_SET_HEADER\n");
+        /* The shared region carries no metadata. */
+        if (dev->mode == GROUP_MODE_SHARED)
+        {
+            err("group_dev%u is shared\n", dev->desc);
+            ret = -EOPNOTSUPP;
+            goto exit;
+        }
+        file_settings(filp)->header = !!arg;
+        ret = 0;
+        goto exit;
+    case IOCTL_EXPIRED:
+        dbg("IOCTL_EXPIRED\n");
+        if (put_user(atomic_long_read(&dev->expired), (unsigned long __user *)arg))
+        {
+            err("put_user expired\n");
+            goto exit;
+        }
+        ret = 0;
+        goto exit;
+    case IOCTL_REVOKE_DELAYED_MESSAGES:
+        info("IOCTL_REVOKE_DELAYED_MESSAGES\n");
+        /* Flush the workqueue. */
+        fflush_workqueue(dev);
+        ret = 0;
+        goto exit;
+    case IOCTL_SEND_BATCH:
+        dbg("IOCTL_SEND_BATCH\n");
+        ret = group_send_batch(filp, (struct group_batch __user *)arg);
+        goto exit;
+    case IOCTL_RECV_BATCH:
+        dbg("IOCTL_RECV_BATCH\n");
+        ret = group_recv_batch(filp, (struct group_batch __user *)arg);
+        goto exit;
+    case IOCTL_SHARED_SIZE:
+        dbg("IOCTL_SHARED_SIZE\n");
+        if (dev->mode != GROUP_MODE_SHARED)
+        {
+            err("group_dev%u is not shared\n", dev->desc);
+            goto exit;
+        }
+        if (copy_to_user((unsigned long __user *)arg, &dev->shared->size, sizeof(unsigned long)))
+        {
+            err("copy_to_user shared size\n");
+            goto exit;
+        }
+        ret = 0;
+        goto exit;
+    case IOCTL_SHARED_WAKE:
+        dbg("IOCTL_SHARED_WAKE\n");
+        /* Messages were published or slots were freed from
+           userspace, possibly more than one. */
+        wake_up_interruptible_all(&dev->read_queue);
+        group_wake_writers(dev);
+        ret = 0;
+        goto exit;
+    }
+
+exit:
+    dbg_end();
+    return ret;
+}
+
+int group_has_messages(struct group_dev *dev, struct group_file *file)
+{
+    unsigned int level;
+    u32 tags;
+
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        return !shared_ring_empty(dev->shared);
+    }
+
+    if (dev->mode == GROUP_MODE_RING)
+    {
+        return !ring_empty(dev->ring);
+    }
+
+    if (dev->mode == GROUP_MODE_SHARDED)
+    {
+        return !shards_empty(dev->shards);
+    }
+
+    if (dev->mode == GROUP_MODE_BROADCAST)
+    {
+        return !broadcast_empty(dev->broadcast, file ? &file->cursor : NULL);
+    }
+
+    if (dev->mode == GROUP_MODE_LOG)
+    {
+        return !log_empty(dev->log, file ? &file->cursor : NULL);
+    }
+
+    /* Lockless peek, the reader will check again under
+       message_sem. */
+    tags = file ? READ_ONCE(file->tags) : GROUP_TAGS_ALL;
+
+    /* Spilled messages are brought back for readers of their
+       tag. */
+    if (dev->spill && (tags & 1U) && !spill_empty(dev->spill))
+    {
+        return 1;
+    }
+    for (level = 0; level < GROUP_PRIORITY_LEVELS; level++)
+    {
+        if (READ_ONCE(dev->tags[level]) & tags)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void group_wake_readers(struct group_dev *dev, unsigned int nr)
+{
+    if (dev->mode == GROUP_MODE_BROADCAST || dev->mode == GROUP_MODE_LOG || atomic_read(&dev->filtered))
+    {
+        wake_up_interruptible_all(&dev->read_queue);
+        return;
+    }
+    wake_up_interruptible_nr(&dev->read_queue, nr);
+}
+
+int group_is_idle(struct group_dev *dev)
+{
+    /* No file is open, hence nobody can add messages or raise
+       the barrier meanwhile. */
+    return !group_has_messages(dev, NULL) && list_empty(dev->pending_list) && !is_barrier_up(dev);
+}
+
+int group_wait_messages(struct group_dev *dev, struct group_file *file)
+{
+    int ret;
+
+    dbg_start();
+
+    /* Messages published while waiting are retrieved. */
+    if (file)
+    {
+        _join_broadcast(dev, file);
+    }
+
+    /* Let userspace writers know someone has to be woken up. */
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        shared_ring_sleep_begin(dev->shared);
+    }
+
+    /* Exclusive wait: each published message wakes up a single
+       reader instead of the whole herd. */
+    ret = wait_event_interruptible_exclusive(dev->read_queue, group_has_messages(dev, file));
+
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        shared_ring_sleep_end(dev->shared);
+    }
+
+    if (ret)
+    {
+        dbg("interrupted while waiting messages\n");
+        /* The wake up may have been meant for this reader. Hand
+           it over to the next one, if any message is left. */
+        if (group_has_messages(dev, NULL))
+        {
+            group_wake_readers(dev, 1);
+        }
+        ret = -ERESTARTSYS;
+    }
+
+    dbg_end();
+    return ret;
+}
+
+/* Adds size to counter, unless limit would be exceeded. */
+static int _counter_charge(atomic_long_t *counter, size_t size, unsigned long limit)
+{
+    long old, new;
+
+    old = atomic_long_read(counter);
+    do
+    {
+        new = old + size;
+        if (new > limit)
+        {
+            return 0;
+        }
+    } while (!atomic_long_try_cmpxchg(counter, &old, new));
+
+    return 1;
+}
+
+/* Lockless check against the global budget only. */
+static int _global_has_space(size_t size)
+{
+    return !max_global_storage_size ||
+           atomic_long_read(&global_stored_bytes) + size <= max_global_storage_size;
+}
+
+int global_storage_charge(size_t size)
+{
+    /* Keep counting, the budget may be set later on. */
+    if (!max_global_storage_size)
+    {
+        atomic_long_add(size, &global_stored_bytes);
+        return 1;
+    }
+
+    return _counter_charge(&global_stored_bytes, size, max_global_storage_size);
+}
+
+void global_storage_uncharge(size_t size)
+{
+    atomic_long_sub(size, &global_stored_bytes);
+    if (wq_has_sleeper(&global_write_queue))
+    {
+        wake_up_interruptible_all(&global_write_queue);
+    }
+}
+
+int storage_charge(struct group_dev *dev, size_t size)
+{
+    if (!_counter_charge(&dev->stored_bytes, size, max_storage_size))
+    {
+        return 0;
+    }
+
+    if (!global_storage_charge(size))
+    {
+        /* Someone may have failed because of the bytes which
+           are given back now. */
+        atomic_long_sub(size, &dev->stored_bytes);
+        group_wake_writers(dev);
+        return 0;
+    }
+
+    return 1;
+}
+
+void storage_uncharge(struct group_dev *dev, size_t size)
+{
+    atomic_long_sub(size, &dev->stored_bytes);
+    global_storage_uncharge(size);
+    group_wake_writers(dev);
+}
+
+void group_wake_writers(struct group_dev *dev)
+{
+    /* Pairs with the barrier of prepare_to_wait(). */
+    if (wq_has_sleeper(&dev->write_queue))
+    {
+        wake_up_interruptible_all(&dev->write_queue);
+    }
+}
+
+int group_has_space(struct group_dev *dev, size_t size, int spill)
+{
+    switch (dev->mode)
+    {
+    case GROUP_MODE_SHARED:
+        return !shared_ring_full(dev->shared);
+    case GROUP_MODE_RING:
+        if (ring_full(dev->ring))
+        {
+            return 0;
+        }
+        break;
+    case GROUP_MODE_BROADCAST:
+        /* Published messages may be dropped to make room. */
+        if (!broadcast_empty(dev->broadcast, NULL))
+        {
+            return 1;
+        }
+        break;
+    case GROUP_MODE_LOG:
+        if (!log_empty(dev->log, NULL))
+        {
+            return 1;
+        }
+        break;
+    case GROUP_MODE_LIST:
+        if (spill && !READ_ONCE(dev->delay))
+        {
+            return 1;
+        }
+        break;
+    }
+
+    return atomic_long_read(&dev->stored_bytes) + size <= max_storage_size;
+}
+
+int group_wait_space(struct group_dev *dev, size_t size, int spill)
+{
+    int ret;
+
+    dbg_start();
+
+    /* Shared regions were accounted once for all. Otherwise,
+       bytes freed by other group devices may be needed. */
+    if (dev->mode != GROUP_MODE_SHARED && !_global_has_space(size))
+    {
+        dbg("waiting for the global budget\n");
+        ret = wait_event_interruptible(global_write_queue, _global_has_space(size));
+        goto exit;
+    }
+
+    /* Let userspace readers know someone has to be woken up. */
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        shared_ring_writer_sleep_begin(dev->shared);
+    }
+
+    ret = wait_event_interruptible(dev->write_queue, group_has_space(dev, size, spill));
+
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        shared_ring_writer_sleep_end(dev->shared);
+    }
+
+exit:
+    if (ret)
+    {
+        dbg("interrupted while waiting space\n");
+        ret = -ERESTARTSYS;
+    }
+
+    dbg_end();
+    return ret;
+}
+
+__poll_t group_poll(struct file *filp, struct poll_table_struct *wait)
+{
+    __poll_t mask;
+    size_t size;
+    struct group_dev *dev;
+
+    dev = file_group(filp);
+    mask = 0;
+
+    /* Register on the read wait queue: every publication, either
+       by write or by delayed work, wakes up pollers. Register on
+       the write wait queues too, for freed storage. */
+    poll_wait(filp, &dev->read_queue, wait);
+    poll_wait(filp, &dev->write_queue, wait);
+    if (dev->mode != GROUP_MODE_SHARED && max_global_storage_size)
+    {
+        poll_wait(filp, &global_write_queue, wait);
+    }
+
+    if (dev->mode == GROUP_MODE_SHARED)
+    {
+        shared_ring_set_polled(dev->shared);
+    }
+    _join_broadcast(dev, file_settings(filp));
+
+    /* The rest of a partially spliced message can be spliced
+       too. */
+    if (group_has_messages(dev, file_settings(filp)) || READ_ONCE(file_settings(filp)->remainder))
+    {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+
+    /* Writable if a message of the maximum size fits, such that
+       any write succeeds. */
+    size = min_t(size_t, max_message_size, max_storage_size);
+    if (group_has_space(dev, size, _file_may_spill(filp)) && (dev->mode == GROUP_MODE_SHARED || _global_has_space(size)))
+    {
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    }
+
+    return mask;
+}
+
+int group_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    int ret;
+    struct group_dev *dev;
+
+    dbg_start();
+    ret = -EINVAL;
+
+    dev = file_group(filp);
+    /* Only shared group devices have something to map. */
+    if (dev->mode != GROUP_MODE_SHARED)
+    {
+        err("group_dev%u is not shared\n", dev->desc);
+        goto exit;
+    }
+
+    ret = shared_ring_mmap(dev->shared, vma);
+    dbg("group_dev%u mmap returned %d\n", dev->desc, ret);
+
 exit:
     dbg_end();
     return ret;
@@ -2,9 +2,21 @@
 
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
 #include <linux/cdev.h>
 #include <linux/workqueue.h>
 #include <linux/wait.h>
+#include <linux/swait.h>
+#include <linux/jiffies.h>
+#include <linux/shrinker.h>
+
+#include "message_broadcast.h"
+#include "message_log.h"
+#include "message_ring.h"
+#include "message_shards.h"
+#include "message_spill.h"
+#include "ioctl.h"
+#include "shared_ring.h"
 
 /**
  * Macros for correctly and easily managing bitwise operations. 
@@ -17,115 +29,508 @@
 #define toggle_bit(var, n) var ^= 1UL << n
 #define check_bit(var, n) (var >> n) & 1U
 
-#define BARRIER_BIT 0
-#define FLUSHING_BIT 1
-
 /**
- * Name of the workqueue for delayed work. 
+ * Retrieve the parameters from outside. Storage sizes are in
+ * bytes, a global size of 0 leaves the total unbounded.
  */
 
-#define DELAYED_WORKQUEUE_NAME "delayed_workqueue"
+extern unsigned int max_message_size;
+extern unsigned int max_storage_size;
+extern unsigned int max_global_storage_size;
+extern unsigned int max_broadcast_lag;
+extern unsigned int log_retention;
+extern unsigned int ttl_sweep_interval;
+extern unsigned int shrink_policy;
+extern char *spill_dir;
 
 /**
- * Retrieve the two parameters from outside.
+ * Messages the shrinker may drop under memory pressure: none,
+ * expired ones only, or expired ones first and then the
+ * oldest ones of the lowest priority level.
  */
 
-extern unsigned int max_message_size;
-extern unsigned int max_storage_size;
+#define SHRINK_POLICY_NONE 0
+#define SHRINK_POLICY_EXPIRED 1
+#define SHRINK_POLICY_PRIORITY 2
 
 /**
- * struct work - struct for delayed work.
- * 
- * @dwork: delayed work struct
- * @dev: pointer to the associated group_dev
- * @list: field required to include works into lists
- * 
- * This struct manages the publishing of messages belonging
- * to group devices whose delay is strictly greater than 0.
+ * Payloads shorter than this are stored into the message
+ * header itself (terminator character included).
  */
-struct work
-{
-    struct delayed_work dwork;
-    struct group_dev *dev;
-    struct list_head list;
-};
+
+#define MESSAGE_INLINE_SIZE 64
 
 /**
  * struct message - struct for messages.
  * 
  * @data_size: the length of the message
- * @data: the text message
+ * @deadline: jiffies at which a delayed message is published
+ * @ttl: jiffies the message lives for once published, 0 for
+ * no limit
+ * @expires: jiffies at which the published message expires,
+ * meaningful only if @ttl is not 0
+ * @priority: the priority level of the message
+ * @tag: the tag the message is labelled with
+ * @seq: order of publication, comparing messages of
+ * different tags
+ * @refs: references to a message stored once for several
+ * readers, held by the storage and by readers copying it
+ * @pending: subscribers which did not retrieve a broadcast
+ * message yet
+ * @data: the text message, NULL if page backed
+ * @buffer: payload buffer from the payload cache, if any
+ * @pages: pages backing a payload too large for the payload
+ * cache, NULL otherwise
+ * @nr_pages: number of @pages
  * @list: field required to include messages into lists
+ * @header: metadata for files reading headers, stamped when
+ * the message is written and when it is published
+ * @inline_data: storage for small messages
  * 
  * This struct represents messages exchanged among processes
- * and threads.
+ * and threads. Messages must be obtained by means of
+ * message_alloc() and given back by means of message_free().
+ * Since payloads may be page backed, they are accessed by
+ * means of the helpers of message_cache.h.
  */
 struct message
 {
     size_t data_size;
+    unsigned long deadline;
+    unsigned long ttl;
+    unsigned long expires;
+    unsigned char priority;
+    unsigned char tag;
+    u64 seq;
+    atomic_t refs;
+    unsigned int pending;
     char *data;
+    char *buffer;
+    struct page **pages;
+    unsigned int nr_pages;
     struct list_head list;
+    struct group_header header;
+    char inline_data[MESSAGE_INLINE_SIZE];
 };
 
+/**
+ * message_expired() - checks whether a message expired.
+ * 
+ * @msg: a published message
+ * 
+ * Returns:
+ * 1 - @msg outlived its time to live
+ * 0 - otherwise
+ */
+static inline int message_expired(struct message *msg)
+{
+    return msg->ttl && time_after_eq(jiffies, msg->expires);
+}
+
 /**
  * struct group_dev - struct for each group device.
  * 
- * @cdev: kernel struct that represents a char device
- * @minor: the minor number associated to the device
- * @flags: variable containing flags
+ * @cdev: kernel struct that represents a char device,
+ * dynamically allocated such that it can outlive the group
+ * device while some inode still refers to it
+ * @desc: the descriptor the group device was installed for
+ * @minor: the minor number dynamically assigned to the device
+ * @mode: storage mode chosen at installation (GROUP_MODE_*)
  * 
  * @messages_number: the number of messages currently stored
  * into the group device
  * @message_sem: semaphore protecting the list of messages
- * @message_list: list containing all publishedmessages of 
- * the group device
+ * @message_list: lists containing all published messages of
+ * the group device, one per priority level and tag
+ * @priorities: bitmap of the priority levels having some
+ * non-empty list
+ * @tags: for each priority level, bitmap of the tags whose
+ * list is non-empty
+ * @next_seq: sequence number of the next message linked into
+ * @message_list or spilled
+ * @published: number of messages published so far, numbering
+ * the headers of messages regardless of @mode
+ * @filtered: number of open files subscribed to a subset of
+ * tags
+ * @ring: lock-free ring replacing @message_list and
+ * @message_sem when @mode is GROUP_MODE_RING
+ * @shared: region shared with userspace replacing
+ * @message_list and @message_sem when @mode is
+ * GROUP_MODE_SHARED
+ * @shards: per-CPU sub-queues replacing @message_list and
+ * @message_sem when @mode is GROUP_MODE_SHARDED
+ * @broadcast: log shared by all readers replacing
+ * @message_list and @message_sem when @mode is
+ * GROUP_MODE_BROADCAST
+ * @log: retained log replacing @message_list and
+ * @message_sem when @mode is GROUP_MODE_LOG
+ * @spill: file the newest messages of priority level 0 and
+ * tag 0 are moved to once the storage is exhausted, protected
+ * by @message_sem. Only when @mode is GROUP_MODE_LIST and
+ * spill_dir is set
  * 
  * @delay: jiffies of delay for the publication of messages
- * @wq_sem: semaphore protecting the workqueue
- * @delay_wq: the workqueue of delayed works
- * @delay_list: the list of delayed works
+ * @publish_work: the work publishing delayed messages, armed
+ * for the earliest deadline
+ * 
+ * @ttl: jiffies messages live for once published, unless
+ * the writer chose otherwise, 0 for no limit
+ * @expiring: set once a message with a time to live has been
+ * stored
+ * @expired: number of messages dropped since they expired
+ * @expire_work: the work sweeping expired messages, armed
+ * every ttl_sweep_interval msecs while messages are stored
+ * @shrinker: drops messages under memory pressure, according
+ * to shrink_policy
  * 
  * @pending_sem: semaphore protecting the pending list
- * @pending_list: list of delayed messages
+ * @pending_list: list of delayed messages, ordered by
+ * deadline with the earliest one last
+ * 
+ * @stored_bytes: bytes of messages stored into the group
+ * device, either published or delayed, bounded by
+ * max_storage_size. When @mode is GROUP_MODE_SHARED, bytes of
+ * the preallocated region instead
+ * 
+ * @users: number of open files, -1 once the group device is
+ * being reclaimed and cannot be opened anymore
+ * @last_used: jiffies of the last install or release, used
+ * to detect idle group devices
+ * @list: field required to collect group devices being
+ * reclaimed
  * 
  * @wait_queue: list containing all threads put into wait
- * after sleeping on the barrier of this group device
+ * after sleeping on the barrier of this group device. Simple
+ * wait queue, such that waking thousands of threads never
+ * holds its lock for long
+ * @barrier_generation: incremented whenever the barrier is
+ * awakened, releasing the threads which slept before
+ * @barrier_sleepers: number of threads sleeping on the
+ * barrier
+ * @read_queue: list containing all readers waiting for a
+ * message to be published, either blocked in read() or
+ * polling the group device
+ * @write_queue: list containing all writers waiting for
+ * storage to be freed, either blocked in write() or polling
+ * the group device
  * 
- * @list: field required to include group devices into lists
+ * @count_lock: spinlock protecting the counting barrier
+ * @count_parties: threads the counting barrier waits for, 0
+ * if not set
+ * @count_arrived: threads waiting on the counting barrier
+ * @count_generation: incremented whenever the counting barrier
+ * releases its waiting threads
+ * @count_queue: list containing all threads waiting on the
+ * counting barrier
  * 
  * This struct represents the group device.
  */
 struct group_dev
 {
-    struct cdev cdev;
-    unsigned char minor;
-    char flags;
+    struct cdev *cdev;
+    unsigned int desc;
+    unsigned int minor;
+    unsigned char mode;
 
     unsigned int messages_number;
     struct semaphore *message_sem;
     struct list_head *message_list;
+    unsigned long priorities;
+    unsigned long tags[GROUP_PRIORITY_LEVELS];
+    u64 next_seq;
+    atomic64_t published;
+    atomic_t filtered;
+    struct message_ring *ring;
+    struct shared_ring *shared;
+    struct message_shards *shards;
+    struct message_broadcast *broadcast;
+    struct message_log *log;
+    struct message_spill *spill;
 
     unsigned long delay;
-    struct semaphore *wq_sem;
-    struct workqueue_struct *delay_wq;
-    struct list_head *delay_list;
+    struct delayed_work publish_work;
+
+    unsigned long ttl;
+    int expiring;
+    atomic_long_t expired;
+    struct delayed_work expire_work;
+    struct shrinker shrinker;
 
     struct semaphore *pending_sem;
     struct list_head *pending_list;
 
-    wait_queue_head_t wait_queue;
+    atomic_long_t stored_bytes;
 
+    atomic_t users;
+    unsigned long last_used;
     struct list_head list;
+
+    struct swait_queue_head wait_queue;
+    atomic_long_t barrier_generation;
+    atomic_t barrier_sleepers;
+    wait_queue_head_t read_queue;
+    wait_queue_head_t write_queue;
+
+    spinlock_t count_lock;
+    unsigned int count_parties;
+    unsigned int count_arrived;
+    u64 count_generation;
+    wait_queue_head_t count_queue;
 };
 
+/**
+ * struct group_file - struct for each open file.
+ * 
+ * @dev: the group device the file refers to
+ * @priority: priority level of messages sent through the
+ * file
+ * @tag: tag of messages sent through the file
+ * @tags: bitmask of the tags of messages retrieved through
+ * the file
+ * @ttl: jiffies messages sent through the file live for, 0 to
+ * use the time to live of the group device
+ * @cursor: sequence number of the next message retrieved
+ * through the file, when the group device is in
+ * GROUP_MODE_BROADCAST or GROUP_MODE_LOG
+ * @subscribed: whether @cursor is registered on the broadcast
+ * log. Files subscribe on their first read, poll or
+ * IOCTL_SUBSCRIBE, so that writers never hold messages back
+ * @header: whether a struct group_header precedes each
+ * message retrieved through the file
+ * @splice_mutex: mutex serializing splices out of the file
+ * @remainder: message partially spliced out of the file,
+ * whose data from @remainder_offset on is spliced before any
+ * other message. Reads do not retrieve it.
+ * @remainder_offset: bytes of @remainder already spliced
+ * 
+ * This struct is the private data of a file opened on a
+ * group device, holding per-file settings.
+ */
+struct group_file
+{
+    struct group_dev *dev;
+    unsigned char priority;
+    unsigned char tag;
+    u32 tags;
+    unsigned long ttl;
+    u64 cursor;
+    int subscribed;
+    int header;
+    struct mutex splice_mutex;
+    struct message *remainder;
+    size_t remainder_offset;
+};
+
+/**
+ * file_group() - retrieves the group device of a file.
+ * 
+ * @filp: a file opened on a group device
+ * 
+ * Returns:
+ * struct group_dev* - the group device
+ */
+static inline struct group_dev *file_group(struct file *filp)
+{
+    return ((struct group_file *)filp->private_data)->dev;
+}
+
+/**
+ * file_settings() - retrieves the per-file settings.
+ * 
+ * @filp: a file opened on a group device
+ * 
+ * Returns:
+ * struct group_file* - the settings of @filp
+ */
+static inline struct group_file *file_settings(struct file *filp)
+{
+    return filp->private_data;
+}
+
+struct group_batch;
+
 extern struct file_operations group_dev_fops;
 
 int group_open(struct inode *inode, struct file *filp);
 int group_release(struct inode *inode, struct file *filp);
 ssize_t group_read(struct file *filp, char *buff, size_t length, loff_t *offset);
 ssize_t group_write(struct file *filp, const char *buff, size_t length, loff_t *offset);
+ssize_t group_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t group_write_iter(struct kiocb *iocb, struct iov_iter *from);
+ssize_t group_splice_write(struct pipe_inode_info *pipe, struct file *out, loff_t *ppos, size_t length, unsigned int flags);
+ssize_t group_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe, size_t length, unsigned int flags);
+loff_t group_llseek(struct file *filp, loff_t offset, int whence);
 long group_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 int group_flush(struct file *filp, fl_owner_t id);
+__poll_t group_poll(struct file *filp, struct poll_table_struct *wait);
+int group_mmap(struct file *filp, struct vm_area_struct *vma);
+
+/**
+ * group_has_messages() - checks for published messages.
+ * 
+ * @dev: the group device
+ * @file: the file of the reader, NULL for any reader
+ * 
+ * Lockless check, suitable as a wait condition. Delayed
+ * messages are not considered until they are published. Tags
+ * are only meaningful in GROUP_MODE_LIST, cursors in
+ * GROUP_MODE_BROADCAST and GROUP_MODE_LOG.
+ * 
+ * Returns:
+ * 1 - at least one message can be retrieved
+ * 0 - no message can be retrieved
+ */
+int group_has_messages(struct group_dev *dev, struct group_file *file);
+
+/**
+ * group_is_idle() - checks whether a group device holds any
+ * state worth keeping.
+ * 
+ * @dev: the group device
+ * 
+ * A group device is idle when it stores neither published
+ * nor delayed messages and its barrier is down. Meaningful
+ * only while no file is open on @dev.
+ * 
+ * Returns:
+ * 1 - the group device may be reclaimed
+ * 0 - the group device has to be kept
+ */
+int group_is_idle(struct group_dev *dev);
+
+/**
+ * group_wait_messages() - waits for a message.
+ * 
+ * @dev: the group device
+ * @file: the file of the reader
+ * 
+ * Puts the calling thread into an interruptible sleep on
+ * @dev's read queue until a message @file may retrieve is
+ * published. Readers wait exclusively, so that publishing a
+ * message wakes up a single reader, see group_wake_readers().
+ * 
+ * Returns:
+ * 0 - a message has been published
+ * -ERESTARTSYS - interrupted by a signal
+ */
+int group_wait_messages(struct group_dev *dev, struct group_file *file);
+
+/**
+ * group_wake_readers() - wakes up readers after publishing.
+ * 
+ * @dev: the group device
+ * @nr: the number of published messages
+ * 
+ * Wakes up @nr readers. While some file is subscribed to a
+ * subset of tags, the woken readers might not be interested
+ * in the published messages, hence all of them are woken up.
+ * The same holds in GROUP_MODE_BROADCAST and GROUP_MODE_LOG,
+ * where every reader retrieves every message.
+ * 
+ * Returns:
+ * void
+ */
+void group_wake_readers(struct group_dev *dev, unsigned int nr);
+
+/**
+ * global_storage_charge() - accounts bytes against the global
+ * storage budget.
+ * 
+ * @size: bytes to be accounted
+ * 
+ * Returns:
+ * 1 - bytes accounted
+ * 0 - max_global_storage_size would be exceeded
+ */
+int global_storage_charge(size_t size);
+
+/**
+ * global_storage_uncharge() - gives bytes back to the global
+ * storage budget.
+ * 
+ * @size: bytes previously accounted
+ * 
+ * Wakes up writers waiting for the global budget, if any.
+ * 
+ * Returns:
+ * void
+ */
+void global_storage_uncharge(size_t size);
+
+/**
+ * storage_charge() - accounts bytes of a message.
+ * 
+ * @dev: the group device
+ * @size: bytes of the message
+ * 
+ * Accounts @size bytes against both max_storage_size for @dev
+ * and the global budget, or none of them.
+ * 
+ * Returns:
+ * 1 - bytes accounted
+ * 0 - not enough space
+ */
+int storage_charge(struct group_dev *dev, size_t size);
+
+/**
+ * storage_uncharge() - gives bytes of a message back.
+ * 
+ * @dev: the group device
+ * @size: bytes previously accounted by storage_charge()
+ * 
+ * Wakes up writers waiting for space, if any.
+ * 
+ * Returns:
+ * void
+ */
+void storage_uncharge(struct group_dev *dev, size_t size);
+
+/**
+ * group_wake_writers() - wakes up writers waiting for space.
+ * 
+ * @dev: the group device
+ * 
+ * Cheap when nobody is waiting. Writers wait for different
+ * amounts of bytes, hence all of them are woken up.
+ * 
+ * Returns:
+ * void
+ */
+void group_wake_writers(struct group_dev *dev);
+
+/**
+ * group_has_space() - checks for room for a message.
+ * 
+ * @dev: the group device
+ * @size: bytes of the message
+ * @spill: whether the message may be spilled
+ * 
+ * Lockless check against the storage of @dev only, suitable
+ * as a wait condition. Ring modes also need a free slot.
+ * 
+ * Returns:
+ * 1 - the message may be stored
+ * 0 - the message does not fit
+ */
+int group_has_space(struct group_dev *dev, size_t size, int spill);
+
+/**
+ * group_wait_space() - waits for room for a message.
+ * 
+ * @dev: the group device
+ * @size: bytes of the message
+ * @spill: whether the message may be spilled
+ * 
+ * Puts the calling thread into an interruptible sleep until
+ * @size bytes may fit, either on @dev's write queue or, if the
+ * global budget is exhausted, on the global one. Space may be
+ * taken by someone else meanwhile, hence callers retry.
+ * 
+ * Returns:
+ * 0 - space has been freed
+ * -ERESTARTSYS - interrupted by a signal
+ */
+int group_wait_space(struct group_dev *dev, size_t size, int spill);
 
 /**
  * message_print() - prints a message.
@@ -193,162 +598,312 @@ long get_delay_msecs(struct group_dev *dev);
 long get_delay_jiffies(struct group_dev *dev);
 
 /**
- * is_flushing() - checks whether the flushing bit is set.
+ * is_barrier_up() - checks if barriers was raised for a 
+ * specific group device.
  * 
  * @dev: the specific group device
  *  
- * Retrieves information on whether @dev's flushing bit is 
- * set or not.
+ * Retrieves information on whether some thread is sleeping
+ * on @dev's barrier.
  * 
  * Returns:
- * 1 - flushing is set for @dev
- * 0 - flushing is not set for @dev
+ * 1 - barrier is raised for @dev
+ * 0 - barrier is not raised for @dev
  */
-int is_flushing(struct group_dev *dev);
+int is_barrier_up(struct group_dev *dev);
 
 /**
- * set_flushing() - sets the flushing bit.
+ * barrier_sleep() - sleeps on the barrier of a specific group
+ * device.
  * 
  * @dev: the specific group device
  * 
- * The flushing bit of @dev's flags variable is set. This
- * helps managing delayed works flushing.
+ * The calling thread joins the current generation of @dev's
+ * barrier and sleeps until the generation is over, i.e. until
+ * the next barrier_awake(). Threads sleeping after that wait
+ * for the following one, hence a thread is never sent back
+ * to sleep nor released twice by the same awake.
  * 
  * Returns:
  * void
  */
-void set_flushing(struct group_dev *dev);
+void barrier_sleep(struct group_dev *dev);
 
 /**
- * clear_flushing() - clears the flushing bit.
+ * barrier_awake() - awakes threads sleeping on the barrier of
+ * a specific group device.
  * 
  * @dev: the specific group device
  * 
- * The flushing bit of @dev's flags variable is reset.
+ * Ends the current generation of @dev's barrier, releasing
+ * exactly the threads which slept on it before. Threads are
+ * woken one at a time without holding the wait queue lock
+ * throughout, so that the time spent with interrupts disabled
+ * stays bounded regardless of their number.
  * 
  * Returns:
  * void
  */
-void clear_flushing(struct group_dev *dev);
+void barrier_awake(struct group_dev *dev);
 
 /**
- * is_barrier_up() - checks if barriers was raised for a 
- * specific group device.
+ * count_barrier_set_parties() - sets the party count of the
+ * counting barrier of a group device.
  * 
- * @dev: the specific group device
- *  
- * Retrieves information on whether @dev's barrier 
- * is raised up or not.
+ * @dev: the group device
+ * @parties: number of threads the barrier waits for, 0 to
+ * unset it
+ * 
+ * Threads already waiting are released if at least @parties
+ * of them arrived, or if the barrier is unset.
  * 
  * Returns:
- * 1 - barrier is raised for @dev
- * 0 - barrier is not raised for @dev
+ * void
  */
-int is_barrier_up(struct group_dev *dev);
+void count_barrier_set_parties(struct group_dev *dev, unsigned int parties);
 
 /**
- * set_barrier() - raises barrier for specifc group device.
+ * count_barrier_wait() - waits on the counting barrier of a
+ * group device.
  * 
- * @dev: the specific group device
+ * @dev: the group device
  * 
- * Raises @dev's barrier. It means that some thread is sleeping
- * on dev. As long as the barrier is up, sleeping threads
- * cannot be awakened.
+ * The calling thread sleeps until as many threads as the
+ * party count arrived, counting itself. The last one to
+ * arrive releases all of them at once, without sleeping, and
+ * the barrier is ready for the next round. Threads are
+ * counted regardless of the process and the file they come
+ * from.
+ * 
+ * Returns:
+ * 1 - the calling thread arrived last
+ * 0 - the calling thread has been released
+ * -EINVAL - no party count is set
+ * -ERESTARTSYS - interrupted while waiting, the thread is no
+ * longer counted
+ */
+long count_barrier_wait(struct group_dev *dev);
+
+/**
+ * _fflush_workqueue() - flushes a workqueue.
+ * 
+ * @dev: the group device whose delayed messages are flushed
+ * 
+ * Flushes @dev pending messages. The pending list is joined
+ * (becoming the new head) to the message list. In other 
+ * terms, all messages whose publication was delayed are 
+ * made available.
+ * Sempahore protected.
  * 
  * Returns:
  * void
  */
-void set_barrier(struct group_dev *dev);
+void _fflush_workqueue(struct group_dev *dev);
 
 /**
- * clear_barrier() - destroys barrier for specifc group device.
+ * fflush_workqueue() - flushes a workqueue.
  * 
- * @dev: the specific group device
+ * @dev: the group device whose delayed messages are flushed
  * 
- * Destroys @dev's barrier. It means that some thread is willing
- * to awake threads sleeping on dev. In order for threads to be
- * awakened, the barried MUST be destroyed.
+ * Wrapper for _fflush_workqueue(). The publishing work is left
+ * armed: it will find no expired message and stop by itself.
  * 
  * Returns:
  * void
  */
-void clear_barrier(struct group_dev *dev);
+void fflush_workqueue(struct group_dev *dev);
 
 /**
- * init_workqueue() - inits a delayed workqueue.
+ * publish_work_fun() - publishing work function.
  * 
- * @dev: the group device whose workqueue must be initialized
+ * @work: struct required to run delayed work
  * 
- * Initializes @dev's workqueue. This structure is managing the
- * publication of messages when a delay is set for @dev. Indeed,
- * if a delay is set, messages are unavailable from the time
- * they are written into the group device until the delay 
- * expires. 
+ * This is the function that will take care of the publication
+ * itself of delayed messages. When the earliest deadline
+ * expires, all expired messages are moved from the pending
+ * list to the storage of the group device in one go and as
+ * many readers are woken up. The work is then armed again for
+ * the next deadline, if any.
  * 
  * Returns:
- * 0 - ok
- * -1 - ko
+ * void
  */
-int init_workqueue(struct group_dev *dev);
+void publish_work_fun(struct work_struct *work);
 
 /**
- * _fflush_workqueue() - flushes a workqueue.
+ * expire_work_fun() - sweeping work function.
  * 
- * @delay_wq: the workqueue to be flushed
+ * @work: struct required to run delayed work
  * 
- * Flushes @dev pending messages. The pending list is joined
- * (becoming the new head) to the message list. In other 
- * terms, all messages whose publication was delayed are 
- * made available.
- * Sempahore protected.
+ * Drops expired messages of a group device, even if no reader
+ * comes to find them. Messages are checked from the oldest
+ * one of each queue, stopping at the first one still alive,
+ * hence a sweep is cheap. Rings can only be inspected by
+ * removing messages, their messages expire when read. The
+ * work is armed again while messages are stored
+ * and ttl_sweep_interval is not 0: otherwise, expired
+ * messages are only dropped when readers come across them.
  * 
  * Returns:
  * void
  */
-void _fflush_workqueue(struct group_dev *dev);
+void expire_work_fun(struct work_struct *work);
 
 /**
- * fflush_workqueue() - flushes a workqueue.
+ * group_shrink_count() - counts the messages a shrinker may
+ * drop.
+ * 
+ * @shrinker: the shrinker of a group device
+ * @sc: the reclaim request
+ * 
+ * Only messages of lists and shards are ever dropped. The
+ * count is an estimate: messages are only known to be expired
+ * once they are inspected.
+ * 
+ * Returns:
+ * unsigned long - the number of stored messages
+ * 0 - nothing can be dropped
+ */
+unsigned long group_shrink_count(struct shrinker *shrinker, struct shrink_control *sc);
+
+/**
+ * group_shrink_scan() - drops messages under memory pressure.
  * 
- * @delay_wq: the workqueue to be flushed
+ * @shrinker: the shrinker of a group device
+ * @sc: the reclaim request
  * 
- * Wrapper for _fflush_workqueue(). In addition, all pending 
- * work in @dev's @delay_wq is executed thanks to @delay_list.
+ * Drops expired messages first then, if shrink_policy is
+ * SHRINK_POLICY_PRIORITY and not enough were freed, the
+ * oldest messages of the lowest priority level of a list
+ * group device. Readers busy with the list are never waited
+ * for.
+ * 
+ * Returns:
+ * unsigned long - the number of dropped messages
+ * SHRINK_STOP - the messages could not be inspected
+ */
+unsigned long group_shrink_scan(struct shrinker *shrinker, struct shrink_control *sc);
+
+/**
+ * _store_message() - stores a message.
+ * 
+ * @dev: the group device
+ * @msg: the message to be stored
+ * 
+ * Adds @msg as the newest message of @dev, without waking up
+ * readers. Room for @msg must have been already accounted
+ * when it was written.
+ * Depending on @dev's mode, either the message list is
+ * semaphore protected, the message ring is used or a copy of
+ * @msg is stored into the shared region and @msg is freed.
  * 
  * Returns:
  * void
  */
-void fflush_workqueue(struct group_dev *dev);
+void _store_message(struct group_dev *dev, struct message *msg);
 
 /**
- * delayed_work_fun() - delayed works function.
+ * publish_message() - makes a message available to readers.
  * 
- * @work: struct required to run delayed work
+ * @dev: the group device
+ * @msg: the message to be published
  * 
- * This is the function that will take care of the publication
- * itself of delayed messages. It boils down to move  messages 
- * from a list to another. When a work in the workqueue is 
- * executed, this function is invoked. The message is moved 
- * from the pending list to the message list.
+ * Stores @msg by means of _store_message() and wakes up one
+ * reader.
  * 
  * Returns:
  * void
  */
-void delayed_work_fun(struct work_struct *work);
+void publish_message(struct group_dev *dev, struct message *msg);
 
 /**
- * add_delayed_work() - adds delayed works.
+ * delay_message() - postpones the publication of a message.
  * 
- * @work: struct required to run delayed work
+ * @dev: the group device
+ * @msg: the message to be delayed
  * 
- * Tries to add a work in @dev's workqueue. This function is
- * invoked when a thread is writing a message on a group
- * device whose delay is set (to something different from 0).
- * The work is queued in the workqueue and will be executed
- * as its specific delay expires. Moreover, the work is added
- * to @dev's delayed works list for flushing purposes.
+ * Sets @msg's deadline according to @dev's delay and adds @msg
+ * to @dev's pending list. The publishing work is moved only if
+ * @msg has the earliest deadline, which with a constant delay
+ * only happens when the pending list was empty.
  * 
  * Returns:
  * void
  */
-void add_delayed_work(struct group_dev *dev);
\ No newline at end of file
+void delay_message(struct group_dev *dev, struct message *msg);
+
+/**
+ * restore_message() - stores a message from a checkpoint.
+ * 
+ * @dev: the group device
+ * @msg: the message, carrying its class and time to live
+ * @delayed: whether @msg is pending, @msg's deadline being
+ * set already
+ * 
+ * Accounts for @msg as a write would, without waiting, then
+ * either publishes @msg or adds it to the pending list.
+ * 
+ * Returns:
+ * 0 - ok
+ * -1 - no storage for @msg, which is left to the caller
+ */
+int restore_message(struct group_dev *dev, struct message *msg, int delayed);
+
+/**
+ * _get_batch_iov() - retrieves a batch from userspace.
+ * 
+ * @ubatch: userspace batch
+ * @batch: where to store the batch
+ * 
+ * Copies @ubatch into @batch, checks the number of iovecs and
+ * copies the iovecs themselves into a newly allocated array,
+ * which must be freed by the caller.
+ * 
+ * Returns:
+ * NULL - error
+ * struct iovec* - the array of iovecs
+ */
+struct iovec *_get_batch_iov(struct group_batch __user *ubatch, struct group_batch *batch);
+
+/**
+ * group_send_batch() - writes several messages at once.
+ * 
+ * @filp: the file of the group device
+ * @ubatch: userspace batch, one iovec per message
+ * 
+ * All messages are copied from userspace before entering the
+ * critical section, which is then entered once for the whole
+ * batch. Messages are stored in iovec order. If the group
+ * device cannot host all of them, only the first ones are
+ * stored and the remaining are discarded.
+ * 
+ * Returns:
+ * -1 - error
+ * >= 0 - number of stored messages
+ */
+long group_send_batch(struct file *filp, struct group_batch __user *ubatch);
+
+/**
+ * group_recv_batch() - reads several messages at once.
+ * 
+ * @filp: the file of the group device
+ * @ubatch: userspace batch, one iovec per buffer
+ * 
+ * Up to vlen messages are removed from the group device, in
+ * FIFO order, within a single critical section. If there is
+ * none, the call blocks as read() does. They are then
+ * copied into the userspace buffers and each iovec length is
+ * updated to the number of bytes retrieved. As for read(),
+ * a message is consumed even if its buffer is too short or
+ * cannot be written. Files reading headers get a struct
+ * group_header at the beginning of each buffer.
+ * 
+ * Returns:
+ * -1 - error
+ * -EINVAL - a buffer is shorter than the header
+ * -EAGAIN - no message and @filp is non-blocking
+ * -ERESTARTSYS - interrupted while waiting
+ * > 0 - number of retrieved messages
+ */
+long group_recv_batch(struct file *filp, struct group_batch __user *ubatch);
+
@@ -1,34 +1,31 @@
 #include <linux/slab.h>
+#include <linux/xarray.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/jiffies.h>
 
 #include "../common.h"
 #include "kern.h"
+#include "ioctl.h"
 #include "group_dev_manager.h"
 #include "group_dev.h"
+#include "message_cache.h"
 
 struct group_devices *group_devs;
 struct class *group_dev_class;
 
-void group_devs_list_print(struct list_head *list)
+void group_devs_print(void)
 {
-    int i = 0;
+    unsigned long desc;
     struct group_dev *tmp;
-    struct list_head *pos;
 
     dbg_start();
 
-    if (!list)
+    xa_for_each(&group_devs->groups, desc, tmp)
     {
-        ref_err("list");
-        goto exit;
-    }
-
-    list_for_each(pos, list)
-    {
-        tmp = list_entry(pos, struct group_dev, list);
-        dbg("%d, group_dev%d - messages_number : %d\n", i++, tmp->minor, tmp->messages_number);
+        dbg("group_dev%lu, minor %u - messages_number : %d\n", desc, tmp->minor, tmp->messages_number);
     }
 
-exit:
     dbg_end();
     return;
 }
@@ -36,6 +33,7 @@ exit:
 int init_group_devs(void)
 {
     int ret;
+    dev_t dev;
 
     dbg_start();
     ret = -1;
@@ -49,58 +47,80 @@ int init_group_devs(void)
     }
     dbg("group_devs allocated\n");
 
-    /* Allocate and initialize group_devs_list. */
-    group_devs->group_devs_list = kmalloc(sizeof(struct list_head), GFP_KERNEL);
-    if (!group_devs->group_devs_list)
+    /* Dynamically allocate region for character devices, once
+       for all the minors group devices may be given. System
+       will provide major. */
+    if (alloc_chrdev_region(&dev, 0, GROUP_DEV_COUNT, GROUP_DEVICE_NAME) < 0)
+    {
+        err("group devices region registration failed\n");
+        goto region_fail;
+    }
+    group_devs->major = MAJOR(dev);
+    dbg("alloc_chrdev_region for major %d\n", group_devs->major);
+
+    /* Create the class group devices belong to. */
+    group_dev_class = class_create(THIS_MODULE, GROUP_CLASS_NAME);
+    if (IS_ERR(group_dev_class))
+    {
+        err("class_create\n");
+        group_dev_class = NULL;
+        goto class_fail;
+    }
+    dbg("group_dev_class initialized\n");
+
+    /* Initialize the tables of group devices and the mutex
+       serializing installers. */
+    xa_init(&group_devs->groups);
+    xa_init_flags(&group_devs->minors, XA_FLAGS_ALLOC);
+    mutex_init(&group_devs->install_mutex);
+    dbg("group_devs->groups initialized\n");
+
+    /* Start reclaiming idle group devices, if enabled. */
+    INIT_DELAYED_WORK(&group_devs->reclaim_work, reclaim_idle_groups);
+    if (group_idle_timeout)
     {
-        kmalloc_err("group_devs->group_devs_list");
-        goto list_fail;
+        schedule_delayed_work(&group_devs->reclaim_work, msecs_to_jiffies(group_idle_timeout));
+        dbg("reclaim_work armed\n");
     }
-    INIT_LIST_HEAD(group_devs->group_devs_list);
-    dbg("group_devs_list allocated\n");
 
     ret = 0;
     goto exit;
 
-list_fail:
+class_fail:
+    unregister_chrdev_region(dev, GROUP_DEV_COUNT);
+    dbg("class_fail\n");
+region_fail:
     kfree(group_devs);
+    group_devs = NULL;
+    dbg("region_fail\n");
+
 exit:
     dbg_end();
     return ret;
 }
 
-struct group_dev *_get_group(int desc)
+struct group_dev *_get_group(unsigned int desc)
 {
     struct group_dev *gd;
 
     dbg_start();
 
-    /* Scan the list searching for a match of desc. */
-    list_for_each_entry(gd, group_devs->group_devs_list, list)
-    {
-        if (gd->minor == desc)
-        {
-            dbg("group_dev found for desc %d\n", desc);
-            goto exit;
-        }
-    }
-
-    dbg("no group_dev found for desc %d\n", desc);
-    gd = NULL;
+    /* Direct lookup, safe under RCU without any lock. */
+    gd = xa_load(&group_devs->groups, desc);
+    dbg("%s group_dev for desc %u\n", gd ? "found" : "no", desc);
 
-exit:
     dbg_end();
     return gd;
 }
 
-struct group_dev *get_group(int desc)
+struct group_dev *get_group(unsigned int desc)
 {
     dbg_start();
 
-    /* Check group_devs_list. */
-    if (!group_devs->group_devs_list || list_empty(group_devs->group_devs_list))
+    /* Check group_devs. */
+    if (!group_devs)
     {
-        warn("cannot reference or empty group_devs_list\n");
+        ref_err("group_devs");
         return NULL;
     }
 
@@ -110,16 +130,57 @@ struct group_dev *get_group(int desc)
     return _get_group(desc);
 }
 
-struct group_dev *_install_group(int desc)
+struct group_dev *get_group_ref(unsigned int desc)
 {
-    int err, minor, major;
+    struct group_dev *gd;
+
+    dbg_start();
+
+    /* As for get_group_by_minor(), the lookup and the reference
+       are taken within the same read-side critical section. */
+    rcu_read_lock();
+    gd = xa_load(&group_devs->groups, desc);
+    if (gd && !atomic_inc_unless_negative(&gd->users))
+    {
+        dbg("group_dev%u is being reclaimed\n", gd->desc);
+        gd = NULL;
+    }
+    rcu_read_unlock();
+
+    dbg_end();
+    return gd;
+}
+
+struct group_dev *get_group_by_minor(unsigned int minor)
+{
+    struct group_dev *gd;
+
+    dbg_start();
+
+    /* The reclaimer waits for a grace period before freeing a
+       group device, hence it can be referenced under RCU. */
+    rcu_read_lock();
+    gd = xa_load(&group_devs->minors, minor);
+    if (gd && !atomic_inc_unless_negative(&gd->users))
+    {
+        dbg("group_dev%u is being reclaimed\n", gd->desc);
+        gd = NULL;
+    }
+    rcu_read_unlock();
+
+    dbg_end();
+    return gd;
+}
+
+struct group_dev *_install_group(unsigned int desc, unsigned char mode)
+{
+    unsigned int minor, major, i;
     char *device_name;
-    dev_t dev;
+    struct device *device;
     struct group_dev *new_group_dev;
 
     dbg_start();
 
-    minor = desc;
     major = group_devs->major;
 
     /* Allocate group device name. */
@@ -132,9 +193,8 @@ struct group_dev *_install_group(int desc)
     dbg("device_name allocated\n");
 
     /* Forge group device name. */
-    sprintf(device_name, GROUP_FORMAT, minor);
+    sprintf(device_name, GROUP_FORMAT, desc);
     dbg("device_name is %s\n", device_name);
-    dbg("initial major : %d minor : %d", major, minor);
 
     /* Allocate structure for group device to be installed. */
     new_group_dev = kzalloc(sizeof(struct group_dev), GFP_KERNEL);
@@ -145,14 +205,27 @@ struct group_dev *_install_group(int desc)
     }
     dbg("new_group_dev allocated\n");
 
-    /* Allocate and initialize messages list. */
-    new_group_dev->message_list = kmalloc(sizeof(struct list_head), GFP_KERNEL);
+    new_group_dev->desc = desc;
+    atomic_set(&new_group_dev->users, 0);
+    new_group_dev->last_used = jiffies;
+
+    /* Allocate and initialize messages lists, one per level and
+       tag. */
+    new_group_dev->message_list = kmalloc_array(GROUP_PRIORITY_LEVELS * GROUP_TAGS, sizeof(struct list_head), GFP_KERNEL);
     if (!new_group_dev->message_list)
     {
         kmalloc_err("group_dev->message_list");
         goto msg_list_fail;
     }
-    INIT_LIST_HEAD(new_group_dev->message_list);
+    for (i = 0; i < GROUP_PRIORITY_LEVELS * GROUP_TAGS; i++)
+    {
+        INIT_LIST_HEAD(&new_group_dev->message_list[i]);
+    }
+    new_group_dev->priorities = 0;
+    memset(new_group_dev->tags, 0, sizeof(new_group_dev->tags));
+    new_group_dev->next_seq = 0;
+    atomic64_set(&new_group_dev->published, 0);
+    atomic_set(&new_group_dev->filtered, 0);
     dbg("new_group_dev->message_list allocated\n");
 
     /* Allocate and initialize message semaphore. */
@@ -185,85 +258,203 @@ struct group_dev *_install_group(int desc)
     sema_init(new_group_dev->pending_sem, 1);
     dbg("new_group_dev->pending_sem allocated\n");
 
-    /* Allocate and initialize workqueue semaphore. */
-    new_group_dev->wq_sem = kmalloc(sizeof(struct semaphore), GFP_KERNEL);
-    if (!new_group_dev->wq_sem)
+    /* Allocate the message ring if required by the mode. Bytes
+       are the actual limit, hence a ring has a slot for each
+       byte, while a shared region hosts max_storage_size bytes
+       of messages of the maximum size. */
+    new_group_dev->mode = mode;
+    atomic_long_set(&new_group_dev->stored_bytes, 0);
+    if (mode == GROUP_MODE_RING)
     {
-        kmalloc_err("group_dev->wq_sem");
-        goto wq_sem_fail;
+        new_group_dev->ring = ring_alloc(max_storage_size);
+        if (!new_group_dev->ring)
+        {
+            kzalloc_err("group_dev->ring");
+            goto ring_fail;
+        }
+        dbg("new_group_dev->ring allocated\n");
     }
-    sema_init(new_group_dev->wq_sem, 1);
-    dbg("new_group_dev->wq_sem allocated\n");
+    else if (mode == GROUP_MODE_SHARED)
+    {
+        new_group_dev->shared = shared_ring_alloc(DIV_ROUND_UP(max_storage_size, max_t(unsigned int, max_message_size, 1)),
+                                                  max_message_size);
+        if (!new_group_dev->shared)
+        {
+            err("shared_ring_alloc\n");
+            goto ring_fail;
+        }
+        dbg("new_group_dev->shared allocated\n");
 
-    /* Allocate and initialize delayed work list. */
-    new_group_dev->delay_list = kmalloc(sizeof(struct list_head), GFP_KERNEL);
-    if (!new_group_dev->delay_list)
+        /* The region is preallocated, account for it at once. */
+        if (!global_storage_charge(new_group_dev->shared->size))
+        {
+            warn("global storage budget exhausted\n");
+            shared_ring_free(new_group_dev->shared);
+            goto ring_fail;
+        }
+        atomic_long_set(&new_group_dev->stored_bytes, new_group_dev->shared->size);
+    }
+    else if (mode == GROUP_MODE_SHARDED)
     {
-        kmalloc_err("group_dev->pending_list");
-        goto delayed_list_fail;
+        new_group_dev->shards = shards_alloc();
+        if (!new_group_dev->shards)
+        {
+            kzalloc_err("group_dev->shards");
+            goto ring_fail;
+        }
+        dbg("new_group_dev->shards allocated\n");
+    }
+    else if (mode == GROUP_MODE_BROADCAST)
+    {
+        new_group_dev->broadcast = broadcast_alloc(max_broadcast_lag);
+        if (!new_group_dev->broadcast)
+        {
+            kzalloc_err("group_dev->broadcast");
+            goto ring_fail;
+        }
+        dbg("new_group_dev->broadcast allocated\n");
+    }
+    else if (mode == GROUP_MODE_LOG)
+    {
+        new_group_dev->log = log_alloc();
+        if (!new_group_dev->log)
+        {
+            kzalloc_err("group_dev->log");
+            goto ring_fail;
+        }
+        dbg("new_group_dev->log allocated\n");
+    }
+    else if (mode == GROUP_MODE_LIST && spill_dir && *spill_dir)
+    {
+        /* The backing file is created at the first spill. */
+        new_group_dev->spill = spill_alloc();
+        if (!new_group_dev->spill)
+        {
+            kzalloc_err("group_dev->spill");
+            goto ring_fail;
+        }
+        dbg("new_group_dev->spill allocated\n");
     }
-    INIT_LIST_HEAD(new_group_dev->delay_list);
-    dbg("new_group_dev->delay_list allocated\n");
-
-    /* Initialize list member. */
-    INIT_LIST_HEAD(&new_group_dev->list);
-    dbg("new_group_dev->list initialized\n");
 
-    /* Initialize wait queue. */
-    init_waitqueue_head(&new_group_dev->wait_queue);
+    /* Initialize the barrier and its wait queue. */
+    init_swait_queue_head(&new_group_dev->wait_queue);
+    atomic_long_set(&new_group_dev->barrier_generation, 0);
+    atomic_set(&new_group_dev->barrier_sleepers, 0);
     dbg("new_group_dev->wait_queue initialized\n");
 
-    /* Initialize workqueue. */
-    init_workqueue(new_group_dev);
-    dbg("new_group_dev->wait_queue initialized\n");
+    /* Initialize read wait queue. */
+    init_waitqueue_head(&new_group_dev->read_queue);
+    dbg("new_group_dev->read_queue initialized\n");
+
+    /* Initialize write wait queue. */
+    init_waitqueue_head(&new_group_dev->write_queue);
+    dbg("new_group_dev->write_queue initialized\n");
 
-    /* If no major has been already initialized, then this is the first time. Hence,
-       dynamically allocate region for character devices. System will provide 
-       major. */
-    if (!major)
+    /* Initialize the counting barrier, with no party count. */
+    spin_lock_init(&new_group_dev->count_lock);
+    init_waitqueue_head(&new_group_dev->count_queue);
+    dbg("new_group_dev->count_queue initialized\n");
+
+    /* Initialize the work publishing delayed messages. */
+    INIT_DELAYED_WORK(&new_group_dev->publish_work, publish_work_fun);
+    dbg("new_group_dev->publish_work initialized\n");
+
+    /* Initialize the work sweeping expired messages. */
+    new_group_dev->ttl = 0;
+    new_group_dev->expiring = 0;
+    atomic_long_set(&new_group_dev->expired, 0);
+    INIT_DELAYED_WORK(&new_group_dev->expire_work, expire_work_fun);
+    dbg("new_group_dev->expire_work initialized\n");
+
+    /* Let memory pressure drop messages. */
+    new_group_dev->shrinker.count_objects = group_shrink_count;
+    new_group_dev->shrinker.scan_objects = group_shrink_scan;
+    new_group_dev->shrinker.seeks = DEFAULT_SEEKS;
+    if (register_shrinker(&new_group_dev->shrinker))
     {
-        err = alloc_chrdev_region(&dev, 0, GROUP_DEV_COUNT, GROUP_DEVICE_NAME);
-        major = MAJOR(dev);
-        group_devs->major = major;
-        dbg("alloc_chrdev_region for major %d and minor %d\n", major, minor);
+        err("register_shrinker for desc %u\n", desc);
+        goto shrinker_fail;
     }
+    dbg("new_group_dev->shrinker registered\n");
 
-    /* Registration failed. */
-    if (err < 0)
+    /* Take the first free minor, mapping it to the group device.
+       No file can be opened before the char device is added. */
+    if (xa_alloc(&group_devs->minors, &minor, new_group_dev, XA_LIMIT(0, GROUP_DEV_COUNT - 1), GFP_KERNEL))
     {
-        err("registration failed for major %d\n", major);
-        goto dev_reg_fail;
+        err("no minor available for desc %u\n", desc);
+        goto minor_fail;
     }
+    new_group_dev->minor = minor;
 
-    /* Create the class group devices belong to. */
-    if (!group_dev_class)
+    /* Allocate char dev structure. Being refcounted, it is freed
+       once the last inode referring to it goes away. */
+    new_group_dev->cdev = cdev_alloc();
+    if (!new_group_dev->cdev)
     {
-        group_dev_class = class_create(THIS_MODULE, GROUP_CLASS_NAME);
-        dbg("group_dev_class initialized\n");
+        kzalloc_err("group_dev->cdev");
+        goto cdev_alloc_fail;
     }
 
-    /* Initialize char dev structure.
-       Associate specific file operations to the group device.
+    /* Associate specific file operations to the group device.
        Create the group device. */
-    cdev_init(&new_group_dev->cdev, &group_dev_fops);
-    cdev_add(&new_group_dev->cdev, MKDEV(major, minor), 1);
-    device_create(group_dev_class, NULL, MKDEV(major, minor), NULL, device_name);
-    new_group_dev->minor = minor;
+    new_group_dev->cdev->ops = &group_dev_fops;
+    new_group_dev->cdev->owner = THIS_MODULE;
+    if (cdev_add(new_group_dev->cdev, MKDEV(major, minor), 1) < 0)
+    {
+        err("cdev_add for minor %u\n", minor);
+        goto cdev_fail;
+    }
+    device = device_create(group_dev_class, NULL, MKDEV(major, minor), NULL, device_name);
+    if (IS_ERR(device))
+    {
+        err("device_create for %s\n", device_name);
+        goto cdev_fail;
+    }
 
-    info("%s with major %d and minor %d created\n", device_name, major, minor);
+    info("%s with major %u and minor %u created\n", device_name, major, minor);
     kfree(device_name); /* Name not needed anymore. */
     goto exit;
 
     /* Each fail should "abort" previous successful operations. */
-dev_reg_fail:
-    kfree(new_group_dev->delay_list);
-    dbg("dev_reg_fail\n");
-delayed_list_fail:
-    kfree(new_group_dev->wq_sem);
-    dbg("delayed_list_fail\n");
-wq_sem_fail:
+cdev_fail:
+    cdev_del(new_group_dev->cdev);
+    dbg("cdev_fail\n");
+cdev_alloc_fail:
+    xa_erase(&group_devs->minors, minor);
+    dbg("cdev_alloc_fail\n");
+minor_fail:
+    unregister_shrinker(&new_group_dev->shrinker);
+    dbg("minor_fail\n");
+shrinker_fail:
+    if (new_group_dev->ring)
+    {
+        ring_free(new_group_dev->ring);
+    }
+    if (new_group_dev->shared)
+    {
+        global_storage_uncharge(new_group_dev->shared->size);
+        shared_ring_free(new_group_dev->shared);
+    }
+    if (new_group_dev->shards)
+    {
+        shards_free(new_group_dev->shards);
+    }
+    if (new_group_dev->broadcast)
+    {
+        broadcast_free(new_group_dev->broadcast);
+    }
+    if (new_group_dev->log)
+    {
+        log_free(new_group_dev->log);
+    }
+    if (new_group_dev->spill)
+    {
+        spill_free(new_group_dev->spill);
+    }
+    dbg("shrinker_fail\n");
+ring_fail:
     kfree(new_group_dev->pending_sem);
-    dbg("wq_sem_fail\n");
+    dbg("ring_fail\n");
 pnd_sem_fail:
     kfree(new_group_dev->pending_list);
     dbg("pnd_sem_fail\n");
@@ -290,7 +481,7 @@ exit:
 int install_group(struct group_t *group_desc)
 {
     int ret;
-    unsigned char desc;
+    unsigned int desc;
     struct group_dev *gd;
 
     dbg_start();
@@ -305,54 +496,91 @@ int install_group(struct group_t *group_desc)
 
     desc = group_desc->desc;
 
-    /* Check number of installed group devices. */
-    if (desc >= GROUP_DEV_COUNT)
+    /* Check storage mode. */
+    if (group_desc->mode > GROUP_MODE_LOG)
     {
-        warn("desc %d > %d GROUP_DEV_COUNT\n", desc, GROUP_DEV_COUNT);
+        warn("unknown mode %d\n", group_desc->mode);
         goto exit;
     }
 
-    /* Initialize group_devs. */
     if (!group_devs)
     {
-        init_group_devs();
-        dbg("group_devs initialized\n");
+        ref_err("group_devs");
+        goto exit;
     }
 
-    /* Seek for a group device matching the descriptor. */
-    gd = get_group(desc);
-    if (gd) /* Seek was successful. */
+    /* Seek for a group device matching the descriptor, without
+       locking: installed group devices are the common case. The
+       reclaimer frees group devices after a grace period, and
+       group devices being reclaimed count as not installed. */
+    rcu_read_lock();
+    gd = _get_group(desc);
+    if (gd && atomic_read(&gd->users) >= 0) /* Seek was successful. */
     {
+        WRITE_ONCE(gd->last_used, jiffies);
         ret = 0;
+    }
+    rcu_read_unlock();
+    if (!ret)
+    {
         goto exit;
     }
 
+    mutex_lock(&group_devs->install_mutex); /* Acquire resource. */
+
+    /* Another installer may have been faster. Group devices
+       are erased from the table under install_mutex, hence one
+       being reclaimed cannot be found here. */
+    gd = _get_group(desc);
+    if (gd && atomic_read(&gd->users) < 0)
+    {
+        err("group_dev%u is being reclaimed\n", desc);
+        goto mutex_exit;
+    }
+    if (gd)
+    {
+        WRITE_ONCE(gd->last_used, jiffies);
+        ret = 0;
+        goto mutex_exit;
+    }
+
     /* Check if there is space for another group device. */
     if (GROUP_DEV_COUNT < group_devs->used + 1)
     {
         warn("cannot install additional group devices\n");
-        goto exit;
+        goto mutex_exit;
+    }
+
+    /* Reserve the table entry, such that storing the group
+       device cannot fail once it is installed. */
+    if (xa_reserve(&group_devs->groups, desc, GFP_KERNEL))
+    {
+        err("xa_reserve desc %u\n", desc);
+        goto mutex_exit;
     }
 
     /* Seek was non successful and there is enough space.
        Install the group device. */
-    gd = _install_group(desc);
-    if (gd)
+    gd = _install_group(desc, group_desc->mode);
+    if (!gd)
     {
-        dbg("obtained group_dev for desc %d\n", desc);
+        xa_release(&group_devs->groups, desc);
+        goto mutex_exit;
+    }
+    dbg("obtained group_dev for desc %u\n", desc);
 
-        /* Add group device to overall list. */
-        list_add(&gd->list, group_devs->group_devs_list);
-        dbg("added group_dev to the list\n");
+    /* Publish the group device to lockless lookups. */
+    xa_store(&group_devs->groups, desc, gd, GFP_KERNEL);
+    dbg("added group_dev to the table\n");
 
-        /* Increment number of used group devices. */
-        group_devs->used++;
+    /* Increment number of used group devices. */
+    group_devs->used++;
 
-        group_devs_list_print(group_devs->group_devs_list);
-        ret = 0;
-        goto exit;
-    }
+    group_devs_print();
+    ret = 0;
 
+mutex_exit:
+    mutex_unlock(&group_devs->install_mutex); /* Release resource. */
 exit:
     dbg_end();
     return ret;
@@ -360,52 +588,35 @@ exit:
 
 void group_free(struct group_dev *dev)
 {
+    unsigned int i;
     struct message *tmp_msg;
     struct list_head *pos, *q;
 
     dbg_start();
-    info("freeing group_dev%d\n", dev->minor);
+    info("freeing group_dev%u\n", dev->desc);
 
-    /* If the barrier has been raised, destroy it
-       and wake up waiting threads. */
-    if (is_barrier_up(dev)) //waitqueue_active(&dev->wait_queue)
+    /* If the barrier has been raised, wake up waiting
+       threads. */
+    if (is_barrier_up(dev))
     {
-        clear_barrier(dev);
-        dbg("clear_barrier\n");
-        wake_up_all(&dev->wait_queue);
-        dbg("wake_up_all\n");
+        barrier_awake(dev);
+        dbg("barrier_awake\n");
     }
 
-    /* Free workqueue before flushing it such that
-       delayed messages become available. */
-    if (dev->delay_wq)
-    {
-        fflush_workqueue(dev);
-        dbg("fflush_workqueue\n");
-        destroy_workqueue(dev->delay_wq);
-        dbg("destroy_workqueue\n");
-    }
+    /* No message can be dropped from now on. */
+    unregister_shrinker(&dev->shrinker);
+    dbg("unregister_shrinker\n");
 
-    /* Free workqueue semaphore. */
-    if (dev->wq_sem)
-    {
-        kfree(dev->wq_sem);
-        dbg("kfreed wq_sem\n");
-    }
+    /* Stop the publishing work, then make delayed messages
+       available such that they are freed with the others. */
+    cancel_delayed_work_sync(&dev->publish_work);
+    dbg("cancel_delayed_work_sync\n");
+    fflush_workqueue(dev);
+    dbg("fflush_workqueue\n");
 
-    /* Free delay_list. Should be empty. */
-    if (dev->delay_list)
-    {
-
-        if (!list_empty(dev->delay_list))
-        {
-            warn("delay_list not emptied\n");
-        }
-
-        /* Finally, free the list. */
-        kfree(dev->delay_list);
-        dbg("kfreed dev->delay_list\n");
-    }
+    /* Flushed messages may have armed the sweeping work. */
+    cancel_delayed_work_sync(&dev->expire_work);
+    dbg("cancel_delayed_work_sync expire_work\n");
 
     /* Free pending semaphore. */
     if (dev->pending_sem)
@@ -427,13 +638,8 @@ void group_free(struct group_dev *dev)
                 if (tmp_msg)
                 {
                     list_del(&tmp_msg->list);
-                    if (tmp_msg->data)
-                    {
-                        dbg("kfree tmp_msg->data\n");
-                        kfree(tmp_msg->data);
-                    }
-                    dbg("kfree tmp_msg\n");
-                    kfree(tmp_msg);
+                    dbg("message_free tmp_msg\n");
+                    message_free(tmp_msg);
                 }
                 else
                 {
@@ -460,28 +666,23 @@ void group_free(struct group_dev *dev)
         dbg("kfreed dev->message_sem\n");
     }
 
-    /* Free message list. */
-    if (dev->message_list)
+    /* Free message lists, one per level and tag. */
+    for (i = 0; dev->message_list && i < GROUP_PRIORITY_LEVELS * GROUP_TAGS; i++)
     {
-        message_list_print(dev->message_list);
-        if (!list_empty(dev->message_list))
+        message_list_print(&dev->message_list[i]);
+        if (!list_empty(&dev->message_list[i]))
         {
             /* Free messages if any. */
-            list_for_each_prev_safe(pos, q, dev->message_list)
+            list_for_each_prev_safe(pos, q, &dev->message_list[i])
             {
                 dbg("traversing dev->message_list\n");
                 tmp_msg = list_entry(pos, struct message, list);
                 if (tmp_msg)
                 {
                     list_del(&tmp_msg->list);
-                    if (tmp_msg->data)
-                    {
-                        message_print(tmp_msg);
-                        dbg("kfree tmp_msg->data\n");
-                        kfree(tmp_msg->data);
-                    }
-                    dbg("kfree tmp_msg\n");
-                    kfree(tmp_msg);
+                    message_print(tmp_msg);
+                    dbg("message_free tmp_msg\n");
+                    message_free(tmp_msg);
                 }
                 else
                 {
@@ -491,16 +692,65 @@ void group_free(struct group_dev *dev)
             }
         }
 
-        if (!list_empty(dev->message_list))
+        if (!list_empty(&dev->message_list[i]))
         {
             warn("message_list not emptied\n");
         }
+    }
 
-        /* Finally, free the list. */
+    /* Finally, free the lists. */
+    if (dev->message_list)
+    {
         kfree(dev->message_list);
         dbg("kfreed dev->message_list\n");
     }
 
+    /* Free message ring, including its messages. */
+    if (dev->ring)
+    {
+        ring_free(dev->ring);
+        dbg("kfreed dev->ring\n");
+    }
+
+    /* Free shared region, messages are stored inline. */
+    if (dev->shared)
+    {
+        shared_ring_free(dev->shared);
+        dbg("vfreed dev->shared\n");
+    }
+
+    /* Free sub-queues, including their messages. */
+    if (dev->shards)
+    {
+        shards_free(dev->shards);
+        dbg("kfreed dev->shards\n");
+    }
+
+    /* Free broadcast log, including its messages. */
+    if (dev->broadcast)
+    {
+        broadcast_free(dev->broadcast);
+        dbg("kfreed dev->broadcast\n");
+    }
+
+    /* Free retained log, including its messages. */
+    if (dev->log)
+    {
+        log_free(dev->log);
+        dbg("kfreed dev->log\n");
+    }
+
+    /* Free spill, spilled messages are not accounted. */
+    if (dev->spill)
+    {
+        spill_free(dev->spill);
+        dbg("kfreed dev->spill\n");
+    }
+
+    /* Give back to the global budget the bytes of messages just
+       freed, or of the shared region. */
+    global_storage_uncharge(atomic_long_read(&dev->stored_bytes));
+
     /* End of the story, free the group device managing structure. */
     kfree(dev);
 
@@ -508,11 +758,85 @@ void group_free(struct group_dev *dev)
     return;
 }
 
+/* Unpublishes the descriptor, the minor and the character
+   device of a group device, which is not freed. Must be
+   invoked holding install_mutex. */
+static void _remove_group(struct group_dev *dev)
+{
+    xa_erase(&group_devs->groups, dev->desc); /* Delete from table. */
+    xa_erase(&group_devs->minors, dev->minor); /* No open may find it anymore. */
+    device_destroy(group_dev_class, MKDEV(group_devs->major, dev->minor)); /* Destroy device */
+    cdev_del(dev->cdev); /* Delete char dev structure. */
+    group_devs->used--;
+    dbg("group_dev%u removed\n", dev->desc);
+}
+
+void reclaim_idle_groups(struct work_struct *work)
+{
+    unsigned long desc, timeout;
+    struct group_dev *gd, *tmp;
+    LIST_HEAD(reclaimed);
+
+    dbg_start();
+
+    timeout = msecs_to_jiffies(group_idle_timeout);
+
+    mutex_lock(&group_devs->install_mutex); /* Acquire resource. */
+
+    xa_for_each(&group_devs->groups, desc, gd)
+    {
+        if (!timeout || time_before(jiffies, READ_ONCE(gd->last_used) + timeout))
+        {
+            continue;
+        }
+
+        /* Forbid further opens, unless some file is open. */
+        if (atomic_cmpxchg(&gd->users, 0, -1))
+        {
+            continue;
+        }
+
+        /* Keep group devices storing messages or threads. */
+        if (!group_is_idle(gd))
+        {
+            atomic_set(&gd->users, 0);
+            continue;
+        }
+
+        _remove_group(gd);
+        list_add(&gd->list, &reclaimed);
+    }
+
+    mutex_unlock(&group_devs->install_mutex); /* Release resource. */
+
+    if (!list_empty(&reclaimed))
+    {
+        /* Openers may still be referencing reclaimed group
+           devices found before their minor was erased. */
+        synchronize_rcu();
+        list_for_each_entry_safe(gd, tmp, &reclaimed, list)
+        {
+            list_del(&gd->list);
+            info("reclaiming idle group_dev%u\n", gd->desc);
+            group_free(gd);
+        }
+    }
+
+    /* Rearm, the timeout cannot change at runtime. */
+    if (group_idle_timeout)
+    {
+        schedule_delayed_work(&group_devs->reclaim_work, msecs_to_jiffies(group_idle_timeout));
+    }
+
+    dbg_end();
+    return;
+}
+
 void group_free_all(void)
 {
-    int minor, major, to_free;
+    int to_free;
+    unsigned long desc;
     struct group_dev *tmp_dev;
-    struct list_head *pos, *q;
 
     dbg_start();
 
@@ -525,59 +849,38 @@ void group_free_all(void)
     }
 
     to_free = group_devs->used;
-    major = group_devs->major;
 
-    /* Check group devices list. */
-    if (!group_devs->group_devs_list)
-    {
-        ref_err("group_devs_list");
-        goto exit;
-    }
+    /* Stop reclaiming group devices. Since the module is being
+       removed, no file is open. */
+    cancel_delayed_work_sync(&group_devs->reclaim_work);
+    dbg("cancel_delayed_work_sync\n");
 
-    group_devs_list_print(group_devs->group_devs_list);
+    group_devs_print();
     dbg("to_free = %d", to_free);
 
-    if (!list_empty(group_devs->group_devs_list))
+    /* Traversing all group devices. */
+    xa_for_each(&group_devs->groups, desc, tmp_dev)
     {
-        /* Traversing all group devices. */
-        list_for_each_prev_safe(pos, q, group_devs->group_devs_list)
-        {
-            tmp_dev = list_entry(pos, struct group_dev, list);
-
-            if (!tmp_dev)
-            {
-                ref_err("tmp_dev");
-                break;
-            }
-
-            minor = tmp_dev->minor;
-
-            list_del(&tmp_dev->list); /* Delete from list. */
-            dbg("group_dev%d list_del\n", minor);
+        _remove_group(tmp_dev);
 
-            device_destroy(group_dev_class, MKDEV(major, minor)); /* Destroy device */
-            dbg("group_dev%d device_destroy\n", minor);
+        group_free(tmp_dev); /* Free the structure matching desc. */
+        dbg("group_dev%lu structure freed\n", desc);
 
-            cdev_del(&tmp_dev->cdev); /* Delete char dev structure. */
-            dbg("group_dev%d cdev_del\n", minor);
-
-            group_free(tmp_dev); /* Free the structure matching minor. */
-            dbg("group_dev%d structure freed\n", minor);
-
-            to_free--; /* Decrease for further check.*/
-        }
+        to_free--; /* Decrease for further check.*/
     }
+    xa_destroy(&group_devs->groups);
+    xa_destroy(&group_devs->minors);
 
     /* Unregister character device region. */
-    unregister_chrdev_region(MKDEV(major, 0), GROUP_DEV_COUNT);
-    dbg("unregister_chrdev_region major %d - minor %d\n", major, 0);
+    unregister_chrdev_region(MKDEV(group_devs->major, 0), GROUP_DEV_COUNT);
+    dbg("unregister_chrdev_region major %d - minor %d\n", group_devs->major, 0);
 
     class_destroy(group_dev_class); /* Destroy the class group devices belong to. */
     dbg("group_class_destroy\n");
 
-    /* Free group devices list and structure. */
-    kfree(group_devs->group_devs_list);
+    /* Free group devices structure. */
     kfree(group_devs);
+    group_devs = NULL;
 
 exit:
     /* The cleanup should free n = used group devices. If to_free
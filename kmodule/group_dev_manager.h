@@ -1,15 +1,30 @@
 #pragma once
 
+#include <linux/xarray.h>
+#include <linux/mutex.h>
+#include <linux/kdev_t.h>
+#include <linux/workqueue.h>
+
 /**
- * maximum number of group devices.
+ * maximum number of group devices installed at the same time.
+ * Descriptors span the whole 32-bit range, while minors are
+ * dynamically assigned in [0 , GROUP_DEV_COUNT - 1].
  */
-#define GROUP_DEV_COUNT 256 /* [0 , GROUP_DEV_COUNT - 1]. */
+#define GROUP_DEV_COUNT (MINORMASK + 1)
 
 #define GROUP_DEVICE_NAME "group_dev"
 #define GROUP_CLASS_NAME "group_dev_class"
 
-#define GROUP_FORMAT "group_dev%d"
-#define GROUP_FORMAT_LENGTH strlen(GROUP_FORMAT) + 3
+#define GROUP_FORMAT "group_dev%u"
+#define GROUP_FORMAT_LENGTH strlen(GROUP_FORMAT) + 10
+
+/**
+ * Milliseconds a group device has to be left unused, with no
+ * open file and no state, before being reclaimed. 0 disables
+ * reclamation. Read-only once the module is loaded, since the
+ * reclaiming work is armed at load time.
+ */
+extern unsigned int group_idle_timeout;
 
 /**
  * struct group_devices - struct for all group devices.
@@ -17,22 +32,36 @@
  * @used: number of used group devices
  * @major: the major number associated to all group
  * devices
- * @group_devs_list: head of the list containing all group
- * devices managing structures.
- * 
- * This struct manages all group devices.
+ * @groups: table of group devices managing structures,
+ * indexed by descriptor
+ * @minors: table of group devices managing structures,
+ * indexed by minor, allocating free minors
+ * @install_mutex: mutex serializing installers and the
+ * reclamation of idle group devices
+ * @reclaim_work: the work periodically reclaiming idle
+ * group devices
+ * 
+ * This struct manages all group devices. Lookups in @groups
+ * and @minors are lockless, while installations and
+ * reclamations hold @install_mutex.
  */
 struct group_devices
 {
-    unsigned short used;
+    unsigned int used;
     unsigned int major;
-    struct list_head *group_devs_list;
+    struct xarray groups;
+    struct xarray minors;
+    struct mutex install_mutex;
+    struct delayed_work reclaim_work;
 };
 
+extern struct group_devices *group_devs;
+
 /**
  * init_group_devs() - initializes struct group devices.
  * 
- * Initializes @group_devices struct.
+ * Initializes @group_devices struct. Invoked when the module
+ * is loaded, before any group device can be installed.
  * 
  * Returns:
  * 0 - ok
@@ -45,15 +74,16 @@ int init_group_devs(void);
  * 
  * @desc: descriptor for the group device
  * 
- * Traverses group devices list searching for a group device
- * whose minor matches @desc. Used to check whether a specific
- * group device has been already installed.
+ * Looks up the group device installed for @desc in constant
+ * time. Used to check whether a specific group device has been
+ * already installed. Safe without any lock, since group
+ * devices are published only once fully initialized.
  * 
  * Returns:
  * NULL - group device not found
  * struct group_dev* - group device found
  */
-struct group_dev *_get_group(int desc);
+struct group_dev *_get_group(unsigned int desc);
 
 /**
  * get_group() - wrapper for _get_group.
@@ -67,23 +97,57 @@ struct group_dev *_get_group(int desc);
  * NULL - group device not found
  * struct group_dev* - group device found
  */
-struct group_dev *get_group(int desc);
+struct group_dev *get_group(unsigned int desc);
+
+/**
+ * get_group_ref() - resolves and holds a group device.
+ * 
+ * @desc: descriptor for the group device
+ * 
+ * Looks up the group device installed for @desc and takes a
+ * reference to it, as an open file does, such that it cannot
+ * be reclaimed until the reference is dropped by decrementing
+ * its users. Fails if the group device is being reclaimed.
+ * 
+ * Returns:
+ * NULL - no group device can be held
+ * struct group_dev* - referenced group device
+ */
+struct group_dev *get_group_ref(unsigned int desc);
+
+/**
+ * get_group_by_minor() - resolves the group device opened
+ * through a minor.
+ * 
+ * @minor: the minor number of the opened inode
+ * 
+ * Looks up the group device currently owning @minor and
+ * takes a reference to it on behalf of the file being
+ * opened. Fails if the group device is being reclaimed.
+ * 
+ * Returns:
+ * NULL - no group device can be opened
+ * struct group_dev* - referenced group device
+ */
+struct group_dev *get_group_by_minor(unsigned int minor);
 
 /**
  * _install_group() - installs a group device.
  * 
  * @desc: descriptor for group device
+ * @mode: storage mode for messages (GROUP_MODE_*)
  * 
  * The group device for @desc is installed. All structures are
  * allocated and initialized. In addition to the kernel
  * structure for managing the group device, the character device
- * itself is installed onto the machine.
+ * itself is installed onto the machine, with the first free
+ * minor.
  * 
  * Returns:
  * NULL - group device not found
  * struct group_dev* - group device found
  */
-struct group_dev *_install_group(int desc);
+struct group_dev *_install_group(unsigned int desc, unsigned char mode);
 
 /**
  * install_group() - whole group device installation process.
@@ -92,9 +156,17 @@ struct group_dev *_install_group(int desc);
  * 
  * Wrapper for previously mentioned functions.
  * First, tries to retrieve a group device for the given
- * descriptor. In the case where no group device was found,
- * then it has to be installed. Hence, if there is enough
- * space, the function tries to install a group device.
+ * descriptor without locking. In the case where no group
+ * device was found, then it has to be installed. Hence,
+ * installers are serialized, the lookup is repeated and, if
+ * there is enough space, the function tries to install a
+ * group device. A group device being reclaimed is not
+ * considered installed, it is installed again once gone.
+ * The storage mode in @group_desc is only honoured when the
+ * group device is installed. Since idle group devices may be
+ * reclaimed, the mode, the delay and the barrier party count
+ * of a group device are not preserved once no file is open
+ * and no state is stored.
  * 
  * Returns:
  * 0 - group device found or installed
@@ -114,6 +186,21 @@ int install_group(struct group_t *group_desc);
  */
 void group_free(struct group_dev *dev);
 
+/**
+ * reclaim_idle_groups() - reclaims idle group devices.
+ * 
+ * @work: the reclaim_work of group_devs
+ * 
+ * Removes every group device that has no open file, stores no
+ * state and has been unused for group_idle_timeout msecs, both
+ * the character device and its descriptor and minor. The work
+ * rearms itself as long as reclamation is enabled.
+ * 
+ * Returns:
+ * void
+ */
+void reclaim_idle_groups(struct work_struct *work);
+
 /**
  * group_free_all() - frees all group devices.
  * 
@@ -1,7 +1,152 @@
+#pragma once
+
 #include <linux/ioctl.h>
+#include <linux/types.h>
+#ifdef __KERNEL__
+#include <linux/uio.h>
+#else
+#include <sys/uio.h>
+#endif
 
 #define IOCTL_IDENTIFIER 's'
 
+/**
+ * Maximum number of messages moved by a single batch.
+ */
+#define GROUP_BATCH_MAX 1024
+
+/**
+ * Number of priority levels of messages. Readers are always
+ * served from the highest non-empty level, 0 being the lowest
+ * and the default one.
+ */
+#define GROUP_PRIORITY_LEVELS 4
+
+/**
+ * Number of tags messages can be labelled with. Files
+ * subscribe to a set of tags by means of a bitmask, all tags
+ * by default, and messages are sent with tag 0 by default.
+ */
+#define GROUP_TAGS 32
+#define GROUP_TAGS_ALL 0xffffffffU
+
+/**
+ * struct group_batch - argument of batch IOCTL.
+ * 
+ * @iov: one iovec per message
+ * @vlen: number of iovecs
+ * 
+ * When sending, each iovec describes a message. When
+ * retrieving, each iovec describes a buffer and its length is
+ * overwritten with the number of bytes actually retrieved.
+ */
+struct group_batch
+{
+    struct iovec *iov;
+    unsigned int vlen;
+};
+
+/**
+ * Alignment of the hot fields of the shared region.
+ */
+#define SHARED_CACHELINE 64
+
+/**
+ * struct shared_header - header of the region shared by group
+ * devices installed with GROUP_MODE_SHARED.
+ * 
+ * @slot_count: number of slots, a power of two
+ * @slot_size: bytes of each slot, struct shared_slot included
+ * @data_offset: offset of the first slot within the region
+ * @region_size: bytes of the whole region
+ * @count: number of reserved slots
+ * @sleepers: number of readers sleeping into the kernel
+ * @polled: set once the group device has been polled
+ * @writers: number of writers sleeping into the kernel for a
+ * free slot
+ * @enqueue_pos: next position writers will claim
+ * @dequeue_pos: next position readers will claim
+ * 
+ * Writers reserve a slot by incrementing @count unless it
+ * equals @slot_count, claim @enqueue_pos by compare and swap,
+ * fill the slot and publish it by setting its sequence number
+ * to pos + 1. Readers claim @dequeue_pos when the sequence
+ * number is pos + 1, copy the message out, set the sequence
+ * number to pos + @slot_count and decrement @count. Slots with
+ * zero length carry no message and are skipped by readers.
+ * After publishing, writers must issue IOCTL_SHARED_WAKE if
+ * either @sleepers or @polled is set. After freeing a slot,
+ * readers must do the same if either @writers or @polled is
+ * set.
+ */
+struct shared_header
+{
+    __u32 slot_count;
+    __u32 slot_size;
+    __u32 data_offset;
+    __u32 region_size;
+
+    __s32 count __attribute__((aligned(SHARED_CACHELINE)));
+    __u32 sleepers;
+    __u32 polled;
+    __u32 writers;
+
+    __u64 enqueue_pos __attribute__((aligned(SHARED_CACHELINE)));
+    __u64 dequeue_pos __attribute__((aligned(SHARED_CACHELINE)));
+};
+
+/**
+ * struct shared_slot - a slot of the shared region.
+ * 
+ * @seq: sequence number, as for struct shared_header
+ * @length: bytes of the message
+ * @data: the message
+ */
+struct shared_slot
+{
+    __u64 seq;
+    __u32 length;
+    __u32 pad;
+    char data[];
+};
+
+/**
+ * struct group_header - metadata preceding each message
+ * retrieved through a file reading headers.
+ * 
+ * @seq: per-group counter of published messages, starting
+ * from 1. In GROUP_MODE_LIST it follows the order messages are
+ * stored in, while in GROUP_MODE_RING and GROUP_MODE_SHARDED
+ * concurrent writers may enqueue them out of @seq order, hence
+ * @seq is not the delivery order there
+ * @enqueued: CLOCK_MONOTONIC nsecs at which the message was
+ * written
+ * @published: CLOCK_MONOTONIC nsecs at which the message was
+ * published, later than @enqueued for delayed messages
+ * @tgid: process id of the writer, 0 if unknown
+ * @tid: thread id of the writer, 0 if unknown
+ * @size: bytes the writer asked to write, before truncation
+ * to max_message_size
+ * @length: bytes of the message following the header, after
+ * truncation to the buffer of the reader
+ * 
+ * A file reading headers, see IOCTL_SET_HEADER, retrieves the
+ * header and then the message into the same buffer, by means
+ * of read(), readv() and IOCTL_RECV_BATCH. Buffers shorter
+ * than the header are refused. Not available for group
+ * devices installed with GROUP_MODE_SHARED.
+ */
+struct group_header
+{
+    __u64 seq;
+    __u64 enqueued;
+    __u64 published;
+    __u32 tgid;
+    __u32 tid;
+    __u64 size;
+    __u64 length;
+};
+
 /**
  * IOCTL for tsm device.
  */
@@ -10,6 +155,8 @@
 #define IOCTL_INSTALL_GROUP _IOW(IOCTL_IDENTIFIER, 0, struct group_t *)
 /* Retrieves from kernel the max_message_size module parameter. */
 #define IOCTL_MAX_MESSAGE_SIZE _IOR(IOCTL_IDENTIFIER, 1, unsigned int)
+/* Checkpoints all group devices into the checkpoint_path module parameter. */
+#define IOCTL_CHECKPOINT _IO(IOCTL_IDENTIFIER, 16)
 
 /**
  * IOCTL for group devices.
@@ -20,3 +167,29 @@
 /* Writes to kernel the group device delay. */
 #define IOCTL_SET_SEND_DELAY _IOW(IOCTL_IDENTIFIER, 4, long)
 #define IOCTL_REVOKE_DELAYED_MESSAGES _IO(IOCTL_IDENTIFIER, 5)
+/* Sends an array of messages, one per iovec. */
+#define IOCTL_SEND_BATCH _IOW(IOCTL_IDENTIFIER, 6, struct group_batch *)
+/* Retrieves up to an array of messages, one per iovec. */
+#define IOCTL_RECV_BATCH _IOWR(IOCTL_IDENTIFIER, 7, struct group_batch *)
+/* Retrieves from kernel the size of the region to be mapped. */
+#define IOCTL_SHARED_SIZE _IOR(IOCTL_IDENTIFIER, 8, unsigned long)
+/* Wakes up readers after publishing into the shared region. */
+#define IOCTL_SHARED_WAKE _IO(IOCTL_IDENTIFIER, 9)
+/* Writes to kernel the priority of messages sent through a file. */
+#define IOCTL_SET_PRIORITY _IOW(IOCTL_IDENTIFIER, 10, unsigned int)
+/* Writes to kernel the tag of messages sent through a file. */
+#define IOCTL_SET_TAG _IOW(IOCTL_IDENTIFIER, 11, unsigned int)
+/* Writes to kernel the bitmask of tags a file retrieves. */
+#define IOCTL_SUBSCRIBE _IOW(IOCTL_IDENTIFIER, 12, __u32)
+/* Writes to kernel the time to live of messages of a group, in msecs. */
+#define IOCTL_SET_GROUP_TTL _IOW(IOCTL_IDENTIFIER, 13, unsigned long)
+/* Writes to kernel the time to live of messages sent through a file, in msecs. */
+#define IOCTL_SET_TTL _IOW(IOCTL_IDENTIFIER, 14, unsigned long)
+/* Retrieves from kernel the number of expired messages of a group. */
+#define IOCTL_EXPIRED _IOR(IOCTL_IDENTIFIER, 15, unsigned long)
+/* Writes to kernel whether a file retrieves a header before each message. */
+#define IOCTL_SET_HEADER _IOW(IOCTL_IDENTIFIER, 17, unsigned int)
+/* Writes to kernel the number of threads the counting barrier of a group waits for. */
+#define IOCTL_SET_BARRIER_PARTIES _IOW(IOCTL_IDENTIFIER, 18, unsigned int)
+/* Waits on the counting barrier of a group. */
+#define IOCTL_WAIT_BARRIER _IO(IOCTL_IDENTIFIER, 19)
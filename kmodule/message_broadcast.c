@@ -0,0 +1,205 @@
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "group_dev.h"
+#include "message_broadcast.h"
+#include "message_cache.h"
+
+struct message_broadcast *broadcast_alloc(unsigned int lag)
+{
+    unsigned int count;
+    struct message_broadcast *b;
+
+    dbg_start();
+
+    /* Sequence numbers are turned into slot indexes with a
+       mask. */
+    count = roundup_pow_of_two(max(lag, 1U));
+
+    b = kvzalloc(struct_size(b, slot, count), GFP_KERNEL);
+    if (!b)
+    {
+        kzalloc_err("broadcast");
+        goto exit;
+    }
+
+    spin_lock_init(&b->lock);
+    b->mask = count - 1;
+    dbg("broadcast log of %u slots allocated\n", count);
+
+exit:
+    dbg_end();
+    return b;
+}
+
+/* Removes the oldest message from the log. */
+static void _broadcast_drop(struct message_broadcast *b, size_t *released)
+{
+    struct message *msg;
+
+    msg = b->slot[b->head & b->mask];
+    b->slot[b->head & b->mask] = NULL;
+    b->head++;
+
+    *released += msg->data_size;
+    message_put(msg); /* Drop the reference of the log. */
+}
+
+/* Removes the oldest messages retrieved by every subscriber.
+   Cursors only move forward, hence they are all at the head
+   of the log. */
+static void _broadcast_trim(struct message_broadcast *b, size_t *released)
+{
+    while (b->head != b->tail && !b->slot[b->head & b->mask]->pending)
+    {
+        _broadcast_drop(b, released);
+    }
+}
+
+void broadcast_free(struct message_broadcast *b)
+{
+    size_t released;
+
+    dbg_start();
+
+    if (!b)
+    {
+        ref_err("broadcast");
+        goto exit;
+    }
+
+    /* Free messages if any. */
+    released = 0;
+    while (b->head != b->tail)
+    {
+        message_print(b->slot[b->head & b->mask]);
+        _broadcast_drop(b, &released);
+    }
+
+    kvfree(b);
+
+exit:
+    dbg_end();
+    return;
+}
+
+void broadcast_subscribe(struct message_broadcast *b, u64 *cursor, int *subscribed)
+{
+    spin_lock(&b->lock); /* Acquire resource. */
+    if (!*subscribed)
+    {
+        *cursor = b->tail;
+        b->subscribers++;
+        /* Lockless readers of the flag find the cursor set. */
+        smp_store_release(subscribed, 1);
+    }
+    spin_unlock(&b->lock); /* Release resource. */
+}
+
+void broadcast_unsubscribe(struct message_broadcast *b, u64 *cursor, int *subscribed, size_t *released)
+{
+    u64 seq;
+
+    spin_lock(&b->lock); /* Acquire resource. */
+    if (!*subscribed)
+    {
+        spin_unlock(&b->lock); /* Release resource. */
+        return;
+    }
+    *subscribed = 0;
+
+    /* Messages dropped meanwhile do not wait for anybody. */
+    for (seq = max(*cursor, b->head); seq != b->tail; seq++)
+    {
+        b->slot[seq & b->mask]->pending--;
+    }
+    b->subscribers--;
+    _broadcast_trim(b, released);
+
+    spin_unlock(&b->lock); /* Release resource. */
+}
+
+void broadcast_publish(struct message_broadcast *b, struct message *msg, size_t *released)
+{
+    spin_lock(&b->lock); /* Acquire resource. */
+
+    /* The slowest subscriber lags behind by as many messages as
+       the log holds. */
+    if (b->tail - b->head > b->mask)
+    {
+        dbg("broadcast log full, oldest message dropped\n");
+        _broadcast_drop(b, released);
+    }
+
+    /* The log holds the reference of the writer until every
+       subscriber retrieved the message. */
+    msg->pending = b->subscribers;
+    b->slot[b->tail & b->mask] = msg;
+    b->tail++;
+    _broadcast_trim(b, released);
+
+    spin_unlock(&b->lock); /* Release resource. */
+}
+
+struct message *broadcast_take(struct message_broadcast *b, u64 *cursor, size_t *released)
+{
+    struct message *msg;
+
+    msg = NULL;
+    spin_lock(&b->lock); /* Acquire resource. */
+
+    /* Skip messages dropped before the subscriber retrieved
+       them. */
+    if (*cursor < b->head)
+    {
+        dbg("%llu messages lost by a slow subscriber\n", b->head - *cursor);
+        *cursor = b->head;
+    }
+
+    if (*cursor != b->tail)
+    {
+        msg = b->slot[*cursor & b->mask];
+        (*cursor)++;
+
+        /* Copying happens outside the lock, meanwhile the
+           message may leave the log. */
+        message_get(msg);
+        msg->pending--;
+        _broadcast_trim(b, released);
+    }
+
+    spin_unlock(&b->lock); /* Release resource. */
+    return msg;
+}
+
+int broadcast_evict(struct message_broadcast *b, size_t *released)
+{
+    int ret;
+
+    ret = 0;
+    spin_lock(&b->lock); /* Acquire resource. */
+    if (b->head != b->tail)
+    {
+        _broadcast_drop(b, released);
+        ret = 1;
+    }
+    spin_unlock(&b->lock); /* Release resource. */
+
+    return ret;
+}
+
+int broadcast_empty(struct message_broadcast *b, u64 *cursor)
+{
+    u64 seq;
+
+    seq = READ_ONCE(b->head);
+    if (cursor)
+    {
+        seq = max(seq, READ_ONCE(*cursor));
+    }
+
+    return seq == READ_ONCE(b->tail);
+}
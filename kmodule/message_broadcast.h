@@ -0,0 +1,162 @@
+#pragma once
+
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+struct message;
+
+/**
+ * struct message_broadcast - log of messages delivered to
+ * every subscriber.
+ *
+ * @lock: spinlock protecting the log and the cursors of its
+ * subscribers
+ * @mask: number of slots minus one (slots are a power of two)
+ * @head: sequence number of the oldest message in the log
+ * @tail: sequence number of the next published message
+ * @subscribers: number of cursors registered on the log
+ * @slot: published messages, indexed by sequence number
+ *
+ * Each message is stored once, however many subscribers
+ * there are. Every subscriber owns a cursor, the sequence
+ * number of the next message it retrieves, and a message
+ * leaves the log as soon as the slowest subscriber retrieved
+ * it. No subscriber may lag behind by more messages than the
+ * log has slots: publishing into a full log drops the oldest
+ * message, which is lost for whoever did not retrieve it yet.
+ */
+struct message_broadcast
+{
+    spinlock_t lock;
+    unsigned long mask;
+    u64 head;
+    u64 tail;
+    unsigned int subscribers;
+
+    struct message *slot[];
+};
+
+/**
+ * broadcast_alloc() - allocates a log.
+ *
+ * @lag: the number of messages a subscriber may lag behind,
+ * rounded up to a power of two
+ *
+ * Returns:
+ * NULL - allocation failed
+ * struct message_broadcast* - the log
+ */
+struct message_broadcast *broadcast_alloc(unsigned int lag);
+
+/**
+ * broadcast_free() - frees a log.
+ *
+ * @b: the log to be freed
+ *
+ * Frees all messages still stored into @b and the log
+ * itself. No subscriber may be left.
+ *
+ * Returns:
+ * void
+ */
+void broadcast_free(struct message_broadcast *b);
+
+/**
+ * broadcast_subscribe() - registers a subscriber.
+ *
+ * @b: the log
+ * @cursor: the cursor of the subscriber
+ * @subscribed: set once the subscriber is registered
+ *
+ * The subscriber retrieves messages published from now on.
+ * Nothing is done if @subscribed is already set, hence
+ * concurrent callers register the subscriber once.
+ *
+ * Returns:
+ * void
+ */
+void broadcast_subscribe(struct message_broadcast *b, u64 *cursor, int *subscribed);
+
+/**
+ * broadcast_unsubscribe() - unregisters a subscriber.
+ *
+ * @b: the log
+ * @cursor: the cursor of the subscriber
+ * @subscribed: whether the subscriber was registered, cleared
+ * @released: incremented by the bytes of messages leaving
+ * the log
+ *
+ * Messages the subscriber did not retrieve yet no longer wait
+ * for it. Nothing is done if @subscribed is not set.
+ *
+ * Returns:
+ * void
+ */
+void broadcast_unsubscribe(struct message_broadcast *b, u64 *cursor, int *subscribed, size_t *released);
+
+/**
+ * broadcast_publish() - stores a message.
+ *
+ * @b: the log
+ * @msg: the message to be stored
+ * @released: incremented by the bytes of messages leaving
+ * the log
+ *
+ * Stores @msg as the newest message of @b, dropping the
+ * oldest one if @b is full. Without subscribers, @msg leaves
+ * the log straight away.
+ *
+ * Returns:
+ * void
+ */
+void broadcast_publish(struct message_broadcast *b, struct message *msg, size_t *released);
+
+/**
+ * broadcast_take() - retrieves a message for a subscriber.
+ *
+ * @b: the log
+ * @cursor: the cursor of the subscriber
+ * @released: incremented by the bytes of messages leaving
+ * the log
+ *
+ * Moves @cursor past the oldest message the subscriber did not
+ * retrieve yet. The message is shared with other subscribers:
+ * it must not be modified and it must be given back by means
+ * of message_put() instead of message_free().
+ *
+ * Returns:
+ * NULL - the subscriber retrieved every message
+ * struct message* - the message
+ */
+struct message *broadcast_take(struct message_broadcast *b, u64 *cursor, size_t *released);
+
+/**
+ * broadcast_evict() - drops the oldest message.
+ *
+ * @b: the log
+ * @released: incremented by the bytes of the dropped message
+ *
+ * Makes room for new messages at the expense of the slowest
+ * subscribers.
+ *
+ * Returns:
+ * 1 - a message has been dropped
+ * 0 - the log is empty
+ */
+int broadcast_evict(struct message_broadcast *b, size_t *released);
+
+/**
+ * broadcast_empty() - checks whether a subscriber retrieved
+ * every message.
+ *
+ * @b: the log
+ * @cursor: the cursor of the subscriber, NULL to check whether
+ * the log is empty
+ *
+ * Lockless check, suitable as a wait condition.
+ *
+ * Returns:
+ * 1 - no message can be retrieved
+ * 0 - otherwise
+ */
+int broadcast_empty(struct message_broadcast *b, u64 *cursor);
@@ -0,0 +1,438 @@
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/atomic.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "group_dev.h"
+#include "message_cache.h"
+
+static struct kmem_cache *message_cache;
+static struct kmem_cache *payload_cache;
+
+/* Size of payload cache objects, terminator included. */
+static size_t payload_size;
+
+static DEFINE_PER_CPU(struct message_pool, message_pools);
+
+/* Gives a message and its payload buffer back to the caches. */
+static void _message_release(struct message *msg)
+{
+    if (msg->buffer)
+    {
+        kmem_cache_free(payload_cache, msg->buffer);
+    }
+    kmem_cache_free(message_cache, msg);
+}
+
+/* Gives the pages backing a payload back. Pages still referred
+   to by a pipe are freed by the pipe. */
+static void _message_free_pages(struct message *msg)
+{
+    while (msg->nr_pages)
+    {
+        put_page(msg->pages[--msg->nr_pages]);
+    }
+    kfree(msg->pages);
+    msg->pages = NULL;
+}
+
+/* Backs a payload with single pages, such that no contiguous
+   memory is needed however large the payload is. */
+static int _message_alloc_pages(struct message *msg, size_t length)
+{
+    unsigned int i, count;
+
+    count = DIV_ROUND_UP(length, PAGE_SIZE);
+    msg->pages = kmalloc_array(count, sizeof(struct page *), GFP_KERNEL_ACCOUNT);
+    if (!msg->pages)
+    {
+        kmalloc_err("msg->pages");
+        return -1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        msg->pages[i] = alloc_page(GFP_KERNEL_ACCOUNT);
+        if (!msg->pages[i])
+        {
+            err("alloc_page %u of %u\n", i, count);
+            msg->nr_pages = i;
+            _message_free_pages(msg);
+            return -1;
+        }
+    }
+    msg->nr_pages = count;
+
+    return 0;
+}
+
+/* Returns the address of the payload byte at offset, and trims
+   length to the bytes contiguous to it. */
+static char *_message_chunk(struct message *msg, size_t offset, size_t *length)
+{
+    size_t in_page;
+
+    if (!msg->pages)
+    {
+        return msg->data + offset;
+    }
+
+    in_page = offset & ~PAGE_MASK;
+    *length = min_t(size_t, *length, PAGE_SIZE - in_page);
+    return (char *)page_address(msg->pages[offset >> PAGE_SHIFT]) + in_page;
+}
+
+int message_cache_init(void)
+{
+    int ret;
+
+    dbg_start();
+    ret = -1;
+
+    /* Stored messages are charged to the memory cgroup of the
+       writer. */
+    message_cache = kmem_cache_create(MESSAGE_CACHE_NAME, sizeof(struct message),
+                                      0, SLAB_HWCACHE_ALIGN | SLAB_ACCOUNT, NULL);
+    if (!message_cache)
+    {
+        err("kmem_cache_create %s\n", MESSAGE_CACHE_NAME);
+        goto exit;
+    }
+    dbg("%s created\n", MESSAGE_CACHE_NAME);
+
+    /* Payloads fitting into the header never reach this cache,
+       payloads exceeding a page are page backed. */
+    payload_size = clamp_t(size_t, max_message_size + 1, MESSAGE_INLINE_SIZE, PAGE_SIZE);
+    payload_cache = kmem_cache_create(PAYLOAD_CACHE_NAME, payload_size, 0, SLAB_ACCOUNT, NULL);
+    if (!payload_cache)
+    {
+        err("kmem_cache_create %s\n", PAYLOAD_CACHE_NAME);
+        goto payload_fail;
+    }
+    dbg("%s created with %ld bytes objects\n", PAYLOAD_CACHE_NAME, payload_size);
+
+    ret = 0;
+    goto exit;
+
+payload_fail:
+    kmem_cache_destroy(message_cache);
+exit:
+    dbg_end();
+    return ret;
+}
+
+void message_cache_destroy(void)
+{
+    int cpu;
+    struct message_pool *pool;
+
+    dbg_start();
+
+    /* Empty per-CPU pools. */
+    for_each_possible_cpu(cpu)
+    {
+        pool = per_cpu_ptr(&message_pools, cpu);
+        while (pool->count)
+        {
+            _message_release(pool->messages[--pool->count]);
+        }
+    }
+    dbg("message pools emptied\n");
+
+    kmem_cache_destroy(payload_cache);
+    kmem_cache_destroy(message_cache);
+    dbg("caches destroyed\n");
+
+    dbg_end();
+    return;
+}
+
+/* Prepares a header, recycled or not, for a payload of the
+   given length. */
+static int _message_prepare(struct message *msg, size_t length)
+{
+    INIT_LIST_HEAD(&msg->list);
+    atomic_set(&msg->refs, 1);
+
+    if (length < MESSAGE_INLINE_SIZE)
+    {
+        /* Small payload, store it into the header. */
+        msg->data = msg->inline_data;
+    }
+    else if (length < payload_size)
+    {
+        /* Reuse the buffer of the recycled message, if any. */
+        if (!msg->buffer)
+        {
+            msg->buffer = kmem_cache_alloc(payload_cache, GFP_KERNEL);
+            if (!msg->buffer)
+            {
+                err("kmem_cache_alloc %s\n", PAYLOAD_CACHE_NAME);
+                return -1;
+            }
+        }
+        msg->data = msg->buffer;
+    }
+    else
+    {
+        /* Large payload, scatter it over pages. */
+        msg->data = NULL;
+        if (_message_alloc_pages(msg, length))
+        {
+            return -1;
+        }
+    }
+
+    message_truncate(msg, length);
+    return 0;
+}
+
+/* Initializes a header coming from the message cache. */
+static void _message_init(struct message *msg)
+{
+    msg->buffer = NULL;
+    msg->pages = NULL;
+    msg->nr_pages = 0;
+}
+
+struct message *message_alloc(size_t length)
+{
+    struct message *msg;
+    struct message_pool *pool;
+
+    /* First, look for a recycled message on this CPU. It stays
+       charged to the memory cgroup which allocated it, pools
+       are small enough for this not to matter. */
+    msg = NULL;
+    pool = get_cpu_ptr(&message_pools);
+    if (pool->count)
+    {
+        msg = pool->messages[--pool->count];
+    }
+    put_cpu_ptr(&message_pools);
+
+    if (!msg)
+    {
+        msg = kmem_cache_alloc(message_cache, GFP_KERNEL);
+        if (!msg)
+        {
+            err("kmem_cache_alloc %s\n", MESSAGE_CACHE_NAME);
+            goto exit;
+        }
+        _message_init(msg);
+    }
+
+    if (_message_prepare(msg, length))
+    {
+        _message_release(msg);
+        msg = NULL;
+    }
+
+exit:
+    return msg;
+}
+
+int message_alloc_bulk(const u32 *lengths, unsigned int count, struct message **msgs)
+{
+    unsigned int i, failed;
+
+    /* Headers come straight from the cache, in one go. */
+    if (!kmem_cache_alloc_bulk(message_cache, GFP_KERNEL, count, (void **)msgs))
+    {
+        err("kmem_cache_alloc_bulk %u %s\n", count, MESSAGE_CACHE_NAME);
+        return -1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        _message_init(msgs[i]);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (_message_prepare(msgs[i], lengths[i]))
+        {
+            goto prepare_fail;
+        }
+    }
+
+    return 0;
+
+prepare_fail:
+    /* Give back prepared messages and untouched headers. */
+    failed = i;
+    for (i = 0; i < count; i++)
+    {
+        if (i < failed)
+        {
+            message_free(msgs[i]);
+        }
+        else
+        {
+            _message_release(msgs[i]);
+        }
+    }
+    return -1;
+}
+
+void message_free(struct message *msg)
+{
+    struct message_pool *pool;
+
+    if (!msg)
+    {
+        return;
+    }
+
+    /* The payload buffer stays with the message, pages do not. */
+    if (msg->pages)
+    {
+        _message_free_pages(msg);
+    }
+    msg->data = NULL;
+
+    /* Park the message on this CPU, if there is room. */
+    pool = get_cpu_ptr(&message_pools);
+    if (pool->count < MESSAGE_POOL_SIZE)
+    {
+        pool->messages[pool->count++] = msg;
+        msg = NULL;
+    }
+    put_cpu_ptr(&message_pools);
+
+    if (msg)
+    {
+        _message_release(msg);
+    }
+    return;
+}
+
+void message_get(struct message *msg)
+{
+    atomic_inc(&msg->refs);
+}
+
+void message_put(struct message *msg)
+{
+    if (atomic_dec_and_test(&msg->refs))
+    {
+        message_free(msg);
+    }
+}
+
+void message_truncate(struct message *msg, size_t length)
+{
+    msg->data_size = length;
+
+    /* Apply the terminator character. */
+    if (msg->data)
+    {
+        msg->data[length] = 0;
+    }
+}
+
+void message_read(struct message *msg, size_t offset, char *buf, size_t length)
+{
+    char *src;
+    size_t done, chunk;
+
+    for (done = 0; done < length; done += chunk)
+    {
+        chunk = length - done;
+        src = _message_chunk(msg, offset + done, &chunk);
+        memcpy(buf + done, src, chunk);
+    }
+}
+
+void message_write(struct message *msg, size_t offset, const char *buf, size_t length)
+{
+    char *dst;
+    size_t done, chunk;
+
+    for (done = 0; done < length; done += chunk)
+    {
+        chunk = length - done;
+        dst = _message_chunk(msg, offset + done, &chunk);
+        memcpy(dst, buf + done, chunk);
+    }
+}
+
+size_t message_copy_to_user(struct message *msg, char __user *buf, size_t length)
+{
+    char *src;
+    size_t offset, chunk;
+
+    for (offset = 0; offset < length; offset += chunk)
+    {
+        chunk = length - offset;
+        src = _message_chunk(msg, offset, &chunk);
+        if (copy_to_user(buf + offset, src, chunk))
+        {
+            return length - offset;
+        }
+    }
+
+    return 0;
+}
+
+size_t message_copy_from_user(struct message *msg, const char __user *buf, size_t length)
+{
+    char *dst;
+    size_t offset, chunk;
+
+    for (offset = 0; offset < length; offset += chunk)
+    {
+        chunk = length - offset;
+        dst = _message_chunk(msg, offset, &chunk);
+        if (copy_from_user(dst, buf + offset, chunk))
+        {
+            return length - offset;
+        }
+    }
+
+    return 0;
+}
+
+size_t message_copy_to_iter(struct message *msg, size_t length, struct iov_iter *to)
+{
+    char *src;
+    size_t offset, chunk, copied;
+
+    for (offset = 0; offset < length; offset += chunk)
+    {
+        chunk = length - offset;
+        src = _message_chunk(msg, offset, &chunk);
+        copied = copy_to_iter(src, chunk, to);
+        if (copied != chunk)
+        {
+            return offset + copied;
+        }
+    }
+
+    return length;
+}
+
+size_t message_copy_from_iter(struct message *msg, size_t length, struct iov_iter *from)
+{
+    char *dst;
+    size_t offset, chunk, copied;
+
+    for (offset = 0; offset < length; offset += chunk)
+    {
+        chunk = length - offset;
+        dst = _message_chunk(msg, offset, &chunk);
+        copied = copy_from_iter(dst, chunk, from);
+        if (copied != chunk)
+        {
+            return offset + copied;
+        }
+    }
+
+    return length;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <linux/slab.h>
+#include <linux/types.h>
+
+struct message;
+struct iov_iter;
+
+/**
+ * Names of the slab caches.
+ */
+
+#define MESSAGE_CACHE_NAME "tsm_message"
+#define PAYLOAD_CACHE_NAME "tsm_payload"
+
+/**
+ * Number of message headers each CPU keeps aside for reuse.
+ */
+
+#define MESSAGE_POOL_SIZE 64
+
+/**
+ * struct message_pool - per-CPU pool of free messages.
+ *
+ * @count: number of messages in the pool
+ * @messages: the free messages
+ *
+ * Freed messages are parked here, together with their payload
+ * buffer if any, so that the next write on the same CPU does
+ * not even reach the slab allocator.
+ */
+struct message_pool
+{
+    unsigned int count;
+    struct message *messages[MESSAGE_POOL_SIZE];
+};
+
+/**
+ * message_cache_init() - creates the slab caches.
+ *
+ * Creates the caches for message headers and payload buffers.
+ * Messages, including page backed payloads, are charged to the
+ * memory cgroup of the allocating task.
+ * Payload buffers are sized according to the value of
+ * max_message_size at the time the module is loaded, but never
+ * exceed a page.
+ *
+ * Returns:
+ * 0 - ok
+ * -1 - ko
+ */
+int message_cache_init(void);
+
+/**
+ * message_cache_destroy() - destroys the slab caches.
+ *
+ * Empties all per-CPU pools and destroys the caches. All
+ * messages must have been freed before.
+ *
+ * Returns:
+ * void
+ */
+void message_cache_destroy(void);
+
+/**
+ * message_alloc() - allocates a message.
+ *
+ * @length: number of bytes the message will carry
+ *
+ * Retrieves a message header able to host @length bytes plus
+ * the terminator character. Small payloads are stored inline
+ * into the header, larger ones into a buffer from the payload
+ * cache. Payloads exceeding the payload cache object size are
+ * scattered over single pages, so that messages of several
+ * megabytes need no contiguous memory: @data is NULL and
+ * @pages holds them, without any terminator character.
+ * Otherwise @data points to the storage. @data_size is set to
+ * @length.
+ *
+ * Returns:
+ * NULL - allocation failed
+ * struct message* - the message
+ */
+struct message *message_alloc(size_t length);
+
+/**
+ * message_alloc_bulk() - allocates several messages at once.
+ *
+ * @lengths: number of bytes each message will carry
+ * @count: number of messages
+ * @msgs: filled with the messages
+ *
+ * As message_alloc(), but headers are retrieved from the slab
+ * cache in a single call, bypassing per-CPU pools. Meant for
+ * rebuilding many messages at once.
+ *
+ * Returns:
+ * 0 - ok
+ * -1 - allocation failed, no message is left allocated
+ */
+int message_alloc_bulk(const u32 *lengths, unsigned int count, struct message **msgs);
+
+/**
+ * message_free() - frees a message.
+ *
+ * @msg: the message to be freed
+ *
+ * Gives @msg back to the pool of the current CPU or, if the
+ * pool is full, to the slab caches.
+ *
+ * Returns:
+ * void
+ */
+void message_free(struct message *msg);
+
+/**
+ * message_get() - takes a reference to a message.
+ *
+ * @msg: the message
+ *
+ * Messages stored once for several readers are referenced by
+ * the storage and by each reader copying them. message_alloc()
+ * returns a message with a single reference.
+ *
+ * Returns:
+ * void
+ */
+void message_get(struct message *msg);
+
+/**
+ * message_put() - drops a reference to a message.
+ *
+ * @msg: the message
+ *
+ * Frees @msg, as message_free() does, when the last reference
+ * is dropped.
+ *
+ * Returns:
+ * void
+ */
+void message_put(struct message *msg);
+
+/**
+ * message_truncate() - shortens a message.
+ *
+ * @msg: the message
+ * @length: the new length, not larger than the allocated one
+ *
+ * Sets @data_size and applies the terminator character, if the
+ * payload is not page backed.
+ *
+ * Returns:
+ * void
+ */
+void message_truncate(struct message *msg, size_t length);
+
+/**
+ * message_read() - copies a payload into a kernel buffer.
+ *
+ * @msg: the message
+ * @offset: position of the payload copied from
+ * @buf: the destination
+ * @length: bytes to be copied
+ *
+ * Returns:
+ * void
+ */
+void message_read(struct message *msg, size_t offset, char *buf, size_t length);
+
+/**
+ * message_write() - copies a kernel buffer into a payload.
+ *
+ * @msg: the message
+ * @offset: position of the payload @buf is copied to
+ * @buf: the source
+ * @length: bytes to be copied
+ *
+ * Returns:
+ * void
+ */
+void message_write(struct message *msg, size_t offset, const char *buf, size_t length);
+
+/**
+ * message_copy_to_user() - copies a payload to userspace.
+ *
+ * @msg: the message
+ * @buf: the userspace destination
+ * @length: bytes to be copied, not larger than @data_size
+ *
+ * Page backed payloads are copied a page at a time.
+ *
+ * Returns:
+ * 0 - ok
+ * size_t - bytes not copied
+ */
+size_t message_copy_to_user(struct message *msg, char __user *buf, size_t length);
+
+/**
+ * message_copy_from_user() - copies userspace data into a
+ * payload.
+ *
+ * @msg: the message
+ * @buf: the userspace source
+ * @length: bytes to be copied, not larger than @data_size
+ *
+ * Returns:
+ * 0 - ok
+ * size_t - bytes not copied
+ */
+size_t message_copy_from_user(struct message *msg, const char __user *buf, size_t length);
+
+/**
+ * message_copy_to_iter() - scatters a payload over an
+ * iterator.
+ *
+ * @msg: the message
+ * @length: bytes to be copied, not larger than @data_size
+ * @to: the destination
+ *
+ * Returns:
+ * size_t - bytes copied
+ */
+size_t message_copy_to_iter(struct message *msg, size_t length, struct iov_iter *to);
+
+/**
+ * message_copy_from_iter() - gathers a payload from an
+ * iterator.
+ *
+ * @msg: the message
+ * @length: bytes to be copied, not larger than @data_size
+ * @from: the source
+ *
+ * Returns:
+ * size_t - bytes copied
+ */
+size_t message_copy_from_iter(struct message *msg, size_t length, struct iov_iter *from);
@@ -0,0 +1,240 @@
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/jiffies.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "group_dev.h"
+#include "message_log.h"
+#include "message_cache.h"
+
+struct message_log *log_alloc(void)
+{
+    struct message_log *log;
+
+    dbg_start();
+
+    log = kzalloc(sizeof(struct message_log), GFP_KERNEL);
+    if (!log)
+    {
+        kzalloc_err("log");
+        goto exit;
+    }
+
+    spin_lock_init(&log->lock);
+    INIT_LIST_HEAD(&log->segments);
+    dbg("log allocated\n");
+
+exit:
+    dbg_end();
+    return log;
+}
+
+/* Removes the oldest segment from the log. */
+static void _log_drop(struct message_log *log, size_t *released)
+{
+    unsigned int i;
+    struct log_segment *seg;
+
+    seg = list_last_entry(&log->segments, struct log_segment, list);
+    list_del(&seg->list);
+    log->head = seg->base + seg->count;
+
+    /* Readers copying a message keep it alive. */
+    for (i = 0; i < seg->count; i++)
+    {
+        *released += seg->msg[i]->data_size;
+        message_put(seg->msg[i]);
+    }
+    kfree(seg);
+}
+
+void log_free(struct message_log *log)
+{
+    size_t released;
+
+    dbg_start();
+
+    if (!log)
+    {
+        ref_err("log");
+        goto exit;
+    }
+
+    /* Free messages if any. */
+    released = 0;
+    while (!list_empty(&log->segments))
+    {
+        _log_drop(log, &released);
+    }
+    dbg("log of %ld bytes freed\n", released);
+
+    kfree(log);
+
+exit:
+    dbg_end();
+    return;
+}
+
+int log_append(struct message_log *log, struct message *msg)
+{
+    struct log_segment *seg, *spare;
+
+    spare = NULL;
+
+retry:
+    spin_lock(&log->lock); /* Acquire resource. */
+
+    /* Start a new segment if the newest one is full. Segments
+       are allocated outside the lock. */
+    seg = list_first_entry_or_null(&log->segments, struct log_segment, list);
+    if (!seg || seg->count == LOG_SEGMENT_MESSAGES)
+    {
+        if (!spare)
+        {
+            spin_unlock(&log->lock); /* Release resource. */
+            spare = kmalloc(sizeof(struct log_segment), GFP_KERNEL_ACCOUNT);
+            if (!spare)
+            {
+                kmalloc_err("log_segment");
+                return -ENOMEM;
+            }
+            goto retry;
+        }
+        seg = spare;
+        spare = NULL;
+        seg->base = log->tail;
+        seg->count = 0;
+        list_add(&seg->list, &log->segments);
+    }
+
+    seg->msg[seg->count++] = msg;
+    seg->stamp = jiffies;
+    log->tail++;
+
+    spin_unlock(&log->lock); /* Release resource. */
+
+    /* Someone else started a segment meanwhile. */
+    kfree(spare);
+    return 0;
+}
+
+struct message *log_take(struct message_log *log, u64 *offset)
+{
+    struct message *msg;
+    struct log_segment *seg;
+
+    msg = NULL;
+    spin_lock(&log->lock); /* Acquire resource. */
+
+    /* Skip messages dropped before the reader retrieved them. */
+    if (*offset < log->head)
+    {
+        dbg("%llu messages dropped before being read\n", log->head - *offset);
+        *offset = log->head;
+    }
+
+    if (*offset < log->tail)
+    {
+        /* Readers mostly follow the newest messages, hence look
+           for the segment starting from the newest one. */
+        list_for_each_entry(seg, &log->segments, list)
+        {
+            if (seg->base <= *offset)
+            {
+                break;
+            }
+        }
+        msg = seg->msg[*offset - seg->base];
+        (*offset)++;
+
+        /* Copying happens outside the lock, meanwhile the
+           segment may be dropped. */
+        message_get(msg);
+    }
+
+    spin_unlock(&log->lock); /* Release resource. */
+    return msg;
+}
+
+loff_t log_seek(struct message_log *log, u64 *offset, loff_t pos, int whence)
+{
+    spin_lock(&log->lock); /* Acquire resource. */
+
+    switch (whence)
+    {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += *offset;
+        break;
+    case SEEK_END:
+        pos += log->tail;
+        break;
+    default:
+        pos = -EINVAL;
+        goto unlock;
+    }
+
+    if (pos < 0 || pos > log->tail)
+    {
+        pos = -EINVAL;
+        goto unlock;
+    }
+    *offset = pos;
+
+unlock:
+    spin_unlock(&log->lock); /* Release resource. */
+    return pos;
+}
+
+int log_evict(struct message_log *log, size_t *released)
+{
+    int ret;
+
+    ret = 0;
+    spin_lock(&log->lock); /* Acquire resource. */
+    if (!list_empty(&log->segments))
+    {
+        _log_drop(log, released);
+        ret = 1;
+    }
+    spin_unlock(&log->lock); /* Release resource. */
+
+    return ret;
+}
+
+void log_expire(struct message_log *log, unsigned long age, size_t *released)
+{
+    struct log_segment *seg;
+
+    if (!age)
+    {
+        return;
+    }
+
+    spin_lock(&log->lock); /* Acquire resource. */
+    while (!list_empty(&log->segments))
+    {
+        seg = list_last_entry(&log->segments, struct log_segment, list);
+        if (!time_after(jiffies, seg->stamp + age))
+        {
+            break;
+        }
+        _log_drop(log, released);
+    }
+    spin_unlock(&log->lock); /* Release resource. */
+}
+
+int log_empty(struct message_log *log, u64 *offset)
+{
+    u64 pos;
+
+    pos = READ_ONCE(log->head);
+    if (offset)
+    {
+        pos = max(pos, READ_ONCE(*offset));
+    }
+
+    return pos == READ_ONCE(log->tail);
+}
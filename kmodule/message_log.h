@@ -0,0 +1,172 @@
+#pragma once
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+struct message;
+
+/**
+ * Number of messages held by each segment of a log.
+ */
+
+#define LOG_SEGMENT_MESSAGES 64
+
+/**
+ * struct log_segment - struct for a chunk of a log.
+ *
+ * @list: field required to include segments into the log
+ * @base: offset of the first message of the segment
+ * @count: number of messages appended to the segment
+ * @stamp: jiffies at which the newest message was appended
+ * @msg: the messages, the oldest one first
+ */
+struct log_segment
+{
+    struct list_head list;
+    u64 base;
+    unsigned int count;
+    unsigned long stamp;
+    struct message *msg[LOG_SEGMENT_MESSAGES];
+};
+
+/**
+ * struct message_log - append-only log of messages.
+ *
+ * @lock: spinlock protecting the log and the offsets of its
+ * readers
+ * @segments: list of segments, the oldest one last
+ * @head: offset of the oldest retained message
+ * @tail: offset of the next appended message
+ *
+ * Messages are not removed when read: each reader owns an
+ * offset, the position of the next message it retrieves, and
+ * may move it back to read messages again. Old messages are
+ * dropped a whole segment at a time, either to make room for
+ * new ones or once they are too old.
+ */
+struct message_log
+{
+    spinlock_t lock;
+    struct list_head segments;
+    u64 head;
+    u64 tail;
+};
+
+/**
+ * log_alloc() - allocates an empty log.
+ *
+ * Returns:
+ * NULL - allocation failed
+ * struct message_log* - the log
+ */
+struct message_log *log_alloc(void);
+
+/**
+ * log_free() - frees a log.
+ *
+ * @log: the log to be freed
+ *
+ * Frees all messages still retained by @log and the log
+ * itself.
+ *
+ * Returns:
+ * void
+ */
+void log_free(struct message_log *log);
+
+/**
+ * log_append() - stores a message.
+ *
+ * @log: the log
+ * @msg: the message to be stored
+ *
+ * Stores @msg as the newest message of @log, starting a new
+ * segment if the newest one is full.
+ *
+ * Returns:
+ * 0 - ok
+ * -ENOMEM - no segment could be allocated
+ */
+int log_append(struct message_log *log, struct message *msg);
+
+/**
+ * log_take() - retrieves a message for a reader.
+ *
+ * @log: the log
+ * @offset: the offset of the reader
+ *
+ * Retrieves the message at @offset and moves @offset past it.
+ * An offset older than the oldest retained message is moved
+ * forward first. The message stays into the log: it must not
+ * be modified and it must be given back by means of
+ * message_put() instead of message_free().
+ *
+ * Returns:
+ * NULL - no message at @offset yet
+ * struct message* - the message
+ */
+struct message *log_take(struct message_log *log, u64 *offset);
+
+/**
+ * log_seek() - moves the offset of a reader.
+ *
+ * @log: the log
+ * @offset: the offset of the reader
+ * @pos: the new offset, relative to @whence
+ * @whence: SEEK_SET, SEEK_CUR or SEEK_END
+ *
+ * Offsets count messages since the log was created. Seeking
+ * before the oldest retained message is allowed, reading then
+ * starts from the oldest one.
+ *
+ * Returns:
+ * loff_t - the new offset
+ * -EINVAL - the new offset is negative or past the newest
+ * message, or @whence is not supported
+ */
+loff_t log_seek(struct message_log *log, u64 *offset, loff_t pos, int whence);
+
+/**
+ * log_evict() - drops the oldest segment.
+ *
+ * @log: the log
+ * @released: incremented by the bytes of the dropped messages
+ *
+ * Returns:
+ * 1 - a segment has been dropped
+ * 0 - the log is empty
+ */
+int log_evict(struct message_log *log, size_t *released);
+
+/**
+ * log_expire() - drops old segments.
+ *
+ * @log: the log
+ * @age: jiffies a message is retained for, 0 to retain
+ * messages regardless of their age
+ * @released: incremented by the bytes of the dropped messages
+ *
+ * Drops every segment whose newest message was appended more
+ * than @age jiffies ago.
+ *
+ * Returns:
+ * void
+ */
+void log_expire(struct message_log *log, unsigned long age, size_t *released);
+
+/**
+ * log_empty() - checks whether a reader reached the end of
+ * the log.
+ *
+ * @log: the log
+ * @offset: the offset of the reader, NULL to check whether
+ * the log retains no message
+ *
+ * Lockless check, suitable as a wait condition.
+ *
+ * Returns:
+ * 1 - no message can be retrieved
+ * 0 - otherwise
+ */
+int log_empty(struct message_log *log, u64 *offset);
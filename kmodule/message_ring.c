@@ -0,0 +1,186 @@
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/preempt.h>
+#include <linux/processor.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "group_dev.h"
+#include "message_ring.h"
+#include "message_cache.h"
+
+struct message_ring *ring_alloc(unsigned int size)
+{
+    unsigned long i, slots;
+    struct message_ring *ring;
+
+    dbg_start();
+
+    /* At least one slot, rounded to a power of two such that
+       positions can be turned into indexes with a mask. */
+    slots = roundup_pow_of_two(size ? size : 1);
+
+    ring = kvzalloc(struct_size(ring, slots, slots), GFP_KERNEL);
+    if (!ring)
+    {
+        kzalloc_err("ring");
+        goto exit;
+    }
+
+    ring->mask = slots - 1;
+    atomic_set(&ring->count, 0);
+    atomic_long_set(&ring->enqueue_pos, 0);
+    atomic_long_set(&ring->dequeue_pos, 0);
+
+    /* Slot i is free for the writer claiming position i. */
+    for (i = 0; i < slots; i++)
+    {
+        atomic_long_set(&ring->slots[i].seq, i);
+    }
+    dbg("ring with %lu slots allocated\n", slots);
+
+exit:
+    dbg_end();
+    return ring;
+}
+
+void ring_free(struct message_ring *ring)
+{
+    struct message *msg;
+
+    dbg_start();
+
+    if (!ring)
+    {
+        ref_err("ring");
+        goto exit;
+    }
+
+    /* Free messages if any. */
+    while ((msg = ring_dequeue(ring)))
+    {
+        message_print(msg);
+        message_free(msg);
+    }
+
+    if (atomic_read(&ring->count))
+    {
+        warn("ring not emptied\n");
+    }
+
+    kvfree(ring);
+
+exit:
+    dbg_end();
+    return;
+}
+
+int ring_reserve(struct message_ring *ring)
+{
+    /* Increment count unless every slot is already taken. */
+    return atomic_add_unless(&ring->count, 1, ring->mask + 1);
+}
+
+void ring_unreserve(struct message_ring *ring)
+{
+    atomic_dec(&ring->count);
+}
+
+void ring_enqueue(struct message_ring *ring, struct message *msg)
+{
+    long pos, diff;
+    struct ring_slot *slot;
+
+    /* Keep the window between claiming a position and
+       publishing its slot as short as possible. */
+    preempt_disable();
+
+    pos = atomic_long_read(&ring->enqueue_pos);
+    for (;;)
+    {
+        slot = &ring->slots[pos & ring->mask];
+        diff = atomic_long_read_acquire(&slot->seq) - pos;
+
+        if (!diff)
+        {
+            /* Slot is free, try to claim the position. */
+            if (atomic_long_cmpxchg_relaxed(&ring->enqueue_pos, pos, pos + 1) == pos)
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            /* A reader claimed the slot of the previous lap but
+               has not released it yet. The reservation grants
+               the slot will be released shortly. */
+            cpu_relax();
+        }
+
+        pos = atomic_long_read(&ring->enqueue_pos);
+    }
+
+    slot->msg = msg;
+    /* Publish the slot to readers. */
+    atomic_long_set_release(&slot->seq, pos + 1);
+
+    preempt_enable();
+    return;
+}
+
+struct message *ring_dequeue(struct message_ring *ring)
+{
+    long pos, diff;
+    struct message *msg;
+    struct ring_slot *slot;
+
+    preempt_disable();
+
+    pos = atomic_long_read(&ring->dequeue_pos);
+    for (;;)
+    {
+        slot = &ring->slots[pos & ring->mask];
+        diff = atomic_long_read_acquire(&slot->seq) - (pos + 1);
+
+        if (!diff)
+        {
+            /* Slot is published, try to claim the position. */
+            if (atomic_long_cmpxchg_relaxed(&ring->dequeue_pos, pos, pos + 1) == pos)
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            /* Oldest slot not published yet: ring is empty. */
+            msg = NULL;
+            goto exit;
+        }
+
+        pos = atomic_long_read(&ring->dequeue_pos);
+    }
+
+    msg = slot->msg;
+    slot->msg = NULL;
+    /* Give the slot back to the writer of the next lap. */
+    atomic_long_set_release(&slot->seq, pos + ring->mask + 1);
+    ring_unreserve(ring);
+
+exit:
+    preempt_enable();
+    return msg;
+}
+
+int ring_empty(struct message_ring *ring)
+{
+    long pos;
+
+    pos = atomic_long_read(&ring->dequeue_pos);
+    return atomic_long_read_acquire(&ring->slots[pos & ring->mask].seq) != pos + 1;
+}
+
+int ring_full(struct message_ring *ring)
+{
+    return atomic_read(&ring->count) > ring->mask;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <linux/atomic.h>
+#include <linux/cache.h>
+
+struct message;
+
+/**
+ * struct ring_slot - struct for a single ring cell.
+ *
+ * @seq: sequence number telling whether the slot is free or
+ * holds a message for the current lap
+ * @msg: the message stored into the slot
+ *
+ * A slot at position pos is free for writers when @seq equals
+ * pos and it is ready for readers when @seq equals pos + 1.
+ */
+struct ring_slot
+{
+    atomic_long_t seq;
+    struct message *msg;
+};
+
+/**
+ * struct message_ring - bounded multi-producer multi-consumer
+ * ring of messages.
+ *
+ * @mask: number of slots minus one (slots are a power of two)
+ * @count: number of reserved slots, i.e. messages either
+ * stored into the ring or about to be stored
+ * @enqueue_pos: next position writers will claim
+ * @dequeue_pos: next position readers will claim
+ * @slots: the ring cells
+ *
+ * Writers and readers claim positions by means of a compare
+ * and swap over @enqueue_pos and @dequeue_pos, so that no
+ * sleeping lock is taken. The two positions live in separate
+ * cache lines to avoid false sharing between writers and
+ * readers.
+ */
+struct message_ring
+{
+    unsigned long mask;
+    atomic_t count;
+
+    atomic_long_t enqueue_pos ____cacheline_aligned_in_smp;
+    atomic_long_t dequeue_pos ____cacheline_aligned_in_smp;
+
+    struct ring_slot slots[] ____cacheline_aligned_in_smp;
+};
+
+/**
+ * ring_alloc() - allocates a message ring.
+ *
+ * @size: minimum number of messages the ring must host
+ *
+ * Allocates and initializes a ring whose number of slots is
+ * @size rounded up to the next power of two.
+ *
+ * Returns:
+ * NULL - allocation failed
+ * struct message_ring* - the ring
+ */
+struct message_ring *ring_alloc(unsigned int size);
+
+/**
+ * ring_free() - frees a message ring.
+ *
+ * @ring: the ring to be freed
+ *
+ * Frees all messages still stored into @ring and the ring
+ * itself.
+ *
+ * Returns:
+ * void
+ */
+void ring_free(struct message_ring *ring);
+
+/**
+ * ring_reserve() - reserves a slot.
+ *
+ * @ring: the ring
+ *
+ * Reserves room for a message. Every successful reservation
+ * must be followed either by ring_enqueue() or by
+ * ring_unreserve(). Reserving in advance allows delayed
+ * messages to account for storage as soon as they are
+ * written.
+ *
+ * Returns:
+ * 1 - slot reserved
+ * 0 - ring is full
+ */
+int ring_reserve(struct message_ring *ring);
+
+/**
+ * ring_unreserve() - gives back a reserved slot.
+ *
+ * @ring: the ring
+ *
+ * Returns:
+ * void
+ */
+void ring_unreserve(struct message_ring *ring);
+
+/**
+ * ring_enqueue() - stores a message.
+ *
+ * @ring: the ring
+ * @msg: the message to be stored
+ *
+ * Stores @msg as the newest message of @ring. A slot must have
+ * been previously reserved by means of ring_reserve().
+ *
+ * Returns:
+ * void
+ */
+void ring_enqueue(struct message_ring *ring, struct message *msg);
+
+/**
+ * ring_dequeue() - retrieves a message.
+ *
+ * @ring: the ring
+ *
+ * Removes the oldest message from @ring and releases its
+ * reservation.
+ *
+ * Returns:
+ * NULL - ring is empty
+ * struct message* - the oldest message
+ */
+struct message *ring_dequeue(struct message_ring *ring);
+
+/**
+ * ring_empty() - checks whether the ring has no messages.
+ *
+ * @ring: the ring
+ *
+ * Only published messages are considered: slots reserved by
+ * delayed messages do not make the ring non-empty.
+ *
+ * Returns:
+ * 1 - no message can be retrieved
+ * 0 - otherwise
+ */
+int ring_empty(struct message_ring *ring);
+
+/**
+ * ring_full() - checks whether every slot is reserved.
+ *
+ * @ring: the ring
+ *
+ * Lockless check, suitable as a wait condition for writers.
+ *
+ * Returns:
+ * 1 - no slot can be reserved
+ * 0 - otherwise
+ */
+int ring_full(struct message_ring *ring);
@@ -0,0 +1,167 @@
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/cpumask.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "group_dev.h"
+#include "message_shards.h"
+#include "message_cache.h"
+
+struct message_shards *shards_alloc(void)
+{
+    unsigned int i, count;
+    struct message_shards *shards;
+
+    dbg_start();
+
+    /* A shard per possible CPU, rounded to a power of two such
+       that thread identifiers can be turned into indexes with a
+       mask. */
+    count = roundup_pow_of_two(num_possible_cpus());
+
+    shards = kvzalloc(struct_size(shards, shard, count), GFP_KERNEL);
+    if (!shards)
+    {
+        kzalloc_err("shards");
+        goto exit;
+    }
+
+    shards->mask = count - 1;
+    atomic_set(&shards->cursor, 0);
+    for (i = 0; i < count; i++)
+    {
+        spin_lock_init(&shards->shard[i].lock);
+        INIT_LIST_HEAD(&shards->shard[i].list);
+    }
+    dbg("%u shards allocated\n", count);
+
+exit:
+    dbg_end();
+    return shards;
+}
+
+void shards_free(struct message_shards *shards)
+{
+    struct message *msg;
+
+    dbg_start();
+
+    if (!shards)
+    {
+        ref_err("shards");
+        goto exit;
+    }
+
+    /* Free messages if any. */
+    while ((msg = shards_dequeue(shards)))
+    {
+        message_print(msg);
+        message_free(msg);
+    }
+
+    kvfree(shards);
+
+exit:
+    dbg_end();
+    return;
+}
+
+void shards_enqueue(struct message_shards *shards, struct message *msg)
+{
+    struct message_shard *shard;
+
+    /* The shard of the sender, not of the caller: delayed
+       messages are published by a worker. */
+    shard = &shards->shard[msg->header.tid & shards->mask];
+
+    spin_lock(&shard->lock);            /* Acquire resource. */
+    list_add(&msg->list, &shard->list); /* Add message to the shard. */
+    spin_unlock(&shard->lock);          /* Release resource. */
+}
+
+struct message *shards_dequeue(struct message_shards *shards)
+{
+    unsigned int i, start;
+    struct message *msg;
+    struct message_shard *shard;
+
+    /* Move the cursor on, such that concurrent readers start
+       from different shards. */
+    start = atomic_inc_return(&shards->cursor);
+    for (i = 0; i <= shards->mask; i++)
+    {
+        shard = &shards->shard[(start + i) & shards->mask];
+
+        /* Lockless peek, checked again under the lock. */
+        if (list_empty(&shard->list))
+        {
+            continue;
+        }
+
+        spin_lock(&shard->lock); /* Acquire resource. */
+        if (list_empty(&shard->list))
+        {
+            spin_unlock(&shard->lock); /* Release resource. */
+            continue;
+        }
+
+        /* Retrieve message according to FIFO policy. */
+        msg = list_last_entry(&shard->list, struct message, list);
+        list_del(&msg->list);
+        spin_unlock(&shard->lock); /* Release resource. */
+        return msg;
+    }
+
+    return NULL;
+}
+
+unsigned int shards_expire(struct message_shards *shards, struct list_head *expired)
+{
+    unsigned int i, count;
+    struct message *msg;
+    struct message_shard *shard;
+
+    count = 0;
+    for (i = 0; i <= shards->mask; i++)
+    {
+        shard = &shards->shard[i];
+
+        /* Lockless peek, checked again under the lock. */
+        if (list_empty(&shard->list))
+        {
+            continue;
+        }
+
+        spin_lock(&shard->lock); /* Acquire resource. */
+        while (!list_empty(&shard->list))
+        {
+            msg = list_last_entry(&shard->list, struct message, list);
+            if (!message_expired(msg))
+            {
+                break;
+            }
+            list_move(&msg->list, expired);
+            count++;
+        }
+        spin_unlock(&shard->lock); /* Release resource. */
+    }
+
+    return count;
+}
+
+int shards_empty(struct message_shards *shards)
+{
+    unsigned int i;
+
+    for (i = 0; i <= shards->mask; i++)
+    {
+        if (!list_empty(&shards->shard[i].list))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+
+struct message;
+
+/**
+ * struct message_shard - struct for a single sub-queue.
+ *
+ * @lock: spinlock protecting @list
+ * @list: messages of the shard, the oldest one last
+ *
+ * Each shard lives in its own cache line, such that writers
+ * of different shards do not share anything.
+ */
+struct message_shard
+{
+    spinlock_t lock;
+    struct list_head list;
+} ____cacheline_aligned_in_smp;
+
+/**
+ * struct message_shards - set of sub-queues of messages.
+ *
+ * @mask: number of shards minus one (shards are a power of two)
+ * @cursor: shard the next reader starts looking from
+ * @shard: the sub-queues
+ *
+ * There are as many shards as possible CPUs. Each writer
+ * always stores into the same shard, chosen by the thread
+ * identifier recorded in its messages when written, hence
+ * messages are FIFO per writer even if it migrates among CPUs
+ * or its messages are delayed, while writers running on
+ * different CPUs seldom contend. Readers drain shards round-robin, so
+ * no global order is kept among different writers.
+ */
+struct message_shards
+{
+    unsigned int mask;
+    atomic_t cursor ____cacheline_aligned_in_smp;
+
+    struct message_shard shard[];
+};
+
+/**
+ * shards_alloc() - allocates a set of sub-queues.
+ *
+ * Returns:
+ * NULL - allocation failed
+ * struct message_shards* - the sub-queues
+ */
+struct message_shards *shards_alloc(void);
+
+/**
+ * shards_free() - frees a set of sub-queues.
+ *
+ * @shards: the sub-queues to be freed
+ *
+ * Frees all messages still stored into @shards and the
+ * sub-queues themselves.
+ *
+ * Returns:
+ * void
+ */
+void shards_free(struct message_shards *shards);
+
+/**
+ * shards_enqueue() - stores a message.
+ *
+ * @shards: the sub-queues
+ * @msg: the message to be stored
+ *
+ * Stores @msg as the newest message of the shard of the
+ * thread which wrote it, not of the calling one.
+ *
+ * Returns:
+ * void
+ */
+void shards_enqueue(struct message_shards *shards, struct message *msg);
+
+/**
+ * shards_dequeue() - retrieves a message.
+ *
+ * @shards: the sub-queues
+ *
+ * Removes the oldest message of the first non-empty shard,
+ * starting from the one after the shard of the previous
+ * reader.
+ *
+ * Returns:
+ * NULL - every shard is empty
+ * struct message* - the oldest message of a shard
+ */
+struct message *shards_dequeue(struct message_shards *shards);
+
+/**
+ * shards_expire() - removes expired messages.
+ *
+ * @shards: the sub-queues
+ * @expired: list the expired messages are moved to
+ *
+ * Removes the oldest messages of each shard as long as they
+ * expired, see message_expired().
+ *
+ * Returns:
+ * unsigned int - the number of removed messages
+ */
+unsigned int shards_expire(struct message_shards *shards, struct list_head *expired);
+
+/**
+ * shards_empty() - checks whether no shard has messages.
+ *
+ * @shards: the sub-queues
+ *
+ * Lockless check, suitable as a wait condition.
+ *
+ * Returns:
+ * 1 - no message can be retrieved
+ * 0 - otherwise
+ */
+int shards_empty(struct message_shards *shards);
@@ -0,0 +1,324 @@
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "group_dev.h"
+#include "message_spill.h"
+#include "message_cache.h"
+
+struct message_spill *spill_alloc(void)
+{
+    struct message_spill *spill;
+
+    dbg_start();
+
+    spill = kzalloc(sizeof(struct message_spill), GFP_KERNEL);
+    if (!spill)
+    {
+        kzalloc_err("spill");
+        goto exit;
+    }
+    dbg("spill allocated\n");
+
+exit:
+    dbg_end();
+    return spill;
+}
+
+void spill_free(struct message_spill *spill)
+{
+    dbg_start();
+
+    if (!spill)
+    {
+        ref_err("spill");
+        goto exit;
+    }
+
+    if (spill->count)
+    {
+        dbg("%lu spilled messages freed\n", spill->count);
+    }
+
+    /* The backing file has no name, closing it removes it. */
+    if (spill->file)
+    {
+        filp_close(spill->file, NULL);
+    }
+    kvfree(spill->wbuf);
+    kvfree(spill->rbuf);
+    kfree(spill);
+
+exit:
+    dbg_end();
+    return;
+}
+
+/* Creates the backing file and the buffers. */
+static int _spill_open(struct message_spill *spill)
+{
+    int ret;
+    struct file *file;
+
+    ret = -ENOMEM;
+    spill->wbuf = kvmalloc(SPILL_CHUNK_SIZE, GFP_KERNEL_ACCOUNT);
+    spill->rbuf = kvmalloc(SPILL_CHUNK_SIZE, GFP_KERNEL_ACCOUNT);
+    if (!spill->wbuf || !spill->rbuf)
+    {
+        kmalloc_err("spill buffers");
+        goto fail;
+    }
+
+    file = filp_open(spill_dir, O_TMPFILE | O_RDWR | O_LARGEFILE, 0600);
+    if (IS_ERR(file))
+    {
+        ret = PTR_ERR(file);
+        err("filp_open %s: %d\n", spill_dir, ret);
+        goto fail;
+    }
+    spill->file = file;
+    dbg("backing file created into %s\n", spill_dir);
+
+    return 0;
+
+fail:
+    kvfree(spill->wbuf);
+    kvfree(spill->rbuf);
+    spill->wbuf = NULL;
+    spill->rbuf = NULL;
+    return ret;
+}
+
+/* Drops every spilled message, once the backing file could not
+   be read. */
+static void _spill_reset(struct message_spill *spill)
+{
+    err("%lu spilled messages lost\n", spill->count);
+
+    spill->head = 0;
+    spill->tail = 0;
+    spill->wlen = 0;
+    spill->rpos = 0;
+    spill->rlen = 0;
+    spill->has_next = 0;
+    WRITE_ONCE(spill->count, 0);
+}
+
+/* Writes the write buffer to the backing file. Bytes not
+   written are kept at the beginning of the buffer. */
+static int _spill_flush(struct message_spill *spill)
+{
+    size_t done;
+    ssize_t ret;
+
+    for (done = 0; done < spill->wlen; done += ret)
+    {
+        ret = kernel_write(spill->file, spill->wbuf + done, spill->wlen - done, &spill->tail);
+        if (ret <= 0)
+        {
+            err("kernel_write %ld bytes: %ld\n", spill->wlen - done, ret);
+            memmove(spill->wbuf, spill->wbuf + done, spill->wlen - done);
+            spill->wlen -= done;
+            return ret ? ret : -EIO;
+        }
+    }
+    spill->wlen = 0;
+
+    return 0;
+}
+
+/* Makes the oldest bytes not consumed yet available into the
+   read buffer. */
+static int _spill_fill(struct message_spill *spill)
+{
+    char *buf;
+    ssize_t ret;
+
+    if (spill->rpos < spill->rlen)
+    {
+        return 0;
+    }
+
+    /* Every record written to the file was read back: start
+       the file over and take buffered records as they are. */
+    if (spill->head == spill->tail)
+    {
+        spill->head = 0;
+        spill->tail = 0;
+
+        buf = spill->rbuf;
+        spill->rbuf = spill->wbuf;
+        spill->wbuf = buf;
+        spill->rlen = spill->wlen;
+        spill->rpos = 0;
+        spill->wlen = 0;
+
+        return spill->rlen ? 0 : -EIO;
+    }
+
+    ret = kernel_read(spill->file, spill->rbuf, min_t(loff_t, spill->tail - spill->head, SPILL_CHUNK_SIZE), &spill->head);
+    if (ret <= 0)
+    {
+        err("kernel_read: %ld\n", ret);
+        return ret ? ret : -EIO;
+    }
+    spill->rlen = ret;
+    spill->rpos = 0;
+
+    return 0;
+}
+
+/* Consumes bytes of the oldest record, copying them either into
+   a kernel buffer or into the payload of a message. */
+static int _spill_read(struct message_spill *spill, char *buf, struct message *msg, size_t length)
+{
+    int ret;
+    size_t done, chunk;
+
+    for (done = 0; done < length; done += chunk)
+    {
+        ret = _spill_fill(spill);
+        if (ret)
+        {
+            return ret;
+        }
+
+        chunk = min(length - done, spill->rlen - spill->rpos);
+        if (msg)
+        {
+            message_write(msg, done, spill->rbuf + spill->rpos, chunk);
+        }
+        else
+        {
+            memcpy(buf + done, spill->rbuf + spill->rpos, chunk);
+        }
+        spill->rpos += chunk;
+    }
+
+    return 0;
+}
+
+int spill_push(struct message_spill *spill, struct message *msg)
+{
+    int ret;
+    loff_t start;
+    size_t done, chunk;
+    struct spill_record rec = {
+        .length = msg->data_size,
+        .priority = msg->priority,
+        .tag = msg->tag,
+        .ttl = msg->ttl,
+        .expires = msg->expires,
+        .seq = msg->seq,
+        .header = msg->header,
+    };
+
+    if (!spill->file)
+    {
+        ret = _spill_open(spill);
+        if (ret)
+        {
+            return ret;
+        }
+    }
+
+    /* A record fitting into a chunk is never split by a failed
+       flush. */
+    if (spill->wlen + sizeof(rec) + msg->data_size > SPILL_CHUNK_SIZE)
+    {
+        ret = _spill_flush(spill);
+        if (ret)
+        {
+            return ret;
+        }
+    }
+
+    /* Larger ones start at the beginning of the buffer and are
+       flushed while being copied, hence a failure can forget
+       about them. */
+    start = spill->tail;
+    memcpy(spill->wbuf + spill->wlen, &rec, sizeof(rec));
+    spill->wlen += sizeof(rec);
+    for (done = 0; done < msg->data_size; done += chunk)
+    {
+        if (spill->wlen == SPILL_CHUNK_SIZE)
+        {
+            ret = _spill_flush(spill);
+            if (ret)
+            {
+                spill->tail = start;
+                spill->wlen = 0;
+                return ret;
+            }
+        }
+
+        chunk = min(msg->data_size - done, SPILL_CHUNK_SIZE - spill->wlen);
+        message_read(msg, done, spill->wbuf + spill->wlen, chunk);
+        spill->wlen += chunk;
+    }
+
+    WRITE_ONCE(spill->count, spill->count + 1);
+    return 0;
+}
+
+ssize_t spill_next(struct message_spill *spill)
+{
+    int ret;
+
+    if (!spill->count)
+    {
+        return -ENODATA;
+    }
+
+    if (!spill->has_next)
+    {
+        ret = _spill_read(spill, (char *)&spill->next, NULL, sizeof(spill->next));
+        if (ret)
+        {
+            _spill_reset(spill);
+            return ret;
+        }
+        spill->has_next = 1;
+    }
+
+    return spill->next.length;
+}
+
+struct message *spill_pop(struct message_spill *spill)
+{
+    struct message *msg;
+
+    /* The record stays in place, a later attempt may succeed. */
+    msg = message_alloc(spill->next.length);
+    if (!msg)
+    {
+        err("message_alloc %u bytes\n", spill->next.length);
+        return NULL;
+    }
+
+    if (_spill_read(spill, NULL, msg, spill->next.length))
+    {
+        message_free(msg);
+        _spill_reset(spill);
+        return NULL;
+    }
+
+    msg->priority = spill->next.priority;
+    msg->tag = spill->next.tag;
+    msg->ttl = spill->next.ttl;
+    msg->expires = spill->next.expires;
+    msg->seq = spill->next.seq;
+    msg->header = spill->next.header;
+
+    spill->has_next = 0;
+    WRITE_ONCE(spill->count, spill->count - 1);
+    return msg;
+}
+
+int spill_empty(struct message_spill *spill)
+{
+    return !READ_ONCE(spill->count);
+}
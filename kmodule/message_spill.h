@@ -0,0 +1,155 @@
+#pragma once
+
+#include <linux/fs.h>
+#include <linux/types.h>
+
+#include "ioctl.h"
+
+struct message;
+
+/**
+ * Bytes written to or read from a backing file at once.
+ */
+
+#define SPILL_CHUNK_SIZE (64 * 1024)
+
+/**
+ * struct spill_record - header of a spilled message.
+ *
+ * @length: bytes of the payload following the header
+ * @priority: the priority level of the message
+ * @tag: the tag the message is labelled with
+ * @ttl: jiffies the message lives for, 0 for no limit
+ * @expires: jiffies at which the message expires
+ * @seq: order of publication among the messages of the group
+ * device
+ * @header: metadata for files reading headers
+ */
+struct spill_record
+{
+    u32 length;
+    u8 priority;
+    u8 tag;
+    unsigned long ttl;
+    unsigned long expires;
+    u64 seq;
+    struct group_header header;
+};
+
+/**
+ * struct message_spill - FIFO of messages kept in a file.
+ *
+ * @file: unnamed backing file, created at the first spill
+ * @head: offset of the oldest record not read back yet
+ * @tail: offset the write buffer is flushed at
+ * @wbuf: records not written to @file yet
+ * @wlen: bytes of @wbuf
+ * @rbuf: records read back from @file
+ * @rpos: offset of the oldest record not consumed from @rbuf
+ * @rlen: bytes of @rbuf
+ * @next: header of the oldest record, if @has_next
+ * @has_next: whether @next was read already
+ * @count: number of spilled messages
+ *
+ * Messages are appended to @wbuf and read back from @rbuf,
+ * which are exchanged with the file a chunk at a time. Once
+ * every record written to the file has been read back, the
+ * file is reused from its beginning and records still in
+ * @wbuf are moved to @rbuf without reaching the file at all.
+ * The caller serializes all operations but spill_empty().
+ */
+struct message_spill
+{
+    struct file *file;
+    loff_t head;
+    loff_t tail;
+    char *wbuf;
+    size_t wlen;
+    char *rbuf;
+    size_t rpos;
+    size_t rlen;
+    struct spill_record next;
+    int has_next;
+    unsigned long count;
+};
+
+/**
+ * spill_alloc() - allocates an empty spill.
+ *
+ * Returns:
+ * NULL - allocation failed
+ * struct message_spill* - the spill
+ */
+struct message_spill *spill_alloc(void);
+
+/**
+ * spill_free() - frees a spill.
+ *
+ * @spill: the spill to be freed
+ *
+ * Spilled messages are lost together with the backing file.
+ *
+ * Returns:
+ * void
+ */
+void spill_free(struct message_spill *spill);
+
+/**
+ * spill_push() - appends a message.
+ *
+ * @spill: the spill
+ * @msg: the message, published already
+ *
+ * Copies @msg as the newest record of @spill, creating the
+ * backing file into spill_dir if needed. The caller keeps
+ * @msg and frees it on success.
+ *
+ * Returns:
+ * 0 - ok
+ * <0 - the backing file could not be created or written,
+ * nothing has been appended
+ */
+int spill_push(struct message_spill *spill, struct message *msg);
+
+/**
+ * spill_next() - peeks the oldest message.
+ *
+ * @spill: the spill
+ *
+ * Returns:
+ * ssize_t - bytes of the payload of the oldest message
+ * -ENODATA - no message is spilled
+ * <0 - the backing file could not be read, every spilled
+ * message is lost
+ */
+ssize_t spill_next(struct message_spill *spill);
+
+/**
+ * spill_pop() - retrieves the oldest message.
+ *
+ * @spill: the spill
+ *
+ * Reads the oldest record back into a new message, restoring
+ * its priority level, tag, time to live, order and header.
+ * spill_next() must have found a message before.
+ *
+ * Returns:
+ * NULL - allocation failed and the record is left in place,
+ * or the backing file could not be read and every spilled
+ * message is lost
+ * struct message* - the message
+ */
+struct message *spill_pop(struct message_spill *spill);
+
+/**
+ * spill_empty() - checks whether no message is spilled.
+ *
+ * @spill: the spill
+ *
+ * Lockless check, suitable as a wait condition.
+ *
+ * Returns:
+ * 1 - no message is spilled
+ * 0 - otherwise
+ */
+int spill_empty(struct message_spill *spill);
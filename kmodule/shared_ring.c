@@ -0,0 +1,387 @@
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/uaccess.h>
+#include <linux/sched.h>
+#include <linux/processor.h>
+
+#include "../common.h"
+#include "kern.h"
+#include "group_dev.h"
+#include "shared_ring.h"
+#include "message_cache.h"
+
+/* Returns the slot hosting position pos. */
+static struct shared_slot *_slot(struct shared_ring *ring, u64 pos)
+{
+    return (struct shared_slot *)((char *)ring->mem + ring->data_offset +
+                                  (pos & ring->mask) * ring->slot_size);
+}
+
+/* Adds delta to a counter of the header, unless the result is
+   negative or above limit. Returns 1 if the counter changed. */
+static int _counter_add(s32 *counter, s32 delta, s32 limit)
+{
+    s32 old, new, cur;
+
+    cur = READ_ONCE(*counter);
+    do
+    {
+        old = cur;
+        new = old + delta;
+        if (new < 0 || new > limit)
+        {
+            return 0;
+        }
+        cur = cmpxchg(counter, old, new);
+    } while (cur != old);
+
+    return 1;
+}
+
+/* Claims the next position to be written. Userspace takes part
+   in the protocol, hence give up instead of spinning forever. */
+static struct shared_slot *_claim_enqueue(struct shared_ring *ring, u64 *claimed)
+{
+    u64 pos;
+    s64 diff;
+    unsigned long spins;
+    struct shared_slot *slot;
+
+    pos = READ_ONCE(ring->header->enqueue_pos);
+    for (spins = 0; spins < SHARED_SPIN_MAX; spins++)
+    {
+        slot = _slot(ring, pos);
+        diff = (s64)(smp_load_acquire(&slot->seq) - pos);
+
+        if (!diff)
+        {
+            /* Slot is free, try to claim the position. */
+            if (cmpxchg(&ring->header->enqueue_pos, pos, pos + 1) == pos)
+            {
+                *claimed = pos;
+                return slot;
+            }
+        }
+        else if (diff < 0)
+        {
+            /* A reader of the previous lap, possibly a preempted
+               userspace one, still owns the slot. */
+            cond_resched();
+        }
+
+        pos = READ_ONCE(ring->header->enqueue_pos);
+    }
+
+    err("cannot claim a slot of shared region\n");
+    return NULL;
+}
+
+/* Claims the oldest published position. */
+static struct shared_slot *_claim_dequeue(struct shared_ring *ring, u64 *claimed)
+{
+    u64 pos;
+    s64 diff;
+    unsigned long spins;
+    struct shared_slot *slot;
+
+    pos = READ_ONCE(ring->header->dequeue_pos);
+    for (spins = 0; spins < SHARED_SPIN_MAX; spins++)
+    {
+        slot = _slot(ring, pos);
+        diff = (s64)(smp_load_acquire(&slot->seq) - (pos + 1));
+
+        if (!diff)
+        {
+            /* Slot is published, try to claim the position. */
+            if (cmpxchg(&ring->header->dequeue_pos, pos, pos + 1) == pos)
+            {
+                *claimed = pos;
+                return slot;
+            }
+        }
+        else if (diff < 0)
+        {
+            /* Oldest slot not published yet: region is empty. */
+            return NULL;
+        }
+
+        pos = READ_ONCE(ring->header->dequeue_pos);
+    }
+
+    err("cannot claim a slot of shared region\n");
+    return NULL;
+}
+
+/* Publishes a claimed slot to readers. */
+static void _publish(struct shared_slot *slot, u64 pos, u32 length)
+{
+    WRITE_ONCE(slot->length, length);
+    smp_store_release(&slot->seq, pos + 1);
+}
+
+/* Gives a claimed slot back to the writer of the next lap. */
+static void _release(struct shared_ring *ring, struct shared_slot *slot, u64 pos)
+{
+    smp_store_release(&slot->seq, pos + ring->mask + 1);
+    shared_ring_unreserve(ring);
+}
+
+/* Reads the length of a claimed slot, not trusting userspace. */
+static u32 _length(struct shared_ring *ring, struct shared_slot *slot)
+{
+    return min_t(u32, READ_ONCE(slot->length), ring->capacity);
+}
+
+struct shared_ring *shared_ring_alloc(unsigned int size, unsigned int capacity)
+{
+    unsigned long i, slots;
+    struct shared_ring *ring;
+
+    dbg_start();
+
+    ring = kzalloc(sizeof(struct shared_ring), GFP_KERNEL);
+    if (!ring)
+    {
+        kzalloc_err("ring");
+        goto exit;
+    }
+
+    slots = roundup_pow_of_two(size ? size : 1);
+    ring->mask = slots - 1;
+    ring->slot_size = ALIGN(sizeof(struct shared_slot) + capacity, SHARED_CACHELINE);
+    ring->capacity = ring->slot_size - sizeof(struct shared_slot);
+    ring->data_offset = ALIGN(sizeof(struct shared_header), SHARED_CACHELINE);
+    ring->size = PAGE_ALIGN(ring->data_offset + slots * ring->slot_size);
+
+    /* Zeroed and suitable for remap_vmalloc_range(). */
+    ring->mem = vmalloc_user(ring->size);
+    if (!ring->mem)
+    {
+        err("vmalloc_user\n");
+        goto mem_fail;
+    }
+
+    ring->header = ring->mem;
+    ring->header->slot_count = slots;
+    ring->header->slot_size = ring->slot_size;
+    ring->header->data_offset = ring->data_offset;
+    ring->header->region_size = ring->size;
+
+    /* Slot i is free for the writer claiming position i. */
+    for (i = 0; i < slots; i++)
+    {
+        _slot(ring, i)->seq = i;
+    }
+    dbg("shared region with %lu slots of %u bytes allocated\n", slots, ring->slot_size);
+    goto exit;
+
+mem_fail:
+    kfree(ring);
+    ring = NULL;
+exit:
+    dbg_end();
+    return ring;
+}
+
+void shared_ring_free(struct shared_ring *ring)
+{
+    dbg_start();
+
+    if (!ring)
+    {
+        ref_err("ring");
+        goto exit;
+    }
+
+    vfree(ring->mem);
+    kfree(ring);
+
+exit:
+    dbg_end();
+    return;
+}
+
+int shared_ring_mmap(struct shared_ring *ring, struct vm_area_struct *vma)
+{
+    /* The whole region, from its beginning. */
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start != ring->size)
+    {
+        err("mmap of %lu bytes at page %lu, region is %lu bytes\n",
+            vma->vm_end - vma->vm_start, vma->vm_pgoff, ring->size);
+        return -EINVAL;
+    }
+
+    return remap_vmalloc_range(vma, ring->mem, 0);
+}
+
+int shared_ring_reserve(struct shared_ring *ring)
+{
+    return _counter_add(&ring->header->count, 1, ring->mask + 1);
+}
+
+void shared_ring_unreserve(struct shared_ring *ring)
+{
+    _counter_add(&ring->header->count, -1, ring->mask + 1);
+}
+
+int shared_ring_enqueue(struct shared_ring *ring, struct message *msg)
+{
+    u64 pos;
+    size_t length;
+    struct shared_slot *slot;
+
+    slot = _claim_enqueue(ring, &pos);
+    if (!slot)
+    {
+        return -1;
+    }
+
+    length = min_t(size_t, msg->data_size, ring->capacity);
+    message_read(msg, 0, slot->data, length);
+    _publish(slot, pos, length);
+
+    return 0;
+}
+
+ssize_t shared_ring_write_user(struct shared_ring *ring, const char __user *buf, size_t length)
+{
+    u64 pos;
+    ssize_t ret;
+    struct shared_slot *slot;
+
+    if (!shared_ring_reserve(ring))
+    {
+        return 0;
+    }
+
+    slot = _claim_enqueue(ring, &pos);
+    if (!slot)
+    {
+        shared_ring_unreserve(ring);
+        return -EBUSY;
+    }
+
+    length = min_t(size_t, length, ring->capacity);
+    if (copy_from_user(slot->data, buf, length))
+    {
+        /* The position is taken: publish an empty slot, which
+           readers skip. */
+        err("copy_from_user\n");
+        _publish(slot, pos, 0);
+        return -EFAULT;
+    }
+
+    _publish(slot, pos, length);
+    ret = length;
+    return ret;
+}
+
+ssize_t shared_ring_read_user(struct shared_ring *ring, char __user *buf, size_t length)
+{
+    u64 pos;
+    ssize_t ret;
+    struct shared_slot *slot;
+
+    do
+    {
+        slot = _claim_dequeue(ring, &pos);
+        if (!slot)
+        {
+            return 0;
+        }
+
+        ret = _length(ring, slot);
+        if (!ret)
+        {
+            /* Skip empty slots. */
+            _release(ring, slot, pos);
+        }
+    } while (!ret);
+
+    length = min_t(size_t, length, ret);
+    ret = copy_to_user(buf, slot->data, length) ? -EFAULT : length;
+    _release(ring, slot, pos);
+
+    return ret;
+}
+
+struct message *shared_ring_dequeue(struct shared_ring *ring)
+{
+    u64 pos;
+    u32 length;
+    struct message *msg;
+    struct shared_slot *slot;
+
+    do
+    {
+        slot = _claim_dequeue(ring, &pos);
+        if (!slot)
+        {
+            return NULL;
+        }
+
+        length = _length(ring, slot);
+        if (!length)
+        {
+            /* Skip empty slots. */
+            _release(ring, slot, pos);
+        }
+    } while (!length);
+
+    msg = message_alloc(length);
+    if (msg)
+    {
+        message_write(msg, 0, slot->data, length);
+    }
+    _release(ring, slot, pos);
+
+    return msg;
+}
+
+int shared_ring_empty(struct shared_ring *ring)
+{
+    u64 pos;
+
+    pos = READ_ONCE(ring->header->dequeue_pos);
+    return smp_load_acquire(&_slot(ring, pos)->seq) != pos + 1;
+}
+
+int shared_ring_full(struct shared_ring *ring)
+{
+    /* Userspace may corrupt the counter, which only affects
+       wake ups of its own writers. */
+    return READ_ONCE(ring->header->count) > (s32)ring->mask;
+}
+
+void shared_ring_sleep_begin(struct shared_ring *ring)
+{
+    _counter_add((s32 *)&ring->header->sleepers, 1, S32_MAX);
+    /* Order the announcement before checking for messages, it
+       pairs with the fence writers issue after publishing. */
+    smp_mb();
+}
+
+void shared_ring_sleep_end(struct shared_ring *ring)
+{
+    _counter_add((s32 *)&ring->header->sleepers, -1, S32_MAX);
+}
+
+void shared_ring_writer_sleep_begin(struct shared_ring *ring)
+{
+    _counter_add((s32 *)&ring->header->writers, 1, S32_MAX);
+    /* Order the announcement before checking for free slots, it
+       pairs with the fence readers issue after freeing one. */
+    smp_mb();
+}
+
+void shared_ring_writer_sleep_end(struct shared_ring *ring)
+{
+    _counter_add((s32 *)&ring->header->writers, -1, S32_MAX);
+}
+
+void shared_ring_set_polled(struct shared_ring *ring)
+{
+    WRITE_ONCE(ring->header->polled, 1);
+    smp_mb();
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+
+#include "ioctl.h"
+
+struct message;
+
+/**
+ * Maximum number of attempts to claim a slot of the shared
+ * region, which is also modified by userspace.
+ */
+
+#define SHARED_SPIN_MAX (1 << 20)
+
+/**
+ * struct shared_ring - kernel side of a shared region.
+ *
+ * @mem: the region, mapped by userspace too
+ * @header: the header at the beginning of @mem
+ * @size: bytes of @mem
+ * @mask: number of slots minus one
+ * @slot_size: bytes of each slot
+ * @capacity: bytes of each slot available for data
+ * @data_offset: offset of the first slot within @mem
+ *
+ * The layout is described by struct shared_header. Since
+ * userspace may write anything into @header, the kernel only
+ * trusts its own copy of the geometry.
+ */
+struct shared_ring
+{
+    void *mem;
+    struct shared_header *header;
+    unsigned long size;
+    unsigned long mask;
+    unsigned int slot_size;
+    unsigned int capacity;
+    unsigned int data_offset;
+};
+
+/**
+ * shared_ring_alloc() - allocates a shared region.
+ *
+ * @size: minimum number of messages the region must host
+ * @capacity: minimum bytes of each message
+ *
+ * Allocates a zeroed region suitable for mmap() and
+ * initializes its header and slots. The number of slots is
+ * @size rounded up to the next power of two.
+ *
+ * Returns:
+ * NULL - allocation failed
+ * struct shared_ring* - the shared region
+ */
+struct shared_ring *shared_ring_alloc(unsigned int size, unsigned int capacity);
+
+/**
+ * shared_ring_free() - frees a shared region.
+ *
+ * @ring: the shared region
+ *
+ * Messages are stored inline, hence nothing else has to be
+ * freed. Userspace mappings keep the pages alive until they
+ * are unmapped.
+ *
+ * Returns:
+ * void
+ */
+void shared_ring_free(struct shared_ring *ring);
+
+/**
+ * shared_ring_mmap() - maps the region into userspace.
+ *
+ * @ring: the shared region
+ * @vma: the userspace area
+ *
+ * Returns:
+ * 0 - ok
+ * < 0 - error
+ */
+int shared_ring_mmap(struct shared_ring *ring, struct vm_area_struct *vma);
+
+/**
+ * shared_ring_reserve() - reserves a slot.
+ *
+ * @ring: the shared region
+ *
+ * As ring_reserve(), on the counter shared with userspace.
+ *
+ * Returns:
+ * 1 - slot reserved
+ * 0 - region is full
+ */
+int shared_ring_reserve(struct shared_ring *ring);
+
+/**
+ * shared_ring_unreserve() - gives back a reserved slot.
+ *
+ * @ring: the shared region
+ *
+ * Returns:
+ * void
+ */
+void shared_ring_unreserve(struct shared_ring *ring);
+
+/**
+ * shared_ring_enqueue() - stores a kernel message.
+ *
+ * @ring: the shared region
+ * @msg: the message
+ *
+ * Copies the payload of @msg into the next slot, truncating it
+ * to the slot capacity. A slot must have been reserved before.
+ *
+ * Returns:
+ * 0 - ok
+ * -1 - no slot could be claimed
+ */
+int shared_ring_enqueue(struct shared_ring *ring, struct message *msg);
+
+/**
+ * shared_ring_write_user() - stores a userspace buffer.
+ *
+ * @ring: the shared region
+ * @buf: the message
+ * @length: bytes of @buf
+ *
+ * Reserves and claims a slot, then copies @buf straight into
+ * it, without any intermediate buffer.
+ *
+ * Returns:
+ * 0 - region is full
+ * > 0 - number of written bytes
+ * < 0 - error
+ */
+ssize_t shared_ring_write_user(struct shared_ring *ring, const char __user *buf, size_t length);
+
+/**
+ * shared_ring_read_user() - retrieves a message into userspace.
+ *
+ * @ring: the shared region
+ * @buf: the userspace buffer
+ * @length: bytes of @buf
+ *
+ * Claims the oldest slot and copies it straight into @buf.
+ * The message is consumed even if @buf is too short.
+ *
+ * Returns:
+ * 0 - region is empty
+ * > 0 - number of read bytes
+ * < 0 - error
+ */
+ssize_t shared_ring_read_user(struct shared_ring *ring, char __user *buf, size_t length);
+
+/**
+ * shared_ring_dequeue() - retrieves a message into the kernel.
+ *
+ * @ring: the shared region
+ *
+ * Claims the oldest slot and copies it into a new message.
+ *
+ * Returns:
+ * NULL - region is empty
+ * struct message* - the message
+ */
+struct message *shared_ring_dequeue(struct shared_ring *ring);
+
+/**
+ * shared_ring_empty() - checks whether the region has no messages.
+ *
+ * @ring: the shared region
+ *
+ * Returns:
+ * 1 - no message can be retrieved
+ * 0 - otherwise
+ */
+int shared_ring_empty(struct shared_ring *ring);
+
+/**
+ * shared_ring_full() - checks whether every slot is reserved.
+ *
+ * @ring: the shared region
+ *
+ * Returns:
+ * 1 - no slot can be reserved
+ * 0 - otherwise
+ */
+int shared_ring_full(struct shared_ring *ring);
+
+/**
+ * shared_ring_sleep_begin() - announces a sleeping reader.
+ *
+ * @ring: the shared region
+ *
+ * Must be invoked before checking for messages and going to
+ * sleep, so that userspace writers know they have to issue
+ * IOCTL_SHARED_WAKE.
+ *
+ * Returns:
+ * void
+ */
+void shared_ring_sleep_begin(struct shared_ring *ring);
+
+/**
+ * shared_ring_sleep_end() - withdraws a sleeping reader.
+ *
+ * @ring: the shared region
+ *
+ * Returns:
+ * void
+ */
+void shared_ring_sleep_end(struct shared_ring *ring);
+
+/**
+ * shared_ring_writer_sleep_begin() - announces a sleeping writer.
+ *
+ * @ring: the shared region
+ *
+ * Must be invoked before checking for free slots and going to
+ * sleep, so that userspace readers know they have to issue
+ * IOCTL_SHARED_WAKE.
+ *
+ * Returns:
+ * void
+ */
+void shared_ring_writer_sleep_begin(struct shared_ring *ring);
+
+/**
+ * shared_ring_writer_sleep_end() - withdraws a sleeping writer.
+ *
+ * @ring: the shared region
+ *
+ * Returns:
+ * void
+ */
+void shared_ring_writer_sleep_end(struct shared_ring *ring);
+
+/**
+ * shared_ring_set_polled() - announces a poller.
+ *
+ * @ring: the shared region
+ *
+ * Pollers cannot tell when they stop waiting, hence from now
+ * on userspace writers and readers always issue
+ * IOCTL_SHARED_WAKE.
+ *
+ * Returns:
+ * void
+ */
+void shared_ring_set_polled(struct shared_ring *ring);
@@ -6,12 +6,15 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/slab.h>
+#include <linux/capability.h>
 
 #include "../common.h"
 #include "kern.h"
 #include "tsm.h"
 #include "ioctl.h"
 #include "group_dev_manager.h"
+#include "message_cache.h"
+#include "checkpoint.h"
 
 int major = TSM_MAJOR;
 int minor = 0;
@@ -29,9 +32,49 @@ EXPORT_SYMBOL(max_message_size);
 
 unsigned int max_storage_size = DEFAULT_MAX_STORAGE_SIZE;
 module_param(max_storage_size, uint, 0644);
-MODULE_PARM_DESC(max_storage_size, "The maximum size of the storage");
+MODULE_PARM_DESC(max_storage_size, "The maximum size of the storage of a group, in bytes");
 EXPORT_SYMBOL(max_storage_size);
 
+unsigned int max_global_storage_size = DEFAULT_MAX_GLOBAL_STORAGE_SIZE;
+module_param(max_global_storage_size, uint, 0644);
+MODULE_PARM_DESC(max_global_storage_size, "The maximum size of the storage of all groups, 0 for no limit");
+EXPORT_SYMBOL(max_global_storage_size);
+
+unsigned int group_idle_timeout = DEFAULT_GROUP_IDLE_TIMEOUT;
+module_param(group_idle_timeout, uint, 0444);
+MODULE_PARM_DESC(group_idle_timeout, "Milliseconds before an idle group device is reclaimed, 0 to never reclaim, set at load time only");
+EXPORT_SYMBOL(group_idle_timeout);
+
+unsigned int max_broadcast_lag = DEFAULT_MAX_BROADCAST_LAG;
+module_param(max_broadcast_lag, uint, 0644);
+MODULE_PARM_DESC(max_broadcast_lag, "The maximum number of messages a reader of a broadcast group may lag behind");
+EXPORT_SYMBOL(max_broadcast_lag);
+
+unsigned int log_retention = DEFAULT_LOG_RETENTION;
+module_param(log_retention, uint, 0644);
+MODULE_PARM_DESC(log_retention, "Milliseconds messages of a log group are retained for, 0 to retain them until storage is needed");
+EXPORT_SYMBOL(log_retention);
+
+unsigned int ttl_sweep_interval = DEFAULT_TTL_SWEEP_INTERVAL;
+module_param(ttl_sweep_interval, uint, 0644);
+MODULE_PARM_DESC(ttl_sweep_interval, "Milliseconds between two sweeps of expired messages of a group, 0 to never sweep");
+EXPORT_SYMBOL(ttl_sweep_interval);
+
+unsigned int shrink_policy = DEFAULT_SHRINK_POLICY;
+module_param(shrink_policy, uint, 0644);
+MODULE_PARM_DESC(shrink_policy, "Messages dropped under memory pressure: 0 none, 1 expired ones, 2 expired ones then the lowest priority ones");
+EXPORT_SYMBOL(shrink_policy);
+
+char *spill_dir = NULL;
+module_param(spill_dir, charp, 0444);
+MODULE_PARM_DESC(spill_dir, "Directory list groups spill messages of priority 0 and tag 0 to once their storage is exhausted, unset to never spill");
+EXPORT_SYMBOL(spill_dir);
+
+char *checkpoint_path = NULL;
+module_param(checkpoint_path, charp, 0444);
+MODULE_PARM_DESC(checkpoint_path, "File group devices are checkpointed into on removal and restored from on insertion, unset to never checkpoint");
+EXPORT_SYMBOL(checkpoint_path);
+
 /* Associate specialized file operations. */
 struct file_operations tsm_dev_fops = {
     .owner = THIS_MODULE,
@@ -64,6 +107,7 @@ static long tsm_dev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg
     /* IOCTL cases: */
     /* First case:  a thread wants to to install a group. */
     /* Second case: userspace library needs maximum message size value. */
+    /* Third case: an administrator checkpoints all group devices. */
     switch (cmd)
     {
     case IOCTL_INSTALL_GROUP:
@@ -89,6 +133,22 @@ static long tsm_dev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg
         }
         ret = 0;
         goto exit;
+    case IOCTL_CHECKPOINT:
+        info("IOCTL_CHECKPOINT\n");
+        /* The image is written with the privileges of the module. */
+        if (!capable(CAP_SYS_ADMIN))
+        {
+            ret = -EPERM;
+            goto exit;
+        }
+        if (!checkpoint_path)
+        {
+            err("checkpoint_path not set\n");
+            ret = -EINVAL;
+            goto exit;
+        }
+        ret = checkpoint_save(checkpoint_path);
+        goto exit;
     }
 
 exit:
@@ -104,8 +164,22 @@ static int __init tsm_init(void)
     info_start();
     info("max_message_size: %u\n", max_message_size);
     info("max_storage_size: %u\n", max_storage_size);
+    info("max_global_storage_size: %u\n", max_global_storage_size);
+    info("group_idle_timeout: %u\n", group_idle_timeout);
+    info("max_broadcast_lag: %u\n", max_broadcast_lag);
+    info("log_retention: %u\n", log_retention);
+    info("ttl_sweep_interval: %u\n", ttl_sweep_interval);
     info("DEBUG: %d\n", DEBUG);
 
+    /* Create slab caches for messages before any group device
+       may be installed. */
+    if (message_cache_init() < 0)
+    {
+        err("message_cache_init failed\n");
+        ret = -1;
+        goto exit;
+    }
+
     /* Try to allocate character device region according to a specified
        major. If no major is specified, dynamically allocate region. */
     if (major)
@@ -125,6 +199,17 @@ static int __init tsm_init(void)
     if (ret < 0)
     {
         err("major %d registration failed\n", major);
+        message_cache_destroy();
+        ret = -1;
+        goto exit;
+    }
+
+    /* Create the table of group devices. */
+    if (init_group_devs() < 0)
+    {
+        err("init_group_devs failed\n");
+        unregister_chrdev_region(dev, 1);
+        message_cache_destroy();
         ret = -1;
         goto exit;
     }
@@ -144,6 +229,13 @@ static int __init tsm_init(void)
     device_create(tsm_dev_class, NULL, MKDEV(major, minor), NULL, TSM_NAME);
 
     info("tsm registered with major %d and minor %d\n", major, minor);
+
+    /* Restore group devices checkpointed by a previous removal.
+       A broken image does not prevent loading. */
+    if (checkpoint_path)
+    {
+        checkpoint_restore(checkpoint_path);
+    }
     ret = 0;
 
 exit:
@@ -154,8 +246,15 @@ exit:
 static void __exit tsm_exit(void)
 {
     info_start();
+    /* No file is open, group devices are quiescent. */
+    if (checkpoint_path)
+    {
+        checkpoint_save(checkpoint_path);
+    }
     group_free_all(); /* Now free all group devices. */
     dbg("cleanup_groups\n");
+    message_cache_destroy(); /* No message is left around. */
+    dbg("message_cache_destroy\n");
     device_destroy(tsm_dev_class, MKDEV(major, minor)); /* Destroy tsm device. */
     dbg("device_destroy\n");
     class_destroy(tsm_dev_class); /* Destroy tsm class. */
@@ -6,7 +6,13 @@
 #define TSM_CLASS_NAME "tsm_class"
 
 #define DEFAULT_MAX_MESSAGE_SIZE 32
-#define DEFAULT_MAX_STORAGE_SIZE 64
+#define DEFAULT_MAX_STORAGE_SIZE 2048
+#define DEFAULT_MAX_GLOBAL_STORAGE_SIZE 0
+#define DEFAULT_GROUP_IDLE_TIMEOUT 0
+#define DEFAULT_MAX_BROADCAST_LAG 64
+#define DEFAULT_LOG_RETENTION 0
+#define DEFAULT_TTL_SWEEP_INTERVAL 1000
+#define DEFAULT_SHRINK_POLICY 1
 
 struct file_operations tsm_dev_fops;
 
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 5
+
+void child_fun(struct group_t *group_descriptor)
+{
+    int fd, i;
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    tid_start();
+
+    /* A file of its own, such that only writes block. */
+    fd = open_group(group_descriptor);
+    if (fd < 0)
+    {
+        tid_err("open_group fd");
+        goto exit;
+    }
+    set_blocking(fd, 1);
+
+    /* More bytes than a group device can store: the writer is
+       throttled until the reader frees storage. */
+    for (i = 0; i < E_MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "%d throttled message from %ld", i, gettid());
+        ret = send_message(fd, msg);
+        if (ret <= 0)
+        {
+            tid_err("write %d", i);
+            break;
+        }
+    }
+    tid_info("Written %d messages", i);
+
+    close_group(fd);
+exit:
+    tid_end();
+    return;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd, i, status;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+    pid_t pid;
+
+    tid_info("EXECUTING %s\n", argv[0]);
+
+    group_descriptor.desc = DESC;
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        tid_err("open_group fd");
+        goto exit;
+    }
+    tid_info("group_dev%d opened with fd %d", DESC, fd);
+
+    if ((pid = fork()) < 0)
+    {
+        tid_err("fork");
+        goto fd_fail;
+    }
+    else if (pid == 0)
+    {
+        child_fun(&group_descriptor);
+        exit(0);
+    }
+
+    /* Let the writer fill the group device and block. */
+    sleep(1);
+
+    set_blocking(fd, 1);
+    for (i = 0; i < E_MSG_TO_WRITE; i++)
+    {
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        if (ret <= 0)
+        {
+            tid_err("read %d", i);
+            break;
+        }
+        msg[ret] = 0;
+    }
+    tid_info("Read %d messages, last '%s'", i, msg);
+    tid_info("Child with PID %ld exited with status 0x%x.", (long)wait(&status), status);
+
+fd_fail:
+    close_group(fd);
+exit:
+    tid_end();
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+int main(int argc, char *argv[])
+{
+    unsigned char desc;
+    int fd, i, ret;
+    struct group_t group_descriptor = {};
+    char *txt, msgs[MSG_TO_READ][MESSAGE_SIZE] = {};
+    struct iovec iov[MSG_TO_READ];
+
+    start(argv[0]);
+
+    desc = 0;
+    group_descriptor.desc = desc;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", desc, fd);
+
+    txt = "%d from userspace in a batch";
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msgs[i], txt, i);
+        iov[i].iov_base = msgs[i];
+        iov[i].iov_len = strlen(msgs[i]);
+    }
+
+    info("Writing %d messages at once", MSG_TO_WRITE);
+    ret = send_messages(fd, iov, MSG_TO_WRITE);
+    if (ret < 0)
+    {
+        err("send_messages");
+        goto write_fail;
+    }
+    info("Written %d messages", ret);
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < MSG_TO_READ; i++)
+    {
+        iov[i].iov_base = msgs[i];
+        iov[i].iov_len = MESSAGE_SIZE - 1;
+    }
+
+    info("Reading up to %d messages at once", MSG_TO_READ);
+    ret = retrieve_messages(fd, iov, MSG_TO_READ);
+    if (ret < 0)
+    {
+        err("retrieve_messages");
+        goto write_fail;
+    }
+    info("Read %d messages", ret);
+
+    for (i = 0; i < ret; i++)
+    {
+        info("Read %ld bytes: '%s'", iov[i].iov_len, msgs[i]);
+    }
+
+write_fail:
+    close_group(fd);
+    info("group_dev%d closed with fd %d", desc, fd);
+fd_fail:
+    end();
+    return 0;
+}
@@ -0,0 +1,502 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DEFAULT_PRODUCERS 1
+#define DEFAULT_CONSUMERS 1
+#define DEFAULT_MESSAGES 100000
+#define DEFAULT_SIZE 32
+#define DEFAULT_GROUPS 1
+#define DEFAULT_DESC 1000
+
+/* Each message starts with its send time, in hexadecimal
+   nanoseconds. */
+#define STAMP_SIZE 16
+
+/* Consumers poll, instead of blocking, to notice when their
+   group device is done. */
+#define POLL_TIMEOUT 100
+
+/* send_message() peeks one byte past max_message_size. */
+#define PADDING 65536
+
+/* Results go to stdout, keep diagnostics out of the way. */
+#define bench_err(format, ...) fprintf(stderr, "ERR: " format "\n", ##__VA_ARGS__)
+
+#define OUTPUT_TEXT 0
+#define OUTPUT_CSV 1
+#define OUTPUT_JSON 2
+
+#define CSV_HEADER "mode,producers,consumers,workers,size,groups,delay_ms,messages,failed," \
+                   "seconds,msgs_per_sec,p50_ns,p99_ns,p999_ns,max_ns"
+
+/**
+ * struct bench_config - parameters of a benchmark run.
+ *
+ * @producers: number of producers
+ * @consumers: number of consumers
+ * @processes: whether workers are processes instead of threads
+ * @messages: number of messages sent by each producer
+ * @size: bytes of each message
+ * @groups: number of group devices, workers are spread over
+ * them round robin
+ * @desc: descriptor of the first group device
+ * @mode: storage mode of the group devices (GROUP_MODE_*)
+ * @delay: delay of the group devices, in msecs
+ * @output: format of the results (OUTPUT_*)
+ */
+struct bench_config
+{
+    int producers;
+    int consumers;
+    int processes;
+    long messages;
+    size_t size;
+    int groups;
+    unsigned int desc;
+    int mode;
+    long delay;
+    int output;
+};
+
+/**
+ * struct bench_state - state shared by all workers.
+ *
+ * @barrier: lets all workers start together
+ * @samples: number of collected latencies
+ * @failed: number of messages producers could not send
+ * @expected: messages each group device is going to receive
+ * @consumed: messages retrieved from each group device
+ * @latencies: send-to-receive latencies, in nanoseconds
+ *
+ * Lives in a shared mapping, such that workers may be either
+ * threads or processes.
+ */
+struct bench_state
+{
+    pthread_barrier_t barrier;
+    long samples;
+    long failed;
+    long *expected;
+    long *consumed;
+    unsigned long long *latencies;
+};
+
+static struct bench_config cfg;
+static struct bench_state *state;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *shared_alloc(size_t size)
+{
+    void *mem;
+
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+static int open_bench_group(int group)
+{
+    struct group_t group_descriptor = {};
+
+    group_descriptor.desc = cfg.desc + group;
+    group_descriptor.mode = cfg.mode;
+    return open_group(&group_descriptor);
+}
+
+static void *producer_fun(void *arg)
+{
+    int fd, group;
+    long i;
+    char *msg;
+
+    group = (long)arg % cfg.groups;
+    fd = open_bench_group(group);
+    msg = calloc(cfg.size + PADDING + 1, sizeof(char));
+    if (fd < 0 || !msg)
+    {
+        bench_err("producer setup");
+        __atomic_fetch_sub(&state->expected[group], cfg.messages, __ATOMIC_SEQ_CST);
+        pthread_barrier_wait(&state->barrier);
+        goto exit;
+    }
+
+    /* Throttle on full group devices instead of failing. */
+    set_blocking(fd, 1);
+    memset(msg, 'x', cfg.size);
+
+    pthread_barrier_wait(&state->barrier);
+
+    for (i = 0; i < cfg.messages; i++)
+    {
+        sprintf(msg, "%016llx", now_ns());
+        msg[STAMP_SIZE] = 'x'; /* Overwrite the terminator. */
+        if (send_message(fd, msg) <= 0)
+        {
+            break;
+        }
+    }
+
+    /* Consumers must not wait for messages never sent. */
+    if (i < cfg.messages)
+    {
+        bench_err("producer sent %ld of %ld messages", i, cfg.messages);
+        __atomic_fetch_add(&state->failed, cfg.messages - i, __ATOMIC_SEQ_CST);
+        __atomic_fetch_sub(&state->expected[group], cfg.messages - i, __ATOMIC_SEQ_CST);
+    }
+
+exit:
+    if (fd >= 0)
+    {
+        close_group(fd);
+    }
+    free(msg);
+    return NULL;
+}
+
+static void *consumer_fun(void *arg)
+{
+    int fd, group;
+    long idx;
+    char *buf;
+    ssize_t ret;
+    struct pollfd pfd;
+
+    group = (long)arg % cfg.groups;
+    fd = open_bench_group(group);
+    buf = calloc(cfg.size + 1, sizeof(char));
+    if (fd < 0 || !buf)
+    {
+        bench_err("consumer setup");
+        pthread_barrier_wait(&state->barrier);
+        goto exit;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    pthread_barrier_wait(&state->barrier);
+
+    while (__atomic_load_n(&state->consumed[group], __ATOMIC_SEQ_CST) <
+           __atomic_load_n(&state->expected[group], __ATOMIC_SEQ_CST))
+    {
+        ret = retrieve_message(fd, buf, cfg.size);
+        if (ret >= STAMP_SIZE)
+        {
+            buf[STAMP_SIZE] = 0;
+            idx = __atomic_fetch_add(&state->samples, 1, __ATOMIC_RELAXED);
+            state->latencies[idx] = now_ns() - strtoull(buf, NULL, 16);
+            __atomic_fetch_add(&state->consumed[group], 1, __ATOMIC_SEQ_CST);
+        }
+        else if (!ret)
+        {
+            poll(&pfd, 1, POLL_TIMEOUT);
+        }
+        else
+        {
+            bench_err("consumer read returned %ld", ret);
+            break;
+        }
+    }
+
+exit:
+    if (fd >= 0)
+    {
+        close_group(fd);
+    }
+    free(buf);
+    return NULL;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of n sorted samples. */
+static unsigned long long percentile(unsigned long long *sorted, long n, double p)
+{
+    long rank;
+
+    if (!n)
+    {
+        return 0;
+    }
+
+    rank = (long)(p * n);
+    if (rank < p * n)
+    {
+        rank++;
+    }
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void print_results(double seconds)
+{
+    long n;
+    double rate;
+    unsigned long long p50, p99, p999, max;
+    const char *workers;
+
+    n = state->samples;
+    qsort(state->latencies, n, sizeof(unsigned long long), compare_latencies);
+    p50 = percentile(state->latencies, n, 0.50);
+    p99 = percentile(state->latencies, n, 0.99);
+    p999 = percentile(state->latencies, n, 0.999);
+    max = n ? state->latencies[n - 1] : 0;
+    rate = seconds > 0 ? n / seconds : 0;
+    workers = cfg.processes ? "processes" : "threads";
+
+    switch (cfg.output)
+    {
+    case OUTPUT_CSV:
+        printf("%d,%d,%d,%s,%zu,%d,%ld,%ld,%ld,%.6f,%.0f,%llu,%llu,%llu,%llu\n",
+               cfg.mode, cfg.producers, cfg.consumers, workers, cfg.size, cfg.groups, cfg.delay,
+               n, state->failed, seconds, rate, p50, p99, p999, max);
+        break;
+    case OUTPUT_JSON:
+        printf("{\"mode\": %d, \"producers\": %d, \"consumers\": %d, \"workers\": \"%s\", "
+               "\"size\": %zu, \"groups\": %d, \"delay_ms\": %ld, \"messages\": %ld, "
+               "\"failed\": %ld, \"seconds\": %.6f, \"msgs_per_sec\": %.0f, "
+               "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}\n",
+               cfg.mode, cfg.producers, cfg.consumers, workers, cfg.size, cfg.groups, cfg.delay,
+               n, state->failed, seconds, rate, p50, p99, p999, max);
+        break;
+    default:
+        info("mode %d, %d producers, %d consumers (%s), %zu bytes, %d groups, %ld msecs delay",
+             cfg.mode, cfg.producers, cfg.consumers, workers, cfg.size, cfg.groups, cfg.delay);
+        info("%ld messages in %.3f s: %.0f msgs/s, %ld failed", n, seconds, rate, state->failed);
+        info("latency p50 %llu ns, p99 %llu ns, p999 %llu ns, max %llu ns", p50, p99, p999, max);
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-p producers] [-c consumers] [-P] [-n messages] [-s size]\n"
+            "          [-g groups] [-D desc] [-m mode] [-d delay] [-o text|csv|json] [-H]\n"
+            "  -P  workers are processes instead of threads\n"
+            "  -n  messages sent by each producer\n"
+            "  -s  bytes of each message, at least %d\n"
+            "  -d  delay of the group devices, in msecs\n"
+            "  -H  print the CSV header and exit\n",
+            name, STAMP_SIZE);
+}
+
+static int parse_args(int argc, char *argv[])
+{
+    int opt;
+
+    cfg.producers = DEFAULT_PRODUCERS;
+    cfg.consumers = DEFAULT_CONSUMERS;
+    cfg.messages = DEFAULT_MESSAGES;
+    cfg.size = DEFAULT_SIZE;
+    cfg.groups = DEFAULT_GROUPS;
+    cfg.desc = DEFAULT_DESC;
+    cfg.mode = GROUP_MODE_LIST;
+    cfg.output = OUTPUT_TEXT;
+
+    while ((opt = getopt(argc, argv, "p:c:Pn:s:g:D:m:d:o:H")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            cfg.producers = atoi(optarg);
+            break;
+        case 'c':
+            cfg.consumers = atoi(optarg);
+            break;
+        case 'P':
+            cfg.processes = 1;
+            break;
+        case 'n':
+            cfg.messages = atol(optarg);
+            break;
+        case 's':
+            cfg.size = (size_t)atol(optarg);
+            break;
+        case 'g':
+            cfg.groups = atoi(optarg);
+            break;
+        case 'D':
+            cfg.desc = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            cfg.mode = atoi(optarg);
+            break;
+        case 'd':
+            cfg.delay = atol(optarg);
+            break;
+        case 'o':
+            if (!strcmp(optarg, "csv"))
+            {
+                cfg.output = OUTPUT_CSV;
+            }
+            else if (!strcmp(optarg, "json"))
+            {
+                cfg.output = OUTPUT_JSON;
+            }
+            else if (strcmp(optarg, "text"))
+            {
+                return -1;
+            }
+            break;
+        case 'H':
+            printf(CSV_HEADER "\n");
+            exit(0);
+        default:
+            return -1;
+        }
+    }
+
+    /* Every group device needs at least a producer and a
+       consumer, otherwise the run never ends. */
+    if (cfg.groups <= 0 || cfg.producers < cfg.groups || cfg.consumers < cfg.groups ||
+        cfg.messages <= 0 || cfg.size < STAMP_SIZE || cfg.delay < 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int spawn(void *(*fun)(void *), long id, pid_t *pid, pthread_t *tid)
+{
+    if (!cfg.processes)
+    {
+        return pthread_create(tid, NULL, fun, (void *)id) ? -1 : 0;
+    }
+
+    *pid = fork();
+    if (*pid < 0)
+    {
+        return -1;
+    }
+    else if (*pid == 0)
+    {
+        fun((void *)id);
+        _exit(0);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, workers, *fds;
+    long total;
+    pid_t *pids;
+    pthread_t *tids;
+    pthread_barrierattr_t attr;
+    unsigned long long start, stop;
+
+    if (parse_args(argc, argv) < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    workers = cfg.producers + cfg.consumers;
+    total = cfg.producers * cfg.messages;
+
+    state = shared_alloc(sizeof(struct bench_state));
+    fds = calloc(cfg.groups, sizeof(int));
+    pids = calloc(workers, sizeof(pid_t));
+    tids = calloc(workers, sizeof(pthread_t));
+    if (!state || !fds || !pids || !tids)
+    {
+        bench_err("alloc");
+        return 1;
+    }
+    state->expected = shared_alloc(cfg.groups * sizeof(long));
+    state->consumed = shared_alloc(cfg.groups * sizeof(long));
+    state->latencies = shared_alloc(total * sizeof(unsigned long long));
+    if (!state->expected || !state->consumed || !state->latencies)
+    {
+        bench_err("shared_alloc");
+        return 1;
+    }
+
+    /* Install group devices outside of the measurement, and keep
+       them open such that they are not reclaimed meanwhile. */
+    for (i = 0; i < cfg.groups; i++)
+    {
+        fds[i] = open_bench_group(i);
+        if (fds[i] < 0)
+        {
+            bench_err("open_group desc %u", cfg.desc + i);
+            return 1;
+        }
+        if (cfg.delay && set_send_delay(fds[i], cfg.delay) < 0)
+        {
+            bench_err("set_send_delay desc %u", cfg.desc + i);
+            return 1;
+        }
+    }
+    for (i = 0; i < cfg.producers; i++)
+    {
+        state->expected[i % cfg.groups] += cfg.messages;
+    }
+
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&state->barrier, &attr, workers + 1);
+
+    for (i = 0; i < workers; i++)
+    {
+        if (spawn(i < cfg.consumers ? consumer_fun : producer_fun,
+                  i < cfg.consumers ? i : i - cfg.consumers, &pids[i], &tids[i]) < 0)
+        {
+            bench_err("spawn worker %d", i);
+            return 1;
+        }
+    }
+
+    pthread_barrier_wait(&state->barrier);
+    start = now_ns();
+
+    for (i = 0; i < workers; i++)
+    {
+        if (cfg.processes)
+        {
+            waitpid(pids[i], NULL, 0);
+        }
+        else
+        {
+            pthread_join(tids[i], NULL);
+        }
+    }
+    stop = now_ns();
+
+    print_results((stop - start) / 1e9);
+
+    for (i = 0; i < cfg.groups; i++)
+    {
+        close_group(fds[i]);
+    }
+    pthread_barrier_destroy(&state->barrier);
+    pthread_barrierattr_destroy(&attr);
+    free(tids);
+    free(pids);
+    free(fds);
+    return 0;
+}
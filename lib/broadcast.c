@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+#include "../kmodule/ioctl.h"
+
+#define DESC 11
+
+int main(int argc, char *argv[])
+{
+    int fd, other_fd, i;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    /* Use a group of its own, since the mode is only
+       honoured when the group device is installed. */
+    group_descriptor.desc = DESC;
+    group_descriptor.mode = GROUP_MODE_BROADCAST;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+
+    other_fd = open_group(&group_descriptor);
+    if (other_fd < 0)
+    {
+        err("open_group other_fd");
+        goto other_fail;
+    }
+    info("group_dev%d opened with fds %d and %d", DESC, fd, other_fd);
+
+    /* File descriptors only subscribe on their first read or
+       poll, or when asked to, such that writers never hold
+       messages back. */
+    if (subscribe(fd, GROUP_TAGS_ALL) < 0 || subscribe(other_fd, GROUP_TAGS_ALL) < 0)
+    {
+        err("subscribe");
+    }
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "broadcast message %d", i);
+        ret = send_message(fd, msg);
+        info("Written %ld bytes: '%s'", ret, msg);
+    }
+
+    /* Each file descriptor retrieves every message, then
+       nothing. */
+    for (i = 0; i < MSG_TO_READ; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(other_fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes through other_fd: '%s'", ret, msg);
+    }
+
+    for (i = 0; i < MSG_TO_READ; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes through fd: '%s'", ret, msg);
+    }
+
+    close_group(other_fd);
+other_fail:
+    close_group(fd);
+    info("group_dev%d closed", DESC);
+fd_fail:
+    end();
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 16
+
+#define DELAY 60000
+
+int main(int argc, char *argv[])
+{
+    int fd, i;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    /* Half of the messages are published, the others wait for
+       a long delay. */
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        set_send_delay(fd, i < MSG_TO_WRITE / 2 ? 0 : DELAY);
+        sprintf(msg, "checkpointed message %d", i);
+        ret = send_message(fd, msg);
+        info("Written %ld bytes: '%s'", ret, msg);
+    }
+
+    /* Needs the checkpoint_path module parameter. Both published
+       and pending messages survive reloading the module. */
+    info("checkpoint_groups returned %d", checkpoint_groups());
+
+    /* Checkpointing leaves messages in place. */
+    memset(msg, 0, MESSAGE_SIZE);
+    ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+    info("Read %ld bytes: '%s'", ret, msg);
+
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}
@@ -8,7 +8,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc;
     int fd1, fd2;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
 
     start(argv[0]);
 
@@ -9,7 +9,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc;
     int fd, i;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
     char *txt, msg[MESSAGE_SIZE] = {};
     ssize_t ret;
 
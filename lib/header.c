@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+#include "../kmodule/ioctl.h"
+
+#define DESC 17
+#define DELAY 100
+
+#define MSG_TO_CHECK (2 * MSG_TO_WRITE + 1)
+
+int main(int argc, char *argv[])
+{
+    int fd, i;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    char msgs[MSG_TO_WRITE][MESSAGE_SIZE] = {};
+    struct iovec iov[MSG_TO_WRITE];
+    unsigned long long last_seq;
+    struct
+    {
+        struct group_header header;
+        char data[MESSAGE_SIZE];
+    } rec;
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "message %d with header", i);
+        ret = send_message(fd, msg);
+        info("Written %ld bytes: '%s'", ret, msg);
+    }
+
+    /* A delayed message is numbered once published, after the
+       batch sent meanwhile. */
+    set_send_delay(fd, DELAY);
+    sprintf(msg, "delayed message with header");
+    ret = send_message(fd, msg);
+    info("Written %ld bytes: '%s'", ret, msg);
+    set_send_delay(fd, 0);
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msgs[i], "batched message %d with header", i);
+        iov[i].iov_base = msgs[i];
+        iov[i].iov_len = strlen(msgs[i]);
+    }
+    info("Written %d messages at once", send_messages(fd, iov, MSG_TO_WRITE));
+
+    /* Each message comes after its header, within the same
+       buffer. Wait for the delayed one. */
+    set_header(fd, 1);
+    set_blocking(fd, 1);
+    last_seq = 0;
+    for (i = 0; i < MSG_TO_CHECK; i++)
+    {
+        memset(&rec, 0, sizeof(rec));
+        ret = retrieve_message(fd, (char *)&rec, sizeof(rec) - 1);
+        if (ret < (ssize_t)sizeof(struct group_header))
+        {
+            err("Read %ld bytes", ret);
+            continue;
+        }
+        info("Read message %llu from %u/%u, %llu ns queued: '%s'",
+             rec.header.seq, rec.header.tgid, rec.header.tid,
+             rec.header.published - rec.header.enqueued, rec.data);
+
+        /* Every path publishing into a list numbers messages in
+           the order they are retrieved. */
+        if (!rec.header.seq || rec.header.seq <= last_seq || !rec.header.published)
+        {
+            err("message %llu not numbered after %llu", rec.header.seq, last_seq);
+        }
+        last_seq = rec.header.seq;
+    }
+
+    set_header(fd, 0);
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}
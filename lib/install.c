@@ -10,7 +10,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc;
     int fd;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
 
     start(argv[0]);
 
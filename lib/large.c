@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 14
+
+/* Larger than a page, such that the message is page backed
+   unless max_message_size truncates it. */
+#define LARGE_SIZE (1 << 20)
+
+int main(int argc, char *argv[])
+{
+    int fd;
+    size_t i;
+    char *msg, *buf;
+    struct iovec iov[2];
+    struct group_t group_descriptor = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    msg = malloc(LARGE_SIZE);
+    buf = malloc(LARGE_SIZE);
+    if (!msg || !buf)
+    {
+        err("malloc");
+        goto fd_fail;
+    }
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    for (i = 0; i < LARGE_SIZE; i++)
+    {
+        msg[i] = 'a' + i % 26;
+    }
+    ret = write(fd, msg, LARGE_SIZE);
+    info("Written %ld bytes", ret);
+
+    /* Scatter the message over two buffers, splitting it
+       across a page. */
+    memset(buf, 0, LARGE_SIZE);
+    iov[0].iov_base = buf;
+    iov[0].iov_len = 5000;
+    iov[1].iov_base = buf + 5000;
+    iov[1].iov_len = LARGE_SIZE - 5000;
+    ret = readv(fd, iov, 2);
+    info("Read %ld bytes, %s", ret, ret > 0 && !memcmp(msg, buf, ret) ? "matching" : "not matching");
+
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    free(buf);
+    free(msg);
+    end();
+    return 0;
+}
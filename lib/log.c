@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 12
+
+int main(int argc, char *argv[])
+{
+    int fd, i;
+    off_t offset;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    /* Use a group of its own, since the mode is only
+       honoured when the group device is installed. */
+    group_descriptor.desc = DESC;
+    group_descriptor.mode = GROUP_MODE_LOG;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "logged message %d", i);
+        ret = send_message(fd, msg);
+        info("Written %ld bytes: '%s'", ret, msg);
+    }
+
+    /* Read half of the log and remember where to resume. */
+    for (i = 0; i < MSG_TO_WRITE / 2; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes: '%s'", ret, msg);
+    }
+    offset = lseek(fd, 0, SEEK_CUR);
+    info("Offset %ld saved", offset);
+    close_group(fd);
+
+    /* A restarted consumer resumes from the saved offset, then
+       finds nothing. */
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    lseek(fd, offset, SEEK_SET);
+    for (i = MSG_TO_WRITE / 2; i < MSG_TO_READ; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes: '%s'", ret, msg);
+    }
+
+    /* Messages are retained, the first one can be read again. */
+    lseek(fd, 0, SEEK_SET);
+    memset(msg, 0, MESSAGE_SIZE);
+    ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+    info("Read %ld bytes after rewinding: '%s'", ret, msg);
+
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}
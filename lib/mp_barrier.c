@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 18
+#define ROUNDS 3
+
+void child_fun(int fd, int id)
+{
+    int round;
+
+    tid_start();
+    for (round = 0; round < ROUNDS; round++)
+    {
+        /* Children arrive at different times, the last one
+           releases everybody. */
+        usleep(id * 1000);
+        tid_info("Round %d: arrived, wait_barrier returned %d", round, wait_barrier(fd));
+    }
+    close_group(fd);
+    tid_end();
+    return;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd, i, round, status;
+    struct group_t group_descriptor = {};
+    pid_t pids[CHILDREN];
+
+    tid_info("EXECUTING %s\n", argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        tid_err("open_group fd");
+        goto fd_fail;
+    }
+    tid_info("group_dev%d opened with fd %d", DESC, fd);
+
+    /* Children and dad meet at every round, no one has to awake
+       the barrier. */
+    set_barrier_parties(fd, CHILDREN + 1);
+
+    for (i = 0; i < CHILDREN; i++)
+    {
+        if ((pids[i] = fork()) < 0)
+        {
+            tid_err("fork");
+            goto fd_fail;
+        }
+        else if (pids[i] == 0)
+        {
+            child_fun(fd, i);
+            exit(0);
+        }
+    }
+
+    for (round = 0; round < ROUNDS; round++)
+    {
+        tid_info("Round %d: dad arrived, wait_barrier returned %d", round, wait_barrier(fd));
+    }
+
+    tid_info("Dad is going to wait %d babies", CHILDREN);
+    i = 0;
+    status = 0;
+    while (i < CHILDREN)
+    {
+        tid_info("Child with PID %ld exited with status 0x%x.", (long)wait(&status), status);
+        i++;
+    }
+
+    set_barrier_parties(fd, 0);
+    close_group(fd);
+    tid_info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    tid_end();
+    return 0;
+}
@@ -12,7 +12,7 @@ void child_fun(int n)
     unsigned char desc;
     int i, ret, fd;
     char *txt, msg[MESSAGE_SIZE] = {};
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
 
     tid_info("My number is %d", n);
 
@@ -52,7 +52,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc;
     int fd, i, status, j;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
     pid_t pids[CHILDREN];
     size_t msg_size;
     char msg[MESSAGE_SIZE] = {};
@@ -38,7 +38,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc;
     int fd, i, status, n;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
     pid_t pids[CHILDREN];
     size_t msg_size;
     char msg[MESSAGE_SIZE] = {};
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 4
+
+pthread_barrier_t barrier;
+
+void *thread_fun(void *arg)
+{
+    int fd;
+    struct group_t group_descriptor = {};
+
+    tid_start();
+
+    group_descriptor.desc = DESC;
+
+    /* All threads race to install the same group device. */
+    pthread_barrier_wait(&barrier);
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        tid_err("open_group fd");
+        goto exit;
+    }
+    tid_info("group_dev%d opened with fd %d", DESC, fd);
+
+    close_group(fd);
+
+exit:
+    tid_end();
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+    pthread_t tids[THREADS];
+
+    tid_info("EXECUTING %s\n", argv[0]);
+
+    pthread_barrier_init(&barrier, NULL, THREADS);
+
+    for (i = 0; i < THREADS; i++)
+    {
+        pthread_create(&tids[i], NULL, thread_fun, NULL);
+    }
+
+    for (i = 0; i < THREADS; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+
+    pthread_barrier_destroy(&barrier);
+    tid_end();
+    return 0;
+}
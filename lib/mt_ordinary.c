@@ -100,7 +100,7 @@ exit:
 int main(int argc, char *argv[])
 {
     int desc, fd, i, ret;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
     pthread_t tids[THREADS];
     size_t msg_size;
     char msg[MESSAGE_SIZE] = {};
@@ -46,7 +46,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc;
     int fd, i, ret;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
     pthread_t tids[THREADS];
     size_t msg_size;
     char msg[MESSAGE_SIZE] = {};
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 8
+
+void *thread_fun(void *arg)
+{
+    int *fd;
+    char msg[MESSAGE_SIZE] = {};
+    int i;
+    ssize_t ret;
+
+    tid_start();
+    fd = (int *)arg;
+    if (!fd || *fd < 0)
+    {
+        tid_err("fd");
+        goto fail;
+    }
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "%d %ld", i, gettid());
+        ret = send_message(*fd, msg);
+        if (ret < 0)
+        {
+            tid_err("write %d", i);
+            goto fail;
+        }
+        tid_info("Written '%s'", msg);
+    }
+
+fail:
+    tid_end();
+    pthread_exit(NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    int fd, i, j, ret, seq;
+    long tid;
+    long tids_seen[THREADS] = {};
+    int next[THREADS] = {};
+    struct group_t group_descriptor = {};
+    pthread_t tids[THREADS];
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t bytes;
+
+    tid_info("EXECUTING %s\n", argv[0]);
+
+    /* Use a group of its own, since the mode is only
+       honoured when the group device is installed. */
+    group_descriptor.desc = DESC;
+    group_descriptor.mode = GROUP_MODE_SHARDED;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        tid_err("open_group fd");
+        goto fd_fail;
+    }
+    tid_info("group_dev%d opened with fd %d", DESC, fd);
+
+    for (i = 0; i < THREADS; i++)
+    {
+        ret = pthread_create(&tids[i], NULL, &thread_fun, (void *)&fd);
+        if (ret)
+        {
+            tid_err("pthread_create");
+            goto thread_fail;
+        }
+    }
+
+    for (i = 0; i < THREADS; i++)
+    {
+        ret = pthread_join(tids[i], NULL);
+        if (ret)
+        {
+            tid_err("pthread_join");
+            goto thread_fail;
+        }
+    }
+
+    /* No global order is kept, but messages of each writer
+       must come in the order they were written. */
+    info("Reading %d messages", THREADS * MSG_TO_WRITE);
+    for (i = 0; i < THREADS * MSG_TO_WRITE; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        bytes = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        if (bytes <= 0)
+        {
+            tid_err("read %d", i);
+            break;
+        }
+        tid_info("Read %ld bytes: '%s'", bytes, msg);
+
+        sscanf(msg, "%d %ld", &seq, &tid);
+        for (j = 0; j < THREADS && tids_seen[j] && tids_seen[j] != tid; j++)
+            ;
+        if (j == THREADS)
+        {
+            tid_err("unknown writer %ld", tid);
+            continue;
+        }
+        tids_seen[j] = tid;
+        if (seq != next[j])
+        {
+            tid_err("message %d of %ld read before message %d", seq, tid, next[j]);
+        }
+        next[j] = seq + 1;
+    }
+
+thread_fail:
+    close_group(fd);
+    tid_info("group_dev%d closed with fd %d", DESC, fd);
+fd_fail:
+    tid_end();
+    return 0;
+}
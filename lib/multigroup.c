@@ -13,7 +13,7 @@ int main(int argc, char *argv[])
     int i;
     int fd[TO_INSTALL] = {};
     unsigned char desc[TO_INSTALL] = {};
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
 
     start(argv[0]);
 
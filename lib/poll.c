@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define GROUPS 2
+#define TIMEOUT 10000
+
+void child_fun(int *fds)
+{
+    int i;
+    char msg[MESSAGE_SIZE] = {};
+
+    tid_start();
+
+    /* Let the parent wait on every group. */
+    sleep(1);
+    for (i = 0; i < GROUPS; i++)
+    {
+        sprintf(msg, "%ld was here for group %d", gettid(), i);
+        if (send_message(fds[i], msg) < 0)
+        {
+            tid_err("write %d", i);
+        }
+        tid_info("Written '%s'", msg);
+    }
+
+    /* Wake up the blocking reader. */
+    sleep(1);
+    sprintf(msg, "%ld was here again", gettid());
+    if (send_message(fds[0], msg) < 0)
+    {
+        tid_err("write again");
+    }
+    tid_info("Written '%s'", msg);
+
+    tid_end();
+    return;
+}
+
+int main(int argc, char *argv[])
+{
+    int fds[GROUPS], efd, i, j, n, opened, status;
+    unsigned char descs[GROUPS] = {0, 2};
+    unsigned char modes[GROUPS] = {GROUP_MODE_LIST, GROUP_MODE_RING};
+    struct group_t group_descriptor = {};
+    struct epoll_event ev, events[GROUPS];
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+    pid_t pid;
+
+    tid_info("EXECUTING %s\n", argv[0]);
+
+    for (opened = 0; opened < GROUPS; opened++)
+    {
+        group_descriptor.desc = descs[opened];
+        group_descriptor.mode = modes[opened];
+        fds[opened] = open_group(&group_descriptor);
+        if (fds[opened] < 0)
+        {
+            tid_err("open_group fd");
+            goto fd_fail;
+        }
+        tid_info("group_dev%d opened with fd %d", descs[opened], fds[opened]);
+    }
+
+    efd = epoll_create1(0);
+    if (efd < 0)
+    {
+        tid_err("epoll_create1");
+        goto fd_fail;
+    }
+
+    for (i = 0; i < GROUPS; i++)
+    {
+        ev.events = EPOLLIN;
+        ev.data.fd = fds[i];
+        if (epoll_ctl(efd, EPOLL_CTL_ADD, fds[i], &ev) < 0)
+        {
+            tid_err("epoll_ctl %d", fds[i]);
+            goto epoll_fail;
+        }
+    }
+
+    if ((pid = fork()) < 0)
+    {
+        tid_err("fork");
+        goto epoll_fail;
+    }
+    else if (pid == 0)
+    {
+        child_fun(fds);
+        exit(0);
+    }
+
+    /* Wait for one message on each group. */
+    tid_info("Waiting messages on %d groups", GROUPS);
+    i = 0;
+    while (i < GROUPS)
+    {
+        n = epoll_wait(efd, events, GROUPS, TIMEOUT);
+        if (n <= 0)
+        {
+            tid_err("epoll_wait");
+            goto wait_fail;
+        }
+        for (j = 0; j < n; j++)
+        {
+            ret = retrieve_message(events[j].data.fd, msg, MESSAGE_SIZE - 1);
+            if (ret > 0)
+            {
+                msg[ret] = 0;
+                tid_info("Read %ld bytes from fd %d: '%s'", ret, events[j].data.fd, msg);
+                i++;
+            }
+        }
+    }
+
+    /* Now sleep in read() until the last message comes. */
+    tid_info("Blocking read on fd %d", fds[0]);
+    set_blocking(fds[0], 1);
+    ret = retrieve_message(fds[0], msg, MESSAGE_SIZE - 1);
+    if (ret > 0)
+    {
+        msg[ret] = 0;
+        tid_info("Read %ld bytes: '%s'", ret, msg);
+    }
+
+wait_fail:
+    tid_info("Child with PID %ld exited with status 0x%x.", (long)wait(&status), status);
+epoll_fail:
+    close(efd);
+fd_fail:
+    while (--opened >= 0)
+    {
+        close_group(fds[opened]);
+    }
+    tid_end();
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+#include "../kmodule/ioctl.h"
+
+#define DESC 9
+
+int main(int argc, char *argv[])
+{
+    int bulk_fd, control_fd, i;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    bulk_fd = open_group(&group_descriptor);
+    if (bulk_fd < 0)
+    {
+        err("open_group bulk_fd");
+        goto bulk_fail;
+    }
+
+    /* A second file of the same group device, with its own
+       priority. */
+    control_fd = open_group(&group_descriptor);
+    if (control_fd < 0)
+    {
+        err("open_group control_fd");
+        goto control_fail;
+    }
+    if (set_priority(control_fd, GROUP_PRIORITY_LEVELS - 1) < 0)
+    {
+        err("set_priority");
+        goto priority_fail;
+    }
+    info("group_dev%d opened with fds %d and %d", DESC, bulk_fd, control_fd);
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "bulk message %d", i);
+        ret = send_message(bulk_fd, msg);
+        info("Written %ld bytes: '%s'", ret, msg);
+    }
+    sprintf(msg, "control message");
+    ret = send_message(control_fd, msg);
+    info("Written %ld bytes: '%s'", ret, msg);
+
+    /* The control message comes first, then bulk ones in FIFO
+       order. */
+    for (i = 0; i < MSG_TO_READ; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(bulk_fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes: '%s'", ret, msg);
+    }
+
+priority_fail:
+    close_group(control_fd);
+control_fail:
+    close_group(bulk_fd);
+    info("group_dev%d closed", DESC);
+bulk_fail:
+    end();
+    return 0;
+}
@@ -12,7 +12,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc;
     int fd, i;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
     long delay;
     size_t msg_size;
     char *txt, msg[MESSAGE_SIZE] = {};
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+void child_fun(int fd)
+{
+    struct shared_group group;
+    char msg[MESSAGE_SIZE] = {};
+
+    tid_start();
+
+    /* Mappings are inherited, but map again as an unrelated
+       process would do. */
+    if (map_group(fd, &group) < 0)
+    {
+        tid_err("map_group");
+        return;
+    }
+
+    /* Let the parent sleep into the kernel. */
+    sleep(1);
+    sprintf(msg, "%ld was here", gettid());
+    if (send_shared_message(&group, msg, strlen(msg)) <= 0)
+    {
+        tid_err("send_shared_message");
+    }
+    tid_info("Written '%s'", msg);
+
+    unmap_group(&group);
+    tid_end();
+    return;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd, i, status;
+    struct group_t group_descriptor = {};
+    struct shared_group group;
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+    pid_t pid;
+
+    tid_info("EXECUTING %s\n", argv[0]);
+
+    group_descriptor.desc = 3;
+    group_descriptor.mode = GROUP_MODE_SHARED;
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        tid_err("open_group fd");
+        goto exit;
+    }
+    tid_info("group_dev%d opened with fd %d", group_descriptor.desc, fd);
+
+    if (map_group(fd, &group) < 0)
+    {
+        tid_err("map_group");
+        goto fd_fail;
+    }
+
+    /* Written from userspace, read by the kernel. */
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "shared message %d", i);
+        ret = send_shared_message(&group, msg, strlen(msg));
+        tid_info("Written %ld bytes: '%s'", ret, msg);
+    }
+    for (i = 0; i < MSG_TO_READ; i++)
+    {
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        msg[ret > 0 ? ret : 0] = 0;
+        tid_info("Read %ld bytes: '%s'", ret, msg);
+    }
+
+    /* Written by the kernel, read from userspace. */
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "regular message %d", i);
+        ret = send_message(fd, msg);
+        tid_info("Written %ld bytes: '%s'", ret, msg);
+    }
+    for (i = 0; i < MSG_TO_READ; i++)
+    {
+        ret = retrieve_shared_message(&group, msg, MESSAGE_SIZE - 1);
+        msg[ret > 0 ? ret : 0] = 0;
+        tid_info("Read %ld bytes: '%s'", ret, msg);
+    }
+
+    if ((pid = fork()) < 0)
+    {
+        tid_err("fork");
+        goto map_fail;
+    }
+    else if (pid == 0)
+    {
+        child_fun(fd);
+        exit(0);
+    }
+
+    /* Sleep in read() until the child writes from userspace. */
+    tid_info("Blocking read on fd %d", fd);
+    set_blocking(fd, 1);
+    ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+    if (ret > 0)
+    {
+        msg[ret] = 0;
+        tid_info("Read %ld bytes: '%s'", ret, msg);
+    }
+    tid_info("Child with PID %ld exited with status 0x%x.", (long)wait(&status), status);
+
+map_fail:
+    unmap_group(&group);
+fd_fail:
+    close_group(fd);
+exit:
+    tid_end();
+    return 0;
+}
@@ -25,7 +25,7 @@ int main(int argc, char *argv[])
 {
     unsigned char desc = 1;
     int fd, status;
-    struct group_t group_descriptor;
+    struct group_t group_descriptor = {};
     pid_t pid;
 
     tid_info("EXECUTING %s\n", argv[0]);
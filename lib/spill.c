@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 15
+
+int main(int argc, char *argv[])
+{
+    int fd, i;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    /* Far more than the storage holds: unless the module was
+       loaded with spill_dir, writes fail once it is full. */
+    set_blocking(fd, 0);
+    for (i = 0; i < E_MSG_TO_WRITE; i++)
+    {
+        sprintf(msg, "spilled message %d", i);
+        ret = send_message(fd, msg);
+        if (ret < 0)
+        {
+            info("Storage full after %d messages", i);
+            break;
+        }
+    }
+    info("Written %d messages", i);
+
+    /* Messages come back in order, either from memory or from
+       the backing file. */
+    for (i = 0; i < E_MSG_TO_WRITE; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        if (ret <= 0)
+        {
+            break;
+        }
+        info("Read %ld bytes: '%s'", ret, msg);
+    }
+
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}
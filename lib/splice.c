@@ -0,0 +1,69 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 6
+
+int main(int argc, char *argv[])
+{
+    int fd;
+    int pipefd[2];
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    if (pipe(pipefd) < 0)
+    {
+        err("pipe");
+        goto pipe_fail;
+    }
+
+    /* Pipe to group device: the pipe content becomes one message. */
+    sprintf(msg, "spliced into group_dev%d", DESC);
+    ret = write(pipefd[1], msg, strlen(msg));
+    ret = splice(pipefd[0], NULL, fd, NULL, MESSAGE_SIZE, 0);
+    info("Spliced %ld bytes into group_dev%d", ret, DESC);
+
+    memset(msg, 0, MESSAGE_SIZE);
+    ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+    info("Read %ld bytes: '%s'", ret, msg);
+
+    /* Group device to pipe: one message is moved into the pipe. */
+    sprintf(msg, "spliced out of group_dev%d", DESC);
+    ret = send_message(fd, msg);
+    info("Written %ld bytes: '%s'", ret, msg);
+
+    ret = splice(fd, NULL, pipefd[1], NULL, MESSAGE_SIZE, 0);
+    info("Spliced %ld bytes out of group_dev%d", ret, DESC);
+
+    memset(msg, 0, MESSAGE_SIZE);
+    ret = read(pipefd[0], msg, ret > 0 ? ret : 0);
+    info("Read %ld bytes from pipe: '%s'", ret, msg);
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+pipe_fail:
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}
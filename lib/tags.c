@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+#include "../kmodule/ioctl.h"
+
+#define DESC 10
+
+#define TAG_ODD 1
+#define TAG_EVEN 2
+
+int main(int argc, char *argv[])
+{
+    int fd, odd_fd, i;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+
+    /* A reader interested in odd messages only. */
+    odd_fd = open_group(&group_descriptor);
+    if (odd_fd < 0)
+    {
+        err("open_group odd_fd");
+        goto odd_fail;
+    }
+    if (subscribe(odd_fd, 1U << TAG_ODD) < 0)
+    {
+        err("subscribe");
+        goto tag_fail;
+    }
+    info("group_dev%d opened with fds %d and %d", DESC, fd, odd_fd);
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        set_tag(fd, i % 2 ? TAG_ODD : TAG_EVEN);
+        sprintf(msg, "message %d", i);
+        ret = send_message(fd, msg);
+        info("Written %ld bytes: '%s'", ret, msg);
+    }
+
+    /* Odd messages only, then nothing. */
+    for (i = 0; i < MSG_TO_WRITE / 2 + 1; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(odd_fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes through odd_fd: '%s'", ret, msg);
+    }
+
+    /* Even messages are left for the other file descriptor. */
+    for (i = 0; i < MSG_TO_WRITE - MSG_TO_WRITE / 2 + 1; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes through fd: '%s'", ret, msg);
+    }
+
+tag_fail:
+    close_group(odd_fd);
+odd_fail:
+    close_group(fd);
+    info("group_dev%d closed", DESC);
+fd_fail:
+    end();
+    return 0;
+}
@@ -2,9 +2,12 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <errno.h>
+#include <linux/io_uring.h>
 
 #include "tsm_lib.h"
 #include "../kmodule/ioctl.h"
@@ -22,15 +25,6 @@ int open_group(struct group_t *group_descriptor)
         goto exit;
     }
 
-    if (group_descriptor->desc < 0)
-    {
-        errno = -EINVAL;
-        ret = -1;
-        goto exit;
-    }
-
-    //MAY ADD CHECK ON DESC UPPERBOUND
-
     /* Open tsm dev.
        It will mediate the opening of a group device. */
     fd = open(TSM_DEV, O_RDWR);
@@ -93,7 +87,7 @@ int open_group(struct group_t *group_descriptor)
     {
         /* Try to open the group device. If file descriptor is 
            non-negative, open was successful. */
-        fd = open(group_dev_name, O_RDWR);
+        fd = open(group_dev_name, O_RDWR | O_NONBLOCK);
         if (fd >= 0)
         {
             dbg("congrats udev");
@@ -161,6 +155,11 @@ ssize_t send_message(int fd, char *msg)
     dbg("write %ld bytes to %d ", length, fd);
     /* Write a message. */
     ret = write(fd, msg, length);
+    if (ret < 0 && errno == EAGAIN)
+    {
+        dbg("no space to write to %d", fd);
+        ret = 0;
+    }
 exit:
     return ret;
 }
@@ -190,10 +189,570 @@ ssize_t retrieve_message(int fd, char *buf, size_t length)
     dbg("read %ld bytes from %d ", length, fd);
     /* Read a message. */
     ret = read(fd, buf, length);
+    if (ret < 0 && errno == EAGAIN)
+    {
+        dbg("no message to read from %d", fd);
+        ret = 0;
+    }
+exit:
+    return ret;
+}
+
+int set_blocking(int fd, int blocking)
+{
+    int ret, flags;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+    {
+        err("F_GETFL");
+        ret = -1;
+        goto exit;
+    }
+
+    /* Blocking reads are the default for the group device,
+       the library opens it non-blocking. */
+    if (blocking)
+    {
+        flags &= ~O_NONBLOCK;
+    }
+    else
+    {
+        flags |= O_NONBLOCK;
+    }
+
+    dbg("fd %d %sblocking", fd, blocking ? "" : "non-");
+    ret = fcntl(fd, F_SETFL, flags);
+exit:
+    return ret;
+}
+
+int send_messages(int fd, struct iovec *iov, unsigned int vlen)
+{
+    int ret;
+    struct group_batch batch;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    /* Check batch. */
+    if (!iov || !vlen || vlen > GROUP_BATCH_MAX)
+    {
+        err("batch");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    batch.iov = iov;
+    batch.vlen = vlen;
+
+    dbg("IOCTL_SEND_BATCH of %u messages", vlen);
+    /* Invoke right IOCTL call with batch as argument. */
+    ret = ioctl(fd, IOCTL_SEND_BATCH, &batch);
+    if (ret < 0 && errno == EAGAIN)
+    {
+        dbg("no space to write to %d", fd);
+        ret = 0;
+    }
+exit:
+    return ret;
+}
+
+int retrieve_messages(int fd, struct iovec *iov, unsigned int vlen)
+{
+    int ret;
+    struct group_batch batch;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    /* Check batch. */
+    if (!iov || !vlen || vlen > GROUP_BATCH_MAX)
+    {
+        err("batch");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    batch.iov = iov;
+    batch.vlen = vlen;
+
+    dbg("IOCTL_RECV_BATCH of %u messages", vlen);
+    /* Invoke right IOCTL call with batch as argument. */
+    ret = ioctl(fd, IOCTL_RECV_BATCH, &batch);
+    if (ret < 0 && errno == EAGAIN)
+    {
+        dbg("no message to read from %d", fd);
+        ret = 0;
+    }
 exit:
     return ret;
 }
 
+/* Returns the slot hosting position pos. */
+static struct shared_slot *shared_slot(struct shared_group *group, __u64 pos)
+{
+    struct shared_header *header = group->header;
+
+    return (struct shared_slot *)((char *)group->mem + header->data_offset +
+                                  (pos & (header->slot_count - 1)) * header->slot_size);
+}
+
+int map_group(int fd, struct shared_group *group)
+{
+    int ret;
+    unsigned long size;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0 || !group)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    /* Ask the kernel for the size of the region. */
+    ret = ioctl(fd, IOCTL_SHARED_SIZE, &size);
+    if (ret < 0)
+    {
+        err("IOCTL_SHARED_SIZE");
+        errno = -ENOSYS;
+        goto exit;
+    }
+
+    group->mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (group->mem == MAP_FAILED)
+    {
+        err("mmap");
+        errno = -ENOMEM;
+        ret = -1;
+        goto exit;
+    }
+
+    group->fd = fd;
+    group->size = size;
+    group->header = group->mem;
+    dbg("fd %d mapped, %lu bytes", fd, size);
+    ret = 0;
+exit:
+    return ret;
+}
+
+ssize_t send_shared_message(struct shared_group *group, const char *msg, size_t length)
+{
+    ssize_t ret;
+    __u64 pos;
+    __s64 diff;
+    __s32 count;
+    struct shared_slot *slot;
+    struct shared_header *header;
+
+    if (!group || !group->header || !msg || !length)
+    {
+        err("shared message");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+    header = group->header;
+
+    if (length > header->slot_size - sizeof(struct shared_slot))
+    {
+        length = header->slot_size - sizeof(struct shared_slot);
+    }
+    if (max_message_size && length > max_message_size)
+    {
+        length = max_message_size;
+    }
+
+    /* Reserve a slot, unless every slot is already taken. */
+    count = __atomic_load_n(&header->count, __ATOMIC_RELAXED);
+    do
+    {
+        if (count >= (__s32)header->slot_count)
+        {
+            dbg("no space to write");
+            ret = 0;
+            goto exit;
+        }
+    } while (!__atomic_compare_exchange_n(&header->count, &count, count + 1, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    /* Claim a position. */
+    pos = __atomic_load_n(&header->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        slot = shared_slot(group, pos);
+        diff = (__s64)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (!diff)
+        {
+            /* Slot is free, try to claim the position. */
+            if (__atomic_compare_exchange_n(&header->enqueue_pos, &pos, pos + 1, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+            continue;
+        }
+        else if (diff < 0)
+        {
+            /* A reader of the previous lap still owns the slot. */
+            sched_yield();
+        }
+
+        pos = __atomic_load_n(&header->enqueue_pos, __ATOMIC_RELAXED);
+    }
+
+    /* Fill and publish the slot. */
+    memcpy(slot->data, msg, length);
+    slot->length = length;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    /* Readers check for messages after announcing themselves,
+       writers check for readers after publishing. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header->sleepers, __ATOMIC_RELAXED) ||
+        __atomic_load_n(&header->polled, __ATOMIC_RELAXED))
+    {
+        dbg("IOCTL_SHARED_WAKE");
+        ioctl(group->fd, IOCTL_SHARED_WAKE);
+    }
+
+    ret = length;
+exit:
+    return ret;
+}
+
+ssize_t retrieve_shared_message(struct shared_group *group, char *buf, size_t length)
+{
+    ssize_t ret;
+    __u64 pos;
+    __s64 diff;
+    __u32 size;
+    struct shared_slot *slot;
+    struct shared_header *header;
+
+    if (!group || !group->header || !buf)
+    {
+        err("shared message");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+    header = group->header;
+
+retry:
+    /* Claim the oldest published position. */
+    pos = __atomic_load_n(&header->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        slot = shared_slot(group, pos);
+        diff = (__s64)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+
+        if (!diff)
+        {
+            /* Slot is published, try to claim the position. */
+            if (__atomic_compare_exchange_n(&header->dequeue_pos, &pos, pos + 1, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+            continue;
+        }
+        else if (diff < 0)
+        {
+            dbg("no message to read");
+            ret = 0;
+            goto exit;
+        }
+
+        pos = __atomic_load_n(&header->dequeue_pos, __ATOMIC_RELAXED);
+    }
+
+    /* Copy the message out, unless the slot carries nothing. */
+    size = slot->length;
+    if (size > header->slot_size - sizeof(struct shared_slot))
+    {
+        size = header->slot_size - sizeof(struct shared_slot);
+    }
+    ret = size < length ? size : length;
+    memcpy(buf, slot->data, ret);
+
+    /* Give the slot back to the writer of the next lap. */
+    __atomic_store_n(&slot->seq, pos + header->slot_count, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&header->count, 1, __ATOMIC_RELAXED);
+
+    /* Writers check for free slots after announcing themselves,
+       readers check for writers after freeing a slot. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header->writers, __ATOMIC_RELAXED) ||
+        __atomic_load_n(&header->polled, __ATOMIC_RELAXED))
+    {
+        dbg("IOCTL_SHARED_WAKE");
+        ioctl(group->fd, IOCTL_SHARED_WAKE);
+    }
+
+    if (!size)
+    {
+        goto retry;
+    }
+exit:
+    return ret;
+}
+
+void unmap_group(struct shared_group *group)
+{
+    if (!group || !group->mem)
+    {
+        err("group");
+        errno = -EINVAL;
+        return;
+    }
+
+    munmap(group->mem, group->size);
+    group->mem = NULL;
+    group->header = NULL;
+    dbg("fd %d unmapped", group->fd);
+    return;
+}
+
+int group_ring_init(struct group_ring *ring, unsigned int entries)
+{
+    int ret;
+    size_t sqes_size;
+    struct io_uring_params params = {};
+
+    if (!ring || !entries)
+    {
+        err("ring");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+    {
+        err("io_uring_setup");
+        errno = -ENOSYS;
+        ret = -1;
+        goto exit;
+    }
+    ring->entries = params.sq_entries;
+
+    /* Map submission queue ring, its entries and completion
+       queue ring, which also holds completion entries. */
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        err("mmap sq_ring");
+        goto sq_ring_fail;
+    }
+
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        err("mmap sqes");
+        goto sqes_fail;
+    }
+
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED)
+    {
+        err("mmap cq_ring");
+        goto cq_ring_fail;
+    }
+
+    ring->sq_head = ring->sq_ring + params.sq_off.head;
+    ring->sq_tail = ring->sq_ring + params.sq_off.tail;
+    ring->sq_mask = ring->sq_ring + params.sq_off.ring_mask;
+    ring->sq_array = ring->sq_ring + params.sq_off.array;
+    ring->cq_head = ring->cq_ring + params.cq_off.head;
+    ring->cq_tail = ring->cq_ring + params.cq_off.tail;
+    ring->cq_mask = ring->cq_ring + params.cq_off.ring_mask;
+    ring->cqes = ring->cq_ring + params.cq_off.cqes;
+
+    dbg("io_uring %d set up with %u entries", ring->fd, ring->entries);
+    ret = 0;
+    goto exit;
+
+cq_ring_fail:
+    munmap(ring->sqes, sqes_size);
+sqes_fail:
+    munmap(ring->sq_ring, ring->sq_ring_size);
+sq_ring_fail:
+    close(ring->fd);
+    errno = -ENOMEM;
+    ret = -1;
+exit:
+    return ret;
+}
+
+/* Fills the next submission queue entry, if any is free. */
+static int _queue_message(struct group_ring *ring, int fd, __u8 opcode, void *buf, size_t length, unsigned long long tag)
+{
+    unsigned int tail, index;
+    struct io_uring_sqe *sqe;
+
+    if (!ring || !ring->sq_ring || fd < 0 || !buf || !length)
+    {
+        err("queue message");
+        errno = -EINVAL;
+        return -1;
+    }
+
+    tail = *ring->sq_tail + ring->queued;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries)
+    {
+        dbg("submission queue full");
+        return 0;
+    }
+
+    index = tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = length;
+    sqe->user_data = tag;
+    ring->sq_array[index] = index;
+
+    ring->queued++;
+    return 1;
+}
+
+int queue_send_message(struct group_ring *ring, int fd, const char *msg, size_t length, unsigned long long tag)
+{
+    if (max_message_size && length > max_message_size)
+    {
+        length = max_message_size;
+    }
+    return _queue_message(ring, fd, IORING_OP_WRITE, (void *)msg, length, tag);
+}
+
+int queue_retrieve_message(struct group_ring *ring, int fd, char *buf, size_t length, unsigned long long tag)
+{
+    return _queue_message(ring, fd, IORING_OP_READ, buf, length, tag);
+}
+
+int submit_messages(struct group_ring *ring, unsigned int wait)
+{
+    int ret;
+    unsigned int queued;
+
+    if (!ring || !ring->sq_ring)
+    {
+        err("ring");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    /* Publish queued entries to the kernel. */
+    queued = ring->queued;
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + queued, __ATOMIC_RELEASE);
+    ring->queued = 0;
+
+    ret = syscall(__NR_io_uring_enter, ring->fd, queued, wait,
+                  wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (ret < 0)
+    {
+        err("io_uring_enter");
+        errno = -errno;
+    }
+    dbg("submitted %d requests", ret);
+exit:
+    return ret;
+}
+
+int reap_messages(struct group_ring *ring, struct group_completion *completions, unsigned int count)
+{
+    int ret;
+    unsigned int head, tail, reaped;
+    struct io_uring_cqe *cqe;
+
+    if (!ring || !ring->cq_ring || !completions)
+    {
+        err("ring");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    reaped = 0;
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && reaped < count)
+    {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        completions[reaped].tag = cqe->user_data;
+        /* As the synchronous functions, map missing messages
+           or storage to 0. */
+        completions[reaped].res = cqe->res == -EAGAIN ? 0 : cqe->res;
+        reaped++;
+        head++;
+    }
+    ret = reaped;
+
+    /* Give entries back to the kernel. */
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    dbg("reaped %d completions", ret);
+exit:
+    return ret;
+}
+
+void group_ring_exit(struct group_ring *ring)
+{
+    if (!ring || !ring->sq_ring)
+    {
+        err("ring");
+        errno = -EINVAL;
+        return;
+    }
+
+    munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    ring->sq_ring = NULL;
+    ring->cq_ring = NULL;
+    dbg("io_uring %d torn down", ring->fd);
+    return;
+}
+
 int sleep_on_barrier(int fd)
 {
     int ret;
@@ -234,6 +793,45 @@ exit:
     return ret;
 }
 
+int set_barrier_parties(int fd, unsigned int parties)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_SET_BARRIER_PARTIES with parties %u", parties);
+    ret = ioctl(fd, IOCTL_SET_BARRIER_PARTIES, parties);
+exit:
+    return ret;
+}
+
+int wait_barrier(int fd)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_WAIT_BARRIER");
+    /* Invoke right IOCTL call. */
+    ret = ioctl(fd, IOCTL_WAIT_BARRIER);
+exit:
+    return ret;
+}
+
 int set_send_delay(int fd, long delay)
 {
     int ret;
@@ -262,6 +860,169 @@ exit:
     return ret;
 }
 
+int set_priority(int fd, unsigned int priority)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    if (priority >= GROUP_PRIORITY_LEVELS)
+    {
+        err("priority");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_SET_PRIORITY with priority %u", priority);
+    ret = ioctl(fd, IOCTL_SET_PRIORITY, priority);
+exit:
+    return ret;
+}
+
+int set_tag(int fd, unsigned int tag)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    if (tag >= GROUP_TAGS)
+    {
+        err("tag");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_SET_TAG with tag %u", tag);
+    ret = ioctl(fd, IOCTL_SET_TAG, tag);
+exit:
+    return ret;
+}
+
+int subscribe(int fd, unsigned int tags)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    if (!tags)
+    {
+        err("tags");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_SUBSCRIBE with tags %x", tags);
+    ret = ioctl(fd, IOCTL_SUBSCRIBE, tags);
+exit:
+    return ret;
+}
+
+int set_group_ttl(int fd, unsigned int ttl)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_SET_GROUP_TTL with ttl %u", ttl);
+    ret = ioctl(fd, IOCTL_SET_GROUP_TTL, (unsigned long)ttl);
+exit:
+    return ret;
+}
+
+int set_ttl(int fd, unsigned int ttl)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_SET_TTL with ttl %u", ttl);
+    ret = ioctl(fd, IOCTL_SET_TTL, (unsigned long)ttl);
+exit:
+    return ret;
+}
+
+long expired_messages(int fd)
+{
+    long ret;
+    unsigned long expired;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    ret = ioctl(fd, IOCTL_EXPIRED, &expired);
+    if (ret < 0)
+    {
+        err("IOCTL_EXPIRED");
+        goto exit;
+    }
+    ret = expired;
+exit:
+    return ret;
+}
+
+int set_header(int fd, int header)
+{
+    int ret;
+
+    /* Check validity of file descriptor. */
+    if (fd < 0)
+    {
+        err("fd");
+        errno = -EINVAL;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_SET_HEADER with header %d", header);
+    ret = ioctl(fd, IOCTL_SET_HEADER, header ? 1 : 0);
+exit:
+    return ret;
+}
+
 int revoke_delayed_messages(int fd)
 {
     int ret;
@@ -282,6 +1043,28 @@ exit:
     return ret;
 }
 
+int checkpoint_groups(void)
+{
+    int fd, ret;
+
+    /* Checkpoints are taken by the tsm device. */
+    fd = open(TSM_DEV, O_RDWR);
+    if (fd < 0)
+    {
+        err("%s open", TSM_DEV);
+        errno = -ENODEV;
+        ret = -1;
+        goto exit;
+    }
+
+    dbg("IOCTL_CHECKPOINT");
+    /* Invoke right IOCTL call. */
+    ret = ioctl(fd, IOCTL_CHECKPOINT);
+    close(fd); /* Close tsm device. */
+exit:
+    return ret;
+}
+
 void close_group(int fd)
 {
     /* Check validity of file descriptor */
@@ -1,11 +1,12 @@
 #include <string.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
 
 #include "../common.h"
 
 #define TSM_DEV "/dev/tsm"
-#define GROUP_DEV "/dev/synch/group_dev%d"
-#define GROUP_DEV_LENGTH strlen(GROUP_DEV) + 3
+#define GROUP_DEV "/dev/synch/group_dev%u"
+#define GROUP_DEV_LENGTH strlen(GROUP_DEV) + 10
 
 #define SLEEP_TIME 0.0000001
 #define ATTEMPTS 10000
@@ -51,6 +52,8 @@ static unsigned int max_message_size = 0;
  * 
  * Opens a group. The provided descriptor will be used to open,
  * or to install if it does not exist, a group device.
+ * The group device is opened in non-blocking mode, see
+ * set_blocking().
  * 
  * Returns:
  * < 0  - error
@@ -67,9 +70,15 @@ int open_group(struct group_t *group_descriptor);
  * Writes @length bytes of the message stored in @msg to
  * the group device related to the file descriptor @fd.
  * 
+ * Unless the file descriptor was made blocking by means of
+ * set_blocking(), the call returns immediately if the group
+ * device has no room for the message. Otherwise, it waits for
+ * readers to free storage.
+ * 
  * Returns:
  * -1   - error
- * >= 0 - number of written bytes
+ * 0    - no space to write
+ * > 0  - number of written bytes
  */
 ssize_t send_message(int fd, char *msg);
 
@@ -84,12 +93,316 @@ ssize_t send_message(int fd, char *msg);
  * from the group device related to the file descriptor fd. The
  * read message is stored in @buf.
  * 
+ * Unless the file descriptor was made blocking by means of
+ * set_blocking(), the call returns immediately if there is no
+ * message. Otherwise, it waits for a message to be published.
+ * 
  * Returns:
  * -1   - error
- * >= 0 - number of read bytes
+ * 0    - no message to read
+ * > 0  - number of read bytes
  */
 ssize_t retrieve_message(int fd, char *buf, size_t length);
 
+/**
+ * set_blocking() - sets the mode of a group device.
+ * 
+ * @fd: the file descriptor
+ * @blocking: whether reads must wait for messages and writes
+ * for storage
+ * 
+ * When @blocking is non-zero, retrieve_message() and
+ * retrieve_messages() on @fd sleep until a message is
+ * available instead of returning 0, while send_message() and
+ * send_messages() sleep until there is room for a message.
+ * In both cases the file descriptor can be monitored with
+ * poll(), select() and epoll.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int set_blocking(int fd, int blocking);
+
+/**
+ * send_messages() - writes several messages to the group device.
+ * 
+ * @fd: the file descriptor
+ * @iov: the messages to be sent, one per iovec
+ * @vlen: the number of messages
+ * 
+ * Writes @vlen messages, each one described by an element of
+ * @iov, with a single system call. Messages are stored in
+ * order. If the group device cannot host all of them, only
+ * the first ones are stored. As send_message(), it waits for
+ * room for the first message only if @fd was made blocking.
+ * 
+ * Returns:
+ * -1   - error
+ * >= 0 - number of stored messages
+ */
+int send_messages(int fd, struct iovec *iov, unsigned int vlen);
+
+/**
+ * retrieve_messages() - reads several messages from the group device.
+ * 
+ * @fd: the file descriptor
+ * @iov: the buffers messages will be retrieved in, one per iovec
+ * @vlen: the maximum number of messages
+ * 
+ * Reads up to @vlen messages according to the FIFO policy with
+ * a single system call. The i-th message is stored in the i-th
+ * buffer and the length of the i-th iovec is updated to the
+ * number of read bytes.
+ * 
+ * As retrieve_message(), it waits for messages only if @fd
+ * was made blocking.
+ * 
+ * Returns:
+ * -1   - error
+ * >= 0 - number of read messages
+ */
+int retrieve_messages(int fd, struct iovec *iov, unsigned int vlen);
+
+/**
+ * struct shared_group - group device mapped into memory.
+ * 
+ * @fd: the file descriptor
+ * @mem: the mapped region
+ * @size: bytes of @mem
+ * @header: the header at the beginning of @mem
+ */
+struct shared_header;
+struct shared_group
+{
+    int fd;
+    void *mem;
+    size_t size;
+    struct shared_header *header;
+};
+
+/**
+ * map_group() - maps a shared group device into memory.
+ * 
+ * @fd: the file descriptor of a group device installed with
+ * GROUP_MODE_SHARED
+ * @group: where to store the mapping
+ * 
+ * Maps the region in which the group device stores its
+ * messages, so that send_shared_message() and
+ * retrieve_shared_message() can exchange messages without
+ * entering the kernel. Regular functions keep working on @fd
+ * and interoperate with the mapped ones.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int map_group(int fd, struct shared_group *group);
+
+/**
+ * send_shared_message() - writes a message to a mapped group device.
+ * 
+ * @group: the mapped group device
+ * @msg: the message to be sent
+ * @length: the length of the message
+ * 
+ * Copies the message straight into the shared region. The
+ * kernel is entered only if some reader is sleeping on, or
+ * polling, the group device.
+ * 
+ * Returns:
+ * -1   - error
+ * 0    - no space to write
+ * > 0  - number of written bytes
+ */
+ssize_t send_shared_message(struct shared_group *group, const char *msg, size_t length);
+
+/**
+ * retrieve_shared_message() - reads a message from a mapped group device.
+ * 
+ * @group: the mapped group device
+ * @buf: the memory location in which the message will be retrieved
+ * @length: the size of the memory location
+ * 
+ * Copies the oldest message straight from the shared region.
+ * It never waits: to wait for messages, use either poll() or
+ * a blocking retrieve_message() on the file descriptor.
+ * 
+ * Returns:
+ * -1   - error
+ * 0    - no message to read
+ * > 0  - number of read bytes
+ */
+ssize_t retrieve_shared_message(struct shared_group *group, char *buf, size_t length);
+
+/**
+ * unmap_group() - unmaps a shared group device.
+ * 
+ * @group: the mapped group device
+ * 
+ * The file descriptor is left open.
+ * 
+ * Returns:
+ * void
+ */
+void unmap_group(struct shared_group *group);
+
+/**
+ * struct group_ring - io_uring instance for asynchronous
+ * messages.
+ * 
+ * @fd: the io_uring file descriptor
+ * @entries: the number of submission queue entries
+ * @queued: the number of requests queued but not submitted
+ * @sq_ring: the mapped submission queue ring
+ * @sq_ring_size: bytes of @sq_ring
+ * @sqes: the mapped submission queue entries
+ * @cq_ring: the mapped completion queue ring
+ * @cq_ring_size: bytes of @cq_ring
+ * @sq_head: @sq_ring head, advanced by the kernel
+ * @sq_tail: @sq_ring tail, advanced by the library
+ * @sq_mask: @sq_ring mask
+ * @sq_array: @sq_ring indexes into @sqes
+ * @cq_head: @cq_ring head, advanced by the library
+ * @cq_tail: @cq_ring tail, advanced by the kernel
+ * @cq_mask: @cq_ring mask
+ * @cqes: @cq_ring completion queue entries
+ */
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct group_ring
+{
+    int fd;
+    unsigned int entries;
+    unsigned int queued;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    struct io_uring_sqe *sqes;
+    void *cq_ring;
+    size_t cq_ring_size;
+
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+/**
+ * struct group_completion - outcome of an asynchronous
+ * request.
+ * 
+ * @tag: the tag the request was queued with
+ * @res: as the result of the synchronous counterpart,
+ * i.e. number of bytes, 0 if the request could not be
+ * served, or a negative error code
+ */
+struct group_completion
+{
+    unsigned long long tag;
+    long res;
+};
+
+/**
+ * group_ring_init() - sets up an io_uring instance.
+ * 
+ * @ring: the instance
+ * @entries: the maximum number of requests queued at once
+ * 
+ * Requests of a single instance may target any number of
+ * group devices. If a group device was made blocking with
+ * set_blocking(), its requests wait for messages or storage
+ * without blocking any thread. Otherwise, requests which
+ * cannot be served right away complete with 0.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int group_ring_init(struct group_ring *ring, unsigned int entries);
+
+/**
+ * queue_send_message() - queues an asynchronous write.
+ * 
+ * @ring: the instance
+ * @fd: the file descriptor
+ * @msg: the message to be sent, valid until completion
+ * @length: the length of the message
+ * @tag: identifier reported by the completion
+ * 
+ * Returns:
+ * -1   - error
+ * 0    - submission queue full, see submit_messages()
+ * 1    - request queued
+ */
+int queue_send_message(struct group_ring *ring, int fd, const char *msg, size_t length, unsigned long long tag);
+
+/**
+ * queue_retrieve_message() - queues an asynchronous read.
+ * 
+ * @ring: the instance
+ * @fd: the file descriptor
+ * @buf: the memory location in which the message will be
+ * retrieved, valid until completion
+ * @length: the size of the memory location
+ * @tag: identifier reported by the completion
+ * 
+ * Returns:
+ * -1   - error
+ * 0    - submission queue full, see submit_messages()
+ * 1    - request queued
+ */
+int queue_retrieve_message(struct group_ring *ring, int fd, char *buf, size_t length, unsigned long long tag);
+
+/**
+ * submit_messages() - submits queued requests.
+ * 
+ * @ring: the instance
+ * @wait: number of completions to wait for
+ * 
+ * All queued requests are submitted with a single system
+ * call, which also waits until at least @wait requests have
+ * completed.
+ * 
+ * Returns:
+ * -1   - error
+ * >= 0 - number of submitted requests
+ */
+int submit_messages(struct group_ring *ring, unsigned int wait);
+
+/**
+ * reap_messages() - collects completed requests.
+ * 
+ * @ring: the instance
+ * @completions: where to store completions
+ * @count: the maximum number of completions
+ * 
+ * Never waits, see submit_messages().
+ * 
+ * Returns:
+ * -1   - error
+ * >= 0 - number of collected completions
+ */
+int reap_messages(struct group_ring *ring, struct group_completion *completions, unsigned int count);
+
+/**
+ * group_ring_exit() - tears down an io_uring instance.
+ * 
+ * @ring: the instance
+ * 
+ * Group devices are left open.
+ * 
+ * Returns:
+ * void
+ */
+void group_ring_exit(struct group_ring *ring);
+
 /**
  * sleep_on_barrier() - thread sleeps.
  * 
@@ -97,7 +410,8 @@ ssize_t retrieve_message(int fd, char *buf, size_t length);
  * 
  * Puts the calling thread into sleep and raises the barrier. The
  * barrier will stay raised up until a thread wants to awaken
- * those threads sleeping on the group device.
+ * those threads sleeping on the group device. Threads going to
+ * sleep after that wait for the next awake.
  * 
  * Returns:
  * 0    - ok
@@ -111,10 +425,8 @@ int sleep_on_barrier(int fd);
  * @fd: the file descriptor
  * 
  * Awakes all threads sleeping on the group device. In particular, all
- * and only those threads sleeping on that specific group device are
- * awakened. Threads will wake up if the barrier is not raised up.
- * Indeed, the first operation the function performs is to destroy the
- * barrier.
+ * and only those threads which went to sleep on that specific group
+ * device before the call are awakened, each exactly once.
  * 
  * Returns:
  * 0    - ok
@@ -122,6 +434,44 @@ int sleep_on_barrier(int fd);
  */
 int awake_barrier(int fd);
 
+/**
+ * set_barrier_parties() - sets the party count of the
+ * counting barrier.
+ * 
+ * @fd: the file descriptor
+ * @parties: number of threads the barrier waits for, 0 to
+ * unset it
+ * 
+ * The party count is shared by all threads of all processes
+ * using the group device. Threads already waiting are
+ * released if enough of them arrived, or if the barrier is
+ * unset.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int set_barrier_parties(int fd, unsigned int parties);
+
+/**
+ * wait_barrier() - waits on the counting barrier.
+ * 
+ * @fd: the file descriptor
+ * 
+ * Puts the calling thread into sleep until as many threads as
+ * the party count called this function, like
+ * pthread_barrier_wait() across processes. The last thread to
+ * arrive releases all the others at once, then the barrier is
+ * ready for the next round. No thread has to awake the
+ * barrier.
+ * 
+ * Returns:
+ * 1    - the calling thread arrived last
+ * 0    - the calling thread has been released
+ * -1   - ko, e.g. no party count set
+ */
+int wait_barrier(int fd);
+
 /**
  * set_send_delay() - message writing delay is set.
  * 
@@ -137,6 +487,127 @@ int awake_barrier(int fd);
  */
 int set_send_delay(int fd, long delay);
 
+/**
+ * set_priority() - sets the priority of sent messages.
+ * 
+ * @fd: the file descriptor
+ * @priority: the priority level, lower than
+ * GROUP_PRIORITY_LEVELS
+ * 
+ * Messages sent through @fd from now on get @priority, while
+ * other file descriptors of the same group device keep their
+ * own. Readers are always served the oldest message of the
+ * highest non-empty level. Levels are honoured by group
+ * devices installed with GROUP_MODE_LIST only.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int set_priority(int fd, unsigned int priority);
+
+/**
+ * set_tag() - sets the tag of sent messages.
+ * 
+ * @fd: the file descriptor
+ * @tag: the tag, lower than GROUP_TAGS
+ * 
+ * Messages sent through @fd from now on are labelled with
+ * @tag, 0 being the default one.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int set_tag(int fd, unsigned int tag);
+
+/**
+ * subscribe() - sets the tags of retrieved messages.
+ * 
+ * @fd: the file descriptor
+ * @tags: bitmask with bit i set to retrieve messages labelled
+ * with tag i, GROUP_TAGS_ALL to retrieve any message
+ * 
+ * Reads through @fd, either plain, batched or asynchronous,
+ * only retrieve messages labelled with one of @tags, in FIFO
+ * order among them, and poll() reports @fd as readable only
+ * when one of them is available. Other messages are left to
+ * other file descriptors. Tags are honoured by group devices
+ * installed with GROUP_MODE_LIST only. With
+ * GROUP_MODE_BROADCAST, @fd retrieves messages published from
+ * now on, as after its first read or poll().
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int subscribe(int fd, unsigned int tags);
+
+/**
+ * set_group_ttl() - sets the time to live of messages of a
+ * group.
+ * 
+ * @fd: the file descriptor
+ * @ttl: milliseconds messages live for once published, 0 for
+ * no limit
+ * 
+ * Messages written from now on through any file descriptor of
+ * the group device related to @fd are dropped if nobody reads
+ * them within @ttl, unless set_ttl() was used on the writing
+ * file descriptor. Times to live are honoured by group devices
+ * installed with GROUP_MODE_LIST, GROUP_MODE_RING and
+ * GROUP_MODE_SHARDED.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int set_group_ttl(int fd, unsigned int ttl);
+
+/**
+ * set_ttl() - sets the time to live of sent messages.
+ * 
+ * @fd: the file descriptor
+ * @ttl: milliseconds messages live for once published, 0 for
+ * the time to live of the group
+ * 
+ * Messages sent through @fd from now on get @ttl, overriding
+ * the one of the group device.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int set_ttl(int fd, unsigned int ttl);
+
+/**
+ * expired_messages() - counts expired messages.
+ * 
+ * @fd: the file descriptor
+ * 
+ * Returns:
+ * long - number of messages of the group device related to
+ * @fd dropped since they expired
+ * -1   - ko
+ */
+long expired_messages(int fd);
+
+/**
+ * set_header() - sets whether headers are retrieved.
+ * 
+ * @fd: the file descriptor
+ * @header: 1 to retrieve headers, 0 not to
+ * 
+ * Messages retrieved through @fd from now on are preceded by
+ * a struct group_header, see ../kmodule/ioctl.h, within the
+ * same buffer. Buffers must be able to hold the header.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int set_header(int fd, int header);
+
 /**
  * revoke_delayed_messages() - publishes all delayed messages.
  * 
@@ -155,6 +626,21 @@ int set_send_delay(int fd, long delay);
  */
 int revoke_delayed_messages(int fd);
 
+/**
+ * checkpoint_groups() - checkpoints all group devices.
+ * 
+ * All group devices, with their pending messages and, for 
+ * GROUP_MODE_LIST, their published ones, are saved into the 
+ * file given as the checkpoint_path module parameter. They are 
+ * restored when the module is loaded again. Requires 
+ * CAP_SYS_ADMIN.
+ * 
+ * Returns:
+ * 0    - ok
+ * -1   - ko
+ */
+int checkpoint_groups(void);
+
 /**
  * close_group() - closes a group device.
  * 
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 13
+
+#define SHORT_TTL 100
+#define LONG_TTL 60000
+
+int main(int argc, char *argv[])
+{
+    int fd, i;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    /* Messages live shortly, unless the writer says otherwise. */
+    set_group_ttl(fd, SHORT_TTL);
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        set_ttl(fd, i % 2 ? LONG_TTL : 0);
+        sprintf(msg, "message %d with ttl %d", i, i % 2 ? LONG_TTL : SHORT_TTL);
+        ret = send_message(fd, msg);
+        info("Written %ld bytes: '%s'", ret, msg);
+    }
+
+    /* Let short lived messages expire: only the others are
+       retrieved. */
+    usleep(2 * SHORT_TTL * 1000);
+    for (i = 0; i < MSG_TO_WRITE / 2 + 1; i++)
+    {
+        memset(msg, 0, MESSAGE_SIZE);
+        ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+        info("Read %ld bytes: '%s'", ret, msg);
+    }
+    info("%ld messages expired", expired_messages(fd));
+
+    set_group_ttl(fd, 0);
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+#define DESC 7
+
+int main(int argc, char *argv[])
+{
+    int fd, i, n;
+    struct group_ring ring;
+    struct group_t group_descriptor = {};
+    struct group_completion completions[2 * MSG_TO_WRITE];
+    char msgs[MSG_TO_WRITE][MESSAGE_SIZE] = {};
+    char bufs[MSG_TO_WRITE][MESSAGE_SIZE] = {};
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%d opened with fd %d", DESC, fd);
+
+    /* Reads submitted before writes wait for messages, without
+       blocking any thread. */
+    set_blocking(fd, 1);
+
+    if (group_ring_init(&ring, 2 * MSG_TO_WRITE) < 0)
+    {
+        err("group_ring_init");
+        goto ring_fail;
+    }
+
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        queue_retrieve_message(&ring, fd, bufs[i], MESSAGE_SIZE - 1, MSG_TO_WRITE + i);
+    }
+    for (i = 0; i < MSG_TO_WRITE; i++)
+    {
+        sprintf(msgs[i], "async message %d to group_dev%d", i, DESC);
+        queue_send_message(&ring, fd, msgs[i], strlen(msgs[i]), i);
+    }
+
+    /* A single system call submits every request and waits for
+       all of them. */
+    n = submit_messages(&ring, 2 * MSG_TO_WRITE);
+    info("Submitted %d requests", n);
+
+    n = reap_messages(&ring, completions, 2 * MSG_TO_WRITE);
+    for (i = 0; i < n; i++)
+    {
+        if (completions[i].tag < MSG_TO_WRITE)
+        {
+            info("Written %ld bytes: '%s'", completions[i].res, msgs[completions[i].tag]);
+        }
+        else
+        {
+            info("Read %ld bytes: '%s'", completions[i].res, bufs[completions[i].tag - MSG_TO_WRITE]);
+        }
+    }
+
+    group_ring_exit(&ring);
+ring_fail:
+    close_group(fd);
+    info("group_dev%d closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}
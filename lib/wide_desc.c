@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tsm_lib.h"
+#include "test.h"
+
+/* Descriptors are no longer bounded by the number of minors. */
+#define DESC 4000000000u
+
+int main(int argc, char *argv[])
+{
+    int fd;
+    struct group_t group_descriptor = {};
+    char msg[MESSAGE_SIZE] = {};
+    ssize_t ret;
+
+    start(argv[0]);
+
+    group_descriptor.desc = DESC;
+
+    fd = open_group(&group_descriptor);
+    if (fd < 0)
+    {
+        err("open_group fd");
+        goto fd_fail;
+    }
+    info("group_dev%u opened with fd %d", DESC, fd);
+
+    sprintf(msg, "hello from group_dev%u", DESC);
+    ret = send_message(fd, msg);
+    info("Written %ld bytes: '%s'", ret, msg);
+
+    memset(msg, 0, MESSAGE_SIZE);
+    ret = retrieve_message(fd, msg, MESSAGE_SIZE - 1);
+    info("Read %ld bytes: '%s'", ret, msg);
+
+    close_group(fd);
+    info("group_dev%u closed with fd %d", DESC, fd);
+
+fd_fail:
+    end();
+    return 0;
+}